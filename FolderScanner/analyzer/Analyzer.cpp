@@ -4,268 +4,476 @@
 #include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <iomanip>
 #include <iostream>
 #include <syncstream>
 #include <memory>
-#include <queue>
+#include <stdexcept>
 #include <unordered_map>
-#include <windows.h>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 
 namespace anal
 {
-	namespace
-	{
-        std::queue<fs_tree::Folder*> work_queue_;
-        std::mutex work_queue_mutex_;
-
-        std::condition_variable loading_condition_variable_;
-        
-        std::atomic_int accessed_ = 0;
-        std::atomic_int loading_working_ = 0;
-        std::atomic_bool loading_finished_ = true;
-        std::atomic_bool calculating_finished_ = true;
-
-        void PushWork(fs_tree::Folder* folder)
-        {
-            std::unique_lock lock(work_queue_mutex_);
-            work_queue_.push(folder);
-            loading_condition_variable_.notify_one();
-        }   
+    Scanner::Scanner(ScanPool& pool) : pool_(pool)
+    {
+    }
+
+    Scanner::~Scanner()
+    {
+        Cancel();
+    }
+
+    void Scanner::NotifyPending()
+    {
+        // Taking the mutex orders the notification after the manager's predicate check.
+        std::unique_lock lock(pending_folders_mutex_);
+        pending_folders_condition_variable_.notify_all();
+    }
+
+    void Scanner::PushWork(std::uint32_t slot, load_work work)
+    {
+        pending_folders_.fetch_add(1);
+        scheduler_.Push(slot, work);
+        StartLoader();
+    }
+
+    void Scanner::FinishWork()
+    {
+        if (pending_folders_.fetch_sub(1) == 1) NotifyPending();
+    }
 
-        fs_tree::Folder* PopWork()
+    void Scanner::CountAccessed(std::uint64_t num)
+    {
+        const auto accessed = accessed_.fetch_add(num) + num;
+        if (options_.entry_budget > 0 && accessed >= options_.entry_budget && !budget_exceeded_.exchange(true))
         {
-            std::unique_lock lock(work_queue_mutex_);
-            if (work_queue_.empty()) return nullptr;
-            auto top = work_queue_.front();
-            work_queue_.pop();
-            return top;
+            NotifyPending();
         }
+    }
+
+    // Estimated subtree size of each subfolder of a folder that was just read. What the ancestors were estimated
+    // to hold beyond the files seen here is split evenly between the subfolders, and a folder with large files or
+    // many entries (counted at the average entry size so far) raises that estimate for its whole branch.
+    std::uint64_t Scanner::SubfolderWeight(const load_work& work, const fs_tree::directory_listing& listing, std::size_t subfolder_num)
+    {
+        if (subfolder_num == 0) return 0;
 
-        fs_tree::Folder* PopWorkNoLock()
+        std::uint64_t bytes = 0;
+        for (const auto& entry : listing.entries)
         {
-            if (work_queue_.empty()) return nullptr;
-            auto top = work_queue_.front();
-            work_queue_.pop();
-            return top;
+            if (entry.type == fs_tree::entry_type::file) bytes += entry.size;
         }
+        const auto seen = bytes_seen_.fetch_add(bytes) + bytes;
+        const auto average = seen / std::max<std::uint64_t>(accessed_.load(), 1);
+
+        const auto inherited = work.weight > bytes ? work.weight - bytes : 0;
+        const auto observed = bytes + listing.entries.size() * average;
+        return std::max(inherited, observed) / subfolder_num;
+    }
+
+    // True if the folder at 'path' still has the stamp it had in the previous scan, so its entries can be copied.
+    bool Scanner::Unchanged(const std::filesystem::path& path, fs_tree::FolderId previous) const
+    {
+        if (previous == fs_tree::invalid_folder) return false;
+
+        std::uint64_t modified = 0;
+        return fs_tree::ReadDirectoryModified(path, modified) && modified != 0 && modified == previous_tree_->FolderModified(previous);
+    }
+
+    void Scanner::StartLoader()
+    {
+        if (idle_slots_.load() == 0) return;
+
+        std::unique_lock lock(state_mutex_);
+        if (free_slots_.empty() || scheduler_.Stopped()) return;
+
+        const auto slot = free_slots_.back();
+        free_slots_.pop_back();
+        idle_slots_.fetch_sub(1);
+        active_loaders_++;
 
-        std::uint64_t QueueSize()
+        const auto posted = std::chrono::steady_clock::now();
+        pool_.Post([this, slot, posted]() { RunLoader(slot, posted); });
+    }
+
+    void Scanner::RunLoader(std::uint32_t index, std::chrono::steady_clock::time_point posted)
+    {
+        auto& slot = slots_[index];
+        auto& stats = slot.stats;
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto wait = Nanoseconds(start - posted);
+        stats.phase_ns[static_cast<std::size_t>(scan_phase::idle)] += wait;
+        stats.idle_us[HistogramBucket(wait / 1000)]++;
+        const auto cpu_start = ThreadCpuNanoseconds();
+        const auto reads = fs_tree::ThreadReadCounters();
+
+        // Gives the thread back after a time slice even while there's work, so the loaders of other scans on the
+        // pool get their turn.
+        while (true)
         {
-            std::unique_lock lock(work_queue_mutex_);
-            return work_queue_.size();
+            stats.queue_depth[HistogramBucket(scheduler_.Size())]++;
+            const auto work = scheduler_.TryPop(index);
+            if (!work) break;
+
+            LoadFolder(slot, index, *work);
+            if (std::chrono::steady_clock::now() - start >= time_slice) break;
         }
 
-        void LoadFolder(fs_tree::Folder* folder)
+        stats.wall_ns += Nanoseconds(std::chrono::steady_clock::now() - start);
+        stats.cpu_ns += ThreadCpuNanoseconds() - cpu_start;
+        stats.reads += fs_tree::ThreadReadCounters() - reads;
+
+        // The slot is freed before the queue is checked, while PushWork queues before it checks for free slots, so
+        // one of the two always sees the other. Everything happens under the lock: once active_loaders_ drops to
+        // zero the scanner may be gone.
+        std::unique_lock lock(state_mutex_);
+        free_slots_.push_back(index);
+        idle_slots_.fetch_add(1);
+        active_loaders_--;
+
+        if (scheduler_.Size() > 0 && !scheduler_.Stopped())
+        {
+            const auto next = free_slots_.back();
+            free_slots_.pop_back();
+            idle_slots_.fetch_sub(1);
+            active_loaders_++;
+
+            const auto reposted = std::chrono::steady_clock::now();
+            pool_.Post([this, next, reposted]() { RunLoader(next, reposted); });
+        }
+        else if (active_loaders_ == 0)
         {
-            loading_working_.fetch_add(1);
-            if (!folder) return;
+            state_condition_variable_.notify_all();
+        }
+    }
 
-            try
+    void Scanner::LoadFolder(loader_slot& slot, std::uint32_t index, load_work work)
+    {
+        thread_local fs_tree::directory_listing listing;
+        thread_local std::unordered_map<fs_tree::native_string_view, fs_tree::FolderId> previous_subfolders;
+
+        auto& stats = slot.stats;
+        const auto folder = work.folder;
+        const auto start = std::chrono::steady_clock::now();
+        const auto stat_ns = fs_tree::ThreadReadCounters().stat_ns;
+        auto read = start;
+        try
+        {
+            const auto path = tree_->FolderPath(folder);
+            if (Unchanged(path, work.previous))
             {
-                const auto iterator = folder->GetDirectoryIterator();
-                if (iterator != std::nullopt)
+                read = std::chrono::steady_clock::now();
+                // Subfolders are still checked one by one, the stamp of a folder doesn't change with theirs.
+                const auto subfolders = tree_->CopyChildren(slot.writer, folder, *previous_tree_, work.previous);
+                const auto entries = subfolders.size() + tree_->Files(folder).size();
+                CountAccessed(entries);
+                reused_.fetch_add(1);
+                stats.entries += entries;
+                stats.reused++;
+                slot.types.AddFiles(*tree_, folder);
+                if (options_.on_folder) options_.on_folder(*tree_, folder);
+
+                // The previous sizes are the best estimate there is.
+                auto previous = previous_tree_->SubFolders(work.previous).begin();
+                for (const auto subfolder : subfolders)
                 {
-                    auto analyze_lambda = [&](const std::filesystem::directory_entry& item)
-                        {
-                            accessed_.fetch_add(1);
-                            const auto status = item.status();
-                            const auto type = status.type();
-                            const auto path = item.path();
-
-                            if (std::filesystem::exists(path))
-                            {
-                                switch (type)
-                                {
-                                case std::filesystem::file_type::regular:
-                                {
-                                    auto file = std::make_unique<fs_tree::File>(path);
-                                    folder->AddFile(std::move(file));
-                                    break;
-                                }
-                                case std::filesystem::file_type::directory:
-                                {
-                                    auto directory = std::make_unique<fs_tree::Folder>(path);
-                                    PushWork(directory.get());
-                                    folder->AddFolder(std::move(directory));
-                                    break;
-                                }
-                                }
-                            }
-                        };
-
-                    std::ranges::for_each(iterator.value(), analyze_lambda);
+                    const auto weight = options_.largest_first ? previous_tree_->FolderSize(*previous) : 0;
+                    PushWork(index, { subfolder, *previous++, weight });
                 }
             }
-            catch (std::exception e)
+            else if (fs_tree::ReadDirectory(path, listing, read_options_))
             {
-                std::osyncstream(std::cout) << e.what() << " " << folder->path_ << std::endl;
-            }
-
+                read = std::chrono::steady_clock::now();
+                if (visited_directories_ && listing.inode != 0 && !visited_directories_->Add({ listing.device, listing.inode }, folder).second)
+                {
+                    // Reached again through a symlink, the folder stays but isn't loaded a second time.
+                    listing.names.clear();
+                    listing.entries.clear();
+                }
 
-            loading_working_.fetch_sub(1);
-        }
+                CountAccessed(listing.entries.size());
+                stats.entries += listing.entries.size();
 
-        void LoadFolderThread(std::uint32_t internal_tid)
-        {
-            const auto mask = 1 << internal_tid;
-            SetThreadAffinityMask(GetCurrentThread(), mask);
-            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-            auto id = std::this_thread::get_id()._Get_underlying_id();
-            while (true)
-            {
-                fs_tree::Folder* folder = nullptr;
+                previous_subfolders.clear();
+                if (work.previous != fs_tree::invalid_folder)
                 {
-                    std::unique_lock lock(work_queue_mutex_);
-
-                    loading_condition_variable_.wait(lock,
-                        [&]()
-                        {
-                            return !work_queue_.empty() || loading_finished_.load();
-                        });
+                    for (const auto previous : previous_tree_->SubFolders(work.previous))
+                    {
+                        previous_subfolders.emplace(previous_tree_->FolderName(previous), previous);
+                    }
+                }
 
-                    if (loading_finished_.load()) break;
+                const auto subfolders = tree_->AddChildren(slot.writer, folder, listing);
+                slot.types.AddFiles(*tree_, folder);
+                if (options_.on_folder) options_.on_folder(*tree_, folder);
 
-                    folder = PopWorkNoLock();
+                const auto weight = options_.largest_first ? SubfolderWeight(work, listing, subfolders.size()) : 0;
+                for (const auto subfolder : subfolders)
+                {
+                    const auto previous = previous_subfolders.find(tree_->FolderName(subfolder));
+                    if (previous == previous_subfolders.end())
+                    {
+                        PushWork(index, { subfolder, fs_tree::invalid_folder, weight });
+                    }
+                    else
+                    {
+                        PushWork(index, { subfolder, previous->second, options_.largest_first ? previous_tree_->FolderSize(previous->second) : 0 });
+                    }
                 }
-
-                LoadFolder(folder);
-                if (loading_finished_.load())  break;
             }
-#if _DEBUG
-			std::osyncstream(std::cout) << "Loader thread: " << id << " exits.\n";
-#endif 
+            else
+            {
+                read = std::chrono::steady_clock::now();
+                stats.errors++;
+            }
         }
+        catch (const std::exception& e)
+        {
+            stats.errors++;
+            if (options_.log) std::osyncstream(*options_.log) << e.what() << " " << tree_->FolderPath(folder) << std::endl;
+        }
+
+        // Sizes are propagated before the folder stops counting as pending, so they are complete by the time
+        // the manager sees zero.
+        const auto inserted = std::chrono::steady_clock::now();
+        tree_->FinishFolder(folder);
+        FinishWork();
+        const auto finished = std::chrono::steady_clock::now();
+
+        // An exception leaves 'read' at the start, its time counts as inserting.
+        const auto stat = fs_tree::ThreadReadCounters().stat_ns - stat_ns;
+        const auto read_ns = Nanoseconds(read - start);
+        stats.folders++;
+        stats.phase_ns[static_cast<std::size_t>(scan_phase::read)] += read_ns > stat ? read_ns - stat : 0;
+        stats.phase_ns[static_cast<std::size_t>(scan_phase::stat)] += stat;
+        stats.phase_ns[static_cast<std::size_t>(scan_phase::insert)] += Nanoseconds(inserted - read);
+        stats.phase_ns[static_cast<std::size_t>(scan_phase::aggregate)] += Nanoseconds(finished - inserted);
+    }
 
-        void LoadFolderManagerThread(fs_tree::FilesystemTree* filesystem_tree)
+    void Scanner::PrintProgress()
+    {
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - scan_start_).count();
+        const scan_progress progress{ accessed_.load(), scheduler_.Size(), static_cast<std::uint64_t>(elapsed * 1000) };
+
+        if (options_.log)
         {
-            auto previous_working = 0;
-            auto previous_accessed = 0;
-            std::uint32_t counter = 0;
-            while (true)
+            std::osyncstream(*options_.log) << "Scanning: " << progress.accessed << " files and folders in " << std::fixed << std::setprecision(1) << elapsed << " s ("
+                << static_cast<std::uint64_t>(elapsed > 0 ? progress.accessed / elapsed : 0) << "/s), " << progress.queued << " folders queued.\n";
+        }
+        if (options_.on_progress) options_.on_progress(progress);
+    }
+
+    void Scanner::RunManager()
+    {
+        const auto stop_token = stop_source_.get_token();
+        {
+            const auto done = [&]()
             {
-                const auto w = loading_working_.load();
-                const auto a = accessed_.load();
+                return pending_folders_.load() == 0 || budget_exceeded_.load() || stop_token.stop_requested();
+            };
 
-                if (w != previous_working || a != previous_accessed)
-                {
-                    previous_working = w;
-                    previous_accessed = a;
-                    counter = 0;
-                }
-                else if (a == previous_accessed && w == previous_working)
-                {
-                    counter++;
-                }
+            using clock = std::chrono::steady_clock;
+            const auto deadline = options_.time_budget_ms > 0 ? scan_start_ + std::chrono::milliseconds(options_.time_budget_ms) : clock::time_point::max();
+            const auto interval = std::chrono::milliseconds(options_.progress_interval_ms);
+            const auto progress = (options_.log || options_.on_progress) && interval.count() > 0;
+            auto next_progress = scan_start_ + interval;
 
-                if (counter > 10)
+            std::unique_lock lock(pending_folders_mutex_);
+            while (true)
+            {
+                const auto wake = progress ? std::min(deadline, next_progress) : deadline;
+                if (wake == clock::time_point::max())
                 {
+                    pending_folders_condition_variable_.wait(lock, done);
                     break;
                 }
+                if (pending_folders_condition_variable_.wait_until(lock, wake, done)) break;
 
-                if (loading_finished_.load())
+                if (clock::now() >= deadline)
                 {
-#if _DEBUG
-                    std::osyncstream(std::cout) << "Manager Thread exits.\n";
-#endif
-                    return;
+                    budget_exceeded_.store(true);
+                    break;
                 }
 
-                Sleep(100);
+                lock.unlock();
+                PrintProgress();
+                next_progress += interval;
+                lock.lock();
             }
+        }
+
+        // A cancelled scan counts as cancelled even if it got to the end at the same time.
+        cancelled_.store(stop_token.stop_requested());
+        scheduler_.Stop();
+        {
+            std::unique_lock lock(state_mutex_);
+            state_condition_variable_.wait(lock, [this]() { return active_loaders_ == 0; });
+            scan_wall_ns_ = Nanoseconds(std::chrono::steady_clock::now() - scan_start_);
+            scan_cpu_ns_ = ProcessCpuNanoseconds() - scan_cpu_start_;
+            finished_.store(true);
+            state_condition_variable_.notify_all();
+        }
 
-            Sleep(400);
+        const auto stats = CollectStatistics();
+        if (options_.log && !cancelled_.load())
+        {
+            std::osyncstream log(*options_.log);
+            if (budget_exceeded_.load())
+            {
+                log << "Scan budget reached, " << pending_folders_.load() << " folders were left unloaded and the results are partial. \n";
+            }
+            log << "Loading folders and files concluded! \nAccessed: " << accessed_.load() << " files and folders (" << tree_->UniqueNameNum() << " distinct names). \n";
+            if (previous_tree_)
+            {
+                log << reused_.load() << " of " << tree_->FolderNum() << " folders were unchanged since the previous scan. \n";
+            }
+            // Only meant for the interactive prompt.
+            if (options_.log == &std::cout) log << "Type 'ls' and press 'enter' to print results.\n";
+        }
+        promise_.set_value(stats);
+    }
 
-            std::osyncstream(std::cout) << "Loading folders and files concluded! \n";
-          
-            FinishLoadingFolders();
+    std::shared_future<scan_stats> Scanner::Start(fs_tree::FilesystemTree* tree, const scan_options& options, const fs_tree::FilesystemTree* previous_tree, std::stop_token stop_token)
+    {
+        if (!finished_.load()) throw std::runtime_error("A scan is already running!");
+        // The manager of the previous scan may still be reporting.
+        if (manager_.joinable()) manager_.join();
+        external_stop_.reset();
 
-            std::osyncstream(std::cout) << "Calculating sizes... "<< "\n";
+        const auto thread_num = options.thread_num == 0 ? pool_.ThreadNum() : std::min(options.thread_num, pool_.ThreadNum());
 
-			std::vector<std::thread> calculator_threads;
-            const auto max_thread_num = std::thread::hardware_concurrency();
+        options_ = options;
+        read_options_ = ReadOptionsFor(options, tree->GetRootPath());
+        visited_directories_ = options.read.follow_symlinks ? std::make_unique<fs_tree::InodeSet>() : nullptr;
+        tree_ = tree;
+        previous_tree_ = previous_tree;
+        scheduler_.Reset(thread_num, options.largest_first);
 
-            auto calculate_lambda = [](fs_tree::Folder* folder, std::uint32_t internal_tid)
+        {
+            std::unique_lock lock(state_mutex_);
+            slots_.clear();
+            free_slots_.clear();
+            for (std::uint32_t i = 0; i < thread_num; i++)
             {
-                const auto mask = 1 << internal_tid;
-                SetThreadAffinityMask(GetCurrentThread(), mask);
-                SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-                auto id = std::this_thread::get_id()._Get_underlying_id();
-
-                folder->RecursiveCalculateSize();
-#if _DEBUG
-                std::osyncstream(std::cout) << "Calculator thread: " << id << " exits.\n";
-#endif  
-            };
+                slots_.push_back({ tree->CreateWriter(), {}, {} });
+                slots_.back().stats.thread = i;
+                // Taken from the back, the first loader gets slot 0 where the root is queued.
+                free_slots_.push_back(thread_num - 1 - i);
+            }
+            idle_slots_.store(thread_num);
+            active_loaders_ = 0;
+
+            scan_start_ = std::chrono::steady_clock::now();
+            scan_cpu_start_ = ProcessCpuNanoseconds();
+            scan_wall_ns_ = 0;
+            scan_cpu_ns_ = 0;
+        }
 
-            auto root = filesystem_tree->GetRoot();            
-            auto& subfolders = root->GetFolders();
-            
-            std::uint32_t tid_ctr = 0;
-            for (auto& folder : subfolders)
+        accessed_.store(0);
+        reused_.store(0);
+        bytes_seen_.store(0);
+        budget_exceeded_.store(false);
+        cancelled_.store(false);
+        pending_folders_.store(0);
+        stop_source_ = std::stop_source();
+        promise_ = std::promise<scan_stats>();
+        future_ = promise_.get_future().share();
+        finished_.store(false);
+
+        if (stop_token.stop_possible())
+        {
+            external_stop_.emplace(stop_token, [this]()
             {
-				calculator_threads.push_back(std::thread(calculate_lambda, folder.get(), tid_ctr % max_thread_num));
-				tid_ctr++;
-            }
+                stop_source_.request_stop();
+                NotifyPending();
+            });
+        }
 
-			for (auto& thread : calculator_threads)
-			{
-				thread.join();
-			}
+        const auto same_root = previous_tree && previous_tree->GetRootPath() == tree->GetRootPath();
+        PushWork(0, { tree->GetRoot(), same_root ? previous_tree->GetRoot() : fs_tree::invalid_folder });
 
-			root->CalculateSize();
-			calculating_finished_.store(true);
+        manager_ = std::thread(&Scanner::RunManager, this);
+        return future_;
+    }
 
-            std::osyncstream(std::cout) << "Calculating concluded! \nAccessed: " << accessed_.load() << " files and folders. \nType 'ls' and press 'enter' to print results.\n";
+    fs_tree::read_options ReadOptionsFor(const scan_options& options, const std::filesystem::path& root)
+    {
+        auto read = options.read;
+        read.device = 0;
+        if (options.one_filesystem) fs_tree::ReadDirectoryDevice(root, read.device);
+        return read;
+    }
 
-#if _DEBUG
-            std::osyncstream(std::cout) << "Manager Thread exits.\n";
-#endif
-        }
-	}
-	
-    void AnalyzeFilesystemTree(fs_tree::FilesystemTree* filesystem_tree)
+    void Scanner::Cancel()
     {
-		while(work_queue_.size()) work_queue_.pop();
-		accessed_.store(0);
-		loading_working_.store(0);
-		loading_finished_.store(false);
-        calculating_finished_.store(false);
-        PushWork(filesystem_tree->GetRoot());
-        
-        const auto max_thread_num = std::thread::hardware_concurrency();
-
-        for (std::uint32_t i = 0; i < max_thread_num; i++)
-        {
-            std::thread loader_thread(LoadFolderThread, i);
-            loader_thread.detach();
-        }
+        stop_source_.request_stop();
+        NotifyPending();
+        if (manager_.joinable()) manager_.join();
+    }
 
-        std::thread loader_thread_manager(LoadFolderManagerThread, filesystem_tree);
-        loader_thread_manager.detach();
+    void Scanner::Wait() const
+    {
+        std::unique_lock lock(state_mutex_);
+        state_condition_variable_.wait(lock, [this]() { return finished_.load(); });
     }
 
-    void FinishLoadingFolders()
+    bool Scanner::Finished() const
     {
-        loading_finished_.store(true);
-        loading_condition_variable_.notify_all();
+        return finished_.load();
+    }
 
+    bool Scanner::BudgetExceeded() const
+    {
+        return budget_exceeded_.load();
     }
 
-    bool LoadingFinished()
+    std::uint64_t Scanner::AccessedCount() const
     {
-        return loading_finished_.load();
+        return accessed_.load();
     }
 
-    bool ProcessingFinished()
+    scan_stats Scanner::CollectStatistics() const
     {
-        return calculating_finished_.load() && loading_finished_.load();
+        std::unique_lock lock(state_mutex_);
+        scan_stats stats;
+        if (slots_.empty()) return stats;
+
+        stats.running = !finished_.load();
+        stats.budget_exceeded = budget_exceeded_.load();
+        stats.cancelled = cancelled_.load();
+        stats.thread_num = static_cast<std::uint32_t>(slots_.size());
+        stats.accessed = accessed_.load();
+        stats.wall_ns = stats.running ? Nanoseconds(std::chrono::steady_clock::now() - scan_start_) : scan_wall_ns_;
+        stats.cpu_ns = stats.running ? ProcessCpuNanoseconds() - scan_cpu_start_ : scan_cpu_ns_;
+
+        // The loaders write their slots without the lock while the scan runs.
+        if (stats.running) return stats;
+        for (const auto& slot : slots_)
+        {
+            stats.loaders.push_back(slot.stats);
+            stats.total += slot.stats;
+        }
+        return stats;
     }
 
-   
+    scan_stats Scanner::Statistics() const
+    {
+        return CollectStatistics();
+    }
 
-    std::condition_variable& GetLoadingConditionVariable()
+    TypeTable Scanner::Types() const
     {
-		return loading_condition_variable_;
+        std::unique_lock lock(state_mutex_);
+        TypeTable types;
+        if (!finished_.load()) return types;
+
+        for (const auto& slot : slots_)
+        {
+            types += slot.types;
+        }
+        return types;
     }
-}
\ No newline at end of file
+}
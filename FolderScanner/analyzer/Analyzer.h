@@ -1,17 +1,181 @@
 #ifndef ANALYZE_ANALYZER
 #define ANALYZE_ANALYZER
 
-#include "../fs_tree/FileSystemTree.h"
+#include "../fs_tree/FilesystemTree.h"
 #include "../fs_tree/Folder.h"
+#include "../fs_tree/InodeSet.h"
+#include "FileTypes.h"
+#include "ScanPool.h"
+#include "ScanStats.h"
+#include "WorkStealingScheduler.h"
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
 namespace anal
 {
-	void AnalyzeFilesystemTree(fs_tree::FilesystemTree* filesystem_tree);
-	void FinishLoadingFolders();
-	bool LoadingFinished();
-	bool ProcessingFinished();
-	std::condition_variable& GetLoadingConditionVariable();
+	struct scan_progress
+	{
+		std::uint64_t accessed;
+		// Folders waiting to be loaded.
+		std::uint64_t queued;
+		std::uint64_t elapsed_ms;
+	};
+
+	struct scan_options
+	{
+		// Number of loaders, at most the number of threads of the pool, 0 uses all of them.
+		std::uint32_t thread_num = 0;
+		fs_tree::read_options read;
+		// Stays on the filesystem of the scanned folder: mount points below it (other disks, /proc, network
+		// shares, bind mounts of other filesystems) are listed as empty folders. Linux only.
+		bool one_filesystem = false;
+		// Loads the folders estimated to hold the most data first (see WorkStealingScheduler), so the biggest
+		// subtrees show up in partial results early.
+		bool largest_first = false;
+		// The scan stops once this many files and folders have been loaded or this many milliseconds have passed,
+		// 0 means no limit. A stopped scan keeps what it loaded: folders that weren't finished are never complete
+		// and only report FolderProgress.
+		std::uint64_t entry_budget = 0;
+		std::uint32_t time_budget_ms = 0;
+		// Where read errors, progress lines and the summary at the end of loading go, nullptr keeps the scan quiet.
+		std::ostream* log = &std::cout;
+		// Writes a progress line to 'log' and calls 'on_progress' this often while loading, 0 never does.
+		std::uint32_t progress_interval_ms = 0;
+		std::function<void(const scan_progress&)> on_progress;
+		// Called once for every folder that was read (or copied from the previous tree), right after its files and
+		// subfolders have been added, so it can look at tree.Files(folder) and tree.SubFolders(folder). Runs on the
+		// loader threads, concurrently for different folders, and slows the scan down by whatever it costs.
+		std::function<void(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder)> on_folder;
+	};
+
+	// The read options for scanning 'root' with 'options', with the device of one_filesystem resolved.
+	fs_tree::read_options ReadOptionsFor(const scan_options& options, const std::filesystem::path& root);
+
+	// Loads filesystem trees in the background, one at a time per Scanner. Every scanner has its own state, so
+	// several of them can scan different trees at once; their loaders share the threads of a ScanPool.
+	//
+	// With a previous tree (an earlier scan or snapshot of the same root, which must stay alive until loading has
+	// finished) a scan is incremental: a folder whose modification stamp hasn't changed since then takes its files
+	// and sizes from the previous tree instead of being read. Subfolders are still checked one by one; modified
+	// files in an unchanged folder keep their old sizes.
+	//
+	// When symlinks are followed, every directory is only loaded the first time it's reached, so links to an
+	// ancestor or to another part of the tree neither loop nor count twice.
+	class Scanner
+	{
+	private:
+		// A loader runs for at most this long before it gives its pool thread to the next task.
+		static constexpr std::chrono::milliseconds time_slice{ 20 };
+
+		struct loader_slot
+		{
+			fs_tree::FilesystemTree::Writer writer;
+			loader_stats stats;
+			TypeTable types;
+		};
+
+		ScanPool& pool_;
+		WorkStealingScheduler scheduler_;
+		scan_options options_;
+		fs_tree::read_options read_options_;
+		fs_tree::FilesystemTree* tree_ = nullptr;
+		const fs_tree::FilesystemTree* previous_tree_ = nullptr;
+		// Directories loaded so far, only used when symlinks are followed. The owner of an entry is the folder.
+		std::unique_ptr<fs_tree::InodeSet> visited_directories_;
+
+		// Every loader has a slot (its deque in the scheduler, its writer and its counters), a slot is used by at
+		// most one pool task at a time. Guarded by state_mutex_, like active_loaders_.
+		std::vector<loader_slot> slots_;
+		std::vector<std::uint32_t> free_slots_;
+		std::uint32_t active_loaders_ = 0;
+
+		// Notified when a loader gives its slot back and when loading finishes.
+		mutable std::mutex state_mutex_;
+		mutable std::condition_variable state_condition_variable_;
+
+		// Number of folders that were pushed but not yet fully loaded. Incremented in PushWork before the folder
+		// becomes visible to loaders and decremented once LoadFolder has pushed all of its subfolders, so it can
+		// only reach zero after the last directory of the tree has been read.
+		std::atomic_uint64_t pending_folders_ = 0;
+		std::mutex pending_folders_mutex_;
+		std::condition_variable pending_folders_condition_variable_;
+
+		std::atomic_uint64_t accessed_ = 0;
+		std::atomic_uint32_t reused_ = 0;
+		// Bytes of the files read so far, only counted when scheduling the largest folders first.
+		std::atomic_uint64_t bytes_seen_ = 0;
+		std::atomic_bool budget_exceeded_ = false;
+		std::atomic_bool cancelled_ = false;
+		std::atomic_bool finished_ = true;
+		// Number of free slots, read without the lock so pushing work doesn't take it while every loader runs.
+		std::atomic_uint32_t idle_slots_ = 0;
+
+		std::stop_source stop_source_;
+		std::optional<std::stop_callback<std::function<void()>>> external_stop_;
+		std::promise<scan_stats> promise_;
+		std::shared_future<scan_stats> future_;
+		std::thread manager_;
+
+		std::chrono::steady_clock::time_point scan_start_;
+		std::uint64_t scan_cpu_start_ = 0;
+		// Set once loading has finished, until then the statistics measure up to now.
+		std::uint64_t scan_wall_ns_ = 0;
+		std::uint64_t scan_cpu_ns_ = 0;
+
+		void PushWork(std::uint32_t slot, load_work work);
+		void FinishWork();
+		void CountAccessed(std::uint64_t num);
+		std::uint64_t SubfolderWeight(const load_work& work, const fs_tree::directory_listing& listing, std::size_t subfolder_num);
+		bool Unchanged(const std::filesystem::path& path, fs_tree::FolderId previous) const;
+
+		// Hands a free slot, if there is one, to a new loader task.
+		void StartLoader();
+		void RunLoader(std::uint32_t slot, std::chrono::steady_clock::time_point posted);
+		void LoadFolder(loader_slot& slot, std::uint32_t index, load_work work);
+
+		void RunManager();
+		void PrintProgress();
+		void NotifyPending();
+		scan_stats CollectStatistics() const;
+
+	public:
+		// Loaders run on 'pool', which must outlive the scanner.
+		explicit Scanner(ScanPool& pool = ScanPool::Shared());
+		Scanner(const Scanner&) = delete;
+		Scanner& operator=(const Scanner&) = delete;
+		// Cancels the running scan, if any.
+		~Scanner();
+
+		// Starts scanning 'tree', which must outlive the scan. The scan stops early when 'stop_token' is
+		// triggered, as if Cancel had been called but without waiting. The future becomes ready once loading has
+		// finished and no loader uses the tree anymore. Throws std::runtime_error if a scan is still running.
+		std::shared_future<scan_stats> Start(fs_tree::FilesystemTree* tree, const scan_options& options = {}, const fs_tree::FilesystemTree* previous_tree = nullptr, std::stop_token stop_token = {});
+
+		// Stops the running scan, if any, and waits until none of its loaders uses the tree anymore.
+		void Cancel();
+		void Wait() const;
+
+		// True when no scan is running: it finished, was cancelled or stopped by its budget (or never started).
+		bool Finished() const;
+		// True if the last scan was stopped by its entry or time budget before the whole tree was loaded.
+		bool BudgetExceeded() const;
+		std::uint64_t AccessedCount() const;
+		// Instrumentation of the current or last scan. The counters of the loaders are merged when loading has
+		// finished, while a scan runs only the totals are up to date.
+		scan_stats Statistics() const;
+		// Files by extension of the last scan, counted by the loaders as they add them. Empty while a scan runs.
+		TypeTable Types() const;
+	};
 }
 
 #endif // !ANALYZE_ANALYZER
-
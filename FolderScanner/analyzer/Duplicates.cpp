@@ -0,0 +1,463 @@
+#include "Duplicates.h"
+#include "../fs_tree/ParallelSort.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <memory>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+namespace anal
+{
+	namespace
+	{
+		// Big enough for the disk to stream, small enough to stay in the cache of the hashing thread.
+		constexpr std::size_t read_size = 1 << 20;
+
+		// Streaming xxHash64: four independent lanes over 32-byte stripes keep the multipliers of the CPU busy,
+		// several GB/s per thread, far more than any disk delivers.
+		class ContentHash
+		{
+		private:
+			static constexpr std::uint64_t prime_1 = 0x9E3779B185EBCA87ull;
+			static constexpr std::uint64_t prime_2 = 0xC2B2AE3D27D4EB4Full;
+			static constexpr std::uint64_t prime_3 = 0x165667B19E3779F9ull;
+			static constexpr std::uint64_t prime_4 = 0x85EBCA77C2B2AE63ull;
+			static constexpr std::uint64_t prime_5 = 0x27D4EB2F165667C5ull;
+
+			std::uint64_t lanes_[4];
+			unsigned char stripe_[32];
+			std::size_t stripe_size_ = 0;
+			std::uint64_t length_ = 0;
+			std::uint64_t seed_;
+
+			static std::uint64_t Load64(const unsigned char* data)
+			{
+				std::uint64_t value;
+				std::memcpy(&value, data, sizeof(value));
+				return value;
+			}
+
+			static std::uint32_t Load32(const unsigned char* data)
+			{
+				std::uint32_t value;
+				std::memcpy(&value, data, sizeof(value));
+				return value;
+			}
+
+			static std::uint64_t Round(std::uint64_t lane, std::uint64_t input)
+			{
+				return std::rotl(lane + input * prime_2, 31) * prime_1;
+			}
+
+			static std::uint64_t Merge(std::uint64_t hash, std::uint64_t lane)
+			{
+				return (hash ^ Round(0, lane)) * prime_1 + prime_4;
+			}
+
+			void Stripe(const unsigned char* data)
+			{
+				lanes_[0] = Round(lanes_[0], Load64(data));
+				lanes_[1] = Round(lanes_[1], Load64(data + 8));
+				lanes_[2] = Round(lanes_[2], Load64(data + 16));
+				lanes_[3] = Round(lanes_[3], Load64(data + 24));
+			}
+
+		public:
+			explicit ContentHash(std::uint64_t seed = 0)
+				: lanes_{ seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1 }, seed_(seed)
+			{
+			}
+
+			void Update(const void* data, std::size_t size)
+			{
+				auto bytes = static_cast<const unsigned char*>(data);
+				length_ += size;
+
+				if (stripe_size_ > 0)
+				{
+					const auto taken = std::min(size, sizeof(stripe_) - stripe_size_);
+					std::memcpy(stripe_ + stripe_size_, bytes, taken);
+					stripe_size_ += taken;
+					bytes += taken;
+					size -= taken;
+					if (stripe_size_ < sizeof(stripe_)) return;
+
+					Stripe(stripe_);
+					stripe_size_ = 0;
+				}
+
+				for (; size >= sizeof(stripe_); bytes += sizeof(stripe_), size -= sizeof(stripe_))
+				{
+					Stripe(bytes);
+				}
+
+				std::memcpy(stripe_, bytes, size);
+				stripe_size_ = size;
+			}
+
+			std::uint64_t Digest() const
+			{
+				std::uint64_t hash;
+				if (length_ >= sizeof(stripe_))
+				{
+					hash = std::rotl(lanes_[0], 1) + std::rotl(lanes_[1], 7) + std::rotl(lanes_[2], 12) + std::rotl(lanes_[3], 18);
+					for (const auto lane : lanes_)
+					{
+						hash = Merge(hash, lane);
+					}
+				}
+				else
+				{
+					hash = seed_ + prime_5;
+				}
+				hash += length_;
+
+				auto rest = stripe_;
+				auto size = stripe_size_;
+				for (; size >= 8; rest += 8, size -= 8)
+				{
+					hash = std::rotl(hash ^ Round(0, Load64(rest)), 27) * prime_1 + prime_4;
+				}
+				if (size >= 4)
+				{
+					hash = std::rotl(hash ^ (Load32(rest) * prime_1), 23) * prime_2 + prime_3;
+					rest += 4;
+					size -= 4;
+				}
+				for (; size > 0; rest++, size--)
+				{
+					hash = std::rotl(hash ^ (*rest * prime_5), 11) * prime_1;
+				}
+
+				hash ^= hash >> 33;
+				hash *= prime_2;
+				hash ^= hash >> 29;
+				hash *= prime_3;
+				hash ^= hash >> 32;
+				return hash;
+			}
+		};
+
+		// Reads a file at given offsets. Read returns false on errors and on files that got shorter since the scan.
+#if defined(_WIN32)
+		class ContentReader
+		{
+		private:
+			HANDLE file_ = INVALID_HANDLE_VALUE;
+
+		public:
+			ContentReader(const std::filesystem::path& path, bool sequential)
+			{
+				file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+					sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+			}
+
+			~ContentReader()
+			{
+				if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+			}
+
+			bool Opened() const
+			{
+				return file_ != INVALID_HANDLE_VALUE;
+			}
+
+			bool Read(void* buffer, std::size_t size, std::uint64_t offset)
+			{
+				auto bytes = static_cast<char*>(buffer);
+				while (size > 0)
+				{
+					OVERLAPPED position{};
+					position.Offset = static_cast<DWORD>(offset);
+					position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+					DWORD read = 0;
+					const auto chunk = static_cast<DWORD>(std::min<std::size_t>(size, std::numeric_limits<DWORD>::max()));
+					if (!ReadFile(file_, bytes, chunk, &read, &position) || read == 0) return false;
+					bytes += read;
+					size -= read;
+					offset += read;
+				}
+				return true;
+			}
+		};
+#elif defined(__unix__) || defined(__APPLE__)
+		class ContentReader
+		{
+		private:
+			int fd_ = -1;
+
+		public:
+			ContentReader(const std::filesystem::path& path, bool sequential)
+			{
+				fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#if defined(__linux__)
+				// Doubles the readahead of the whole file, partial reads only touch two blocks.
+				if (fd_ >= 0 && sequential) posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+				(void)sequential;
+#endif
+			}
+
+			~ContentReader()
+			{
+				if (fd_ >= 0) close(fd_);
+			}
+
+			bool Opened() const
+			{
+				return fd_ >= 0;
+			}
+
+			bool Read(void* buffer, std::size_t size, std::uint64_t offset)
+			{
+				auto bytes = static_cast<char*>(buffer);
+				while (size > 0)
+				{
+					const auto read = pread(fd_, bytes, size, static_cast<off_t>(offset));
+					if (read <= 0) return false;
+					bytes += read;
+					size -= static_cast<std::size_t>(read);
+					offset += static_cast<std::uint64_t>(read);
+				}
+				return true;
+			}
+		};
+#else
+		class ContentReader
+		{
+		private:
+			std::ifstream stream_;
+
+		public:
+			ContentReader(const std::filesystem::path& path, bool) : stream_(path, std::ios::binary)
+			{
+			}
+
+			bool Opened() const
+			{
+				return stream_.is_open();
+			}
+
+			bool Read(void* buffer, std::size_t size, std::uint64_t offset)
+			{
+				stream_.seekg(static_cast<std::streamoff>(offset));
+				return static_cast<bool>(stream_.read(static_cast<char*>(buffer), static_cast<std::streamsize>(size)));
+			}
+		};
+#endif
+
+		std::vector<char>& ThreadBuffer()
+		{
+			thread_local std::vector<char> buffer(read_size);
+			return buffer;
+		}
+
+		// Hashes the first and last 'partial_bytes' of a file, or all of it if that's shorter. Seeded with the size,
+		// so hashes are only ever compared between files of the same size anyway.
+		bool PartialHash(const std::filesystem::path& path, duplicate_candidate& file, std::uint32_t partial_bytes, std::uintmax_t& read_bytes)
+		{
+			ContentReader reader(path, false);
+			if (!reader.Opened()) return false;
+
+			auto& buffer = ThreadBuffer();
+			ContentHash hash(file.size);
+			if (file.size <= 2ull * partial_bytes)
+			{
+				const auto size = static_cast<std::size_t>(file.size);
+				if (buffer.size() < size) buffer.resize(size);
+				if (!reader.Read(buffer.data(), size, 0)) return false;
+				hash.Update(buffer.data(), size);
+				read_bytes += size;
+			}
+			else
+			{
+				if (buffer.size() < partial_bytes) buffer.resize(partial_bytes);
+				if (!reader.Read(buffer.data(), partial_bytes, 0)) return false;
+				hash.Update(buffer.data(), partial_bytes);
+				if (!reader.Read(buffer.data(), partial_bytes, file.size - partial_bytes)) return false;
+				hash.Update(buffer.data(), partial_bytes);
+				read_bytes += 2ull * partial_bytes;
+			}
+			file.hash = hash.Digest();
+			return true;
+		}
+
+		bool FullHash(const std::filesystem::path& path, duplicate_candidate& file, std::uintmax_t& read_bytes, std::stop_token stop_token)
+		{
+			ContentReader reader(path, true);
+			if (!reader.Opened()) return false;
+
+			auto& buffer = ThreadBuffer();
+			ContentHash hash(file.size);
+			for (std::uint64_t offset = 0; offset < file.size; offset += read_size)
+			{
+				if (stop_token.stop_requested()) return false;
+
+				const auto size = static_cast<std::size_t>(std::min<std::uint64_t>(read_size, file.size - offset));
+				if (!reader.Read(buffer.data(), size, offset)) return false;
+				hash.Update(buffer.data(), size);
+				read_bytes += size;
+			}
+			file.hash = hash.Digest();
+			return true;
+		}
+
+		// Drops the candidates that don't share their key with another one. 'candidates' must be sorted by it.
+		template<typename Equal>
+		void KeepGroups(std::vector<duplicate_candidate>& candidates, Equal equal)
+		{
+			std::size_t kept = 0;
+			for (std::size_t begin = 0, end = 0; begin < candidates.size(); begin = end)
+			{
+				for (end = begin + 1; end < candidates.size() && equal(candidates[begin], candidates[end]); end++);
+				if (end - begin < 2) continue;
+
+				for (auto i = begin; i < end; i++)
+				{
+					candidates[kept++] = std::move(candidates[i]);
+				}
+			}
+			candidates.resize(kept);
+		}
+
+		// Hashes every candidate with 'hash_file' in parallel, then keeps the ones whose size and hash match
+		// another one.
+		template<typename HashFile>
+		void HashStage(std::vector<duplicate_candidate>& candidates, ScanPool& pool, std::uint64_t& errors, HashFile hash_file)
+		{
+			std::atomic_uint64_t failed = 0;
+			ParallelFor(pool, candidates.size(), [&](std::size_t i)
+			{
+				candidates[i].failed = !hash_file(candidates[i]);
+				if (candidates[i].failed) failed.fetch_add(1, std::memory_order_relaxed);
+			});
+			errors += failed.load();
+
+			std::erase_if(candidates, [](const duplicate_candidate& file) { return file.failed; });
+			fs_tree::ParallelSort(std::span(candidates), [](const duplicate_candidate& lhs, const duplicate_candidate& rhs)
+			{
+				return lhs.size != rhs.size ? lhs.size > rhs.size : lhs.hash < rhs.hash;
+			});
+			KeepGroups(candidates, [](const duplicate_candidate& lhs, const duplicate_candidate& rhs) { return lhs.size == rhs.size && lhs.hash == rhs.hash; });
+		}
+	}
+
+	std::vector<duplicate_candidate> DuplicateCandidates(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder, const duplicate_options& options,
+		duplicate_stats* stats)
+	{
+		duplicate_stats local_stats;
+		auto& result_stats = stats ? *stats : local_stats;
+		result_stats = {};
+
+		// Stage 1, sizes: nothing is read, most files have a size no other file has.
+		struct sized_file
+		{
+			fs_tree::FileId file;
+			std::uintmax_t size;
+		};
+		std::vector<sized_file> files;
+		std::vector<fs_tree::FolderId> stack{ folder };
+		while (!stack.empty())
+		{
+			const auto current = stack.back();
+			stack.pop_back();
+
+			for (const auto file : tree.Files(current))
+			{
+				const auto size = tree.FileSize(file);
+				if (size < options.min_size || tree.FileUniqueSize(file) != size) continue;
+				files.push_back({ file, size });
+			}
+			for (const auto subfolder : tree.SubFolders(current))
+			{
+				stack.push_back(subfolder);
+			}
+		}
+		result_stats.files = files.size();
+
+		fs_tree::ParallelSort(std::span(files), [](const sized_file& lhs, const sized_file& rhs) { return lhs.size > rhs.size; });
+
+		// Only the files that share their size get a path.
+		std::vector<duplicate_candidate> candidates;
+		for (std::size_t begin = 0, end = 0; begin < files.size(); begin = end)
+		{
+			for (end = begin + 1; end < files.size() && files[end].size == files[begin].size; end++);
+			if (end - begin < 2) continue;
+
+			for (auto i = begin; i < end; i++)
+			{
+				candidates.push_back({ tree.FilePath(files[i].file), files[i].size, 0, false });
+				result_stats.same_size_bytes += files[i].size;
+			}
+		}
+		result_stats.same_size = candidates.size();
+		return candidates;
+	}
+
+	std::vector<duplicate_group> FindDuplicates(std::vector<duplicate_candidate> candidates, const duplicate_options& options, duplicate_stats* stats,
+		ScanPool& pool, std::stop_token stop_token)
+	{
+		duplicate_stats local_stats;
+		auto& result_stats = stats ? *stats : local_stats;
+
+		// Stage 2, both ends of every file: different files of the same size usually differ in their headers or
+		// their last block, and reading them costs two small reads per file.
+		std::atomic<std::uintmax_t> partial_read = 0;
+		HashStage(candidates, pool, result_stats.errors, [&](duplicate_candidate& file)
+		{
+			if (stop_token.stop_requested()) return false;
+			std::uintmax_t read = 0;
+			const auto hashed = PartialHash(file.path, file, options.partial_bytes, read);
+			partial_read.fetch_add(read, std::memory_order_relaxed);
+			return hashed;
+		});
+		result_stats.partial_read_bytes = partial_read.load();
+		result_stats.same_partial = candidates.size();
+
+		// Stage 3, the whole file, only for the files that still match and weren't read whole already.
+		std::atomic<std::uintmax_t> full_read = 0;
+		HashStage(candidates, pool, result_stats.errors, [&](duplicate_candidate& file)
+		{
+			if (file.size <= 2ull * options.partial_bytes) return true;
+			if (stop_token.stop_requested()) return false;
+			std::uintmax_t read = 0;
+			const auto hashed = FullHash(file.path, file, read, stop_token);
+			full_read.fetch_add(read, std::memory_order_relaxed);
+			return hashed;
+		});
+		result_stats.full_read_bytes = full_read.load();
+
+		// Files skipped because of the stop look like read errors, the result is dropped instead.
+		if (stop_token.stop_requested())
+		{
+			result_stats.cancelled = true;
+			return {};
+		}
+
+		std::vector<duplicate_group> groups;
+		for (auto& file : candidates)
+		{
+			if (groups.empty() || groups.back().size != file.size || groups.back().hash != file.hash)
+			{
+				groups.push_back({ file.size, file.hash, {} });
+			}
+			groups.back().files.push_back(std::move(file.path));
+		}
+		result_stats.duplicates = candidates.size();
+
+		std::stable_sort(groups.begin(), groups.end(), [](const duplicate_group& lhs, const duplicate_group& rhs) { return lhs.Reclaimable() > rhs.Reclaimable(); });
+		return groups;
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef ANALYZE_DUPLICATES
+#define ANALYZE_DUPLICATES
+
+#include "../fs_tree/FilesystemTree.h"
+#include "ScanPool.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <stop_token>
+#include <vector>
+
+namespace anal
+{
+	// Files of the same size whose contents hash the same. Deleting all but one of them frees the reclaimable
+	// bytes.
+	struct duplicate_group
+	{
+		std::uintmax_t size = 0;
+		std::uint64_t hash = 0;
+		std::vector<std::filesystem::path> files;
+
+		std::uintmax_t Reclaimable() const
+		{
+			return size * (files.size() - 1);
+		}
+	};
+
+	struct duplicate_options
+	{
+		// Smaller files are ignored; empty files are always equal and never worth reporting.
+		std::uintmax_t min_size = 1;
+		// Bytes hashed at each end of a file by the partial hash. Files up to twice this size are read whole
+		// right away and never read again.
+		std::uint32_t partial_bytes = 4096;
+	};
+
+	// What every stage left over and read, to show how little of the candidates had to be read in full.
+	struct duplicate_stats
+	{
+		std::uint64_t files = 0;
+		std::uint64_t same_size = 0;
+		std::uint64_t same_partial = 0;
+		std::uint64_t duplicates = 0;
+		std::uintmax_t same_size_bytes = 0;
+		std::uintmax_t partial_read_bytes = 0;
+		std::uintmax_t full_read_bytes = 0;
+		std::uint64_t errors = 0;
+		bool cancelled = false;
+	};
+
+	// A file that shares its size with another one, waiting to be hashed.
+	struct duplicate_candidate
+	{
+		std::filesystem::path path;
+		std::uintmax_t size = 0;
+		std::uint64_t hash = 0;
+		bool failed = false;
+	};
+
+	// The files below 'folder' that share their size with another one, from the sizes in the tree; nothing is read
+	// from disk. Hard links aren't duplicates, only the link that owns an inode (see FileUniqueSize) is considered.
+	// Fills the size counts of 'stats'. This is the only part that needs the tree, the paths let FindDuplicates run
+	// while the tree changes.
+	std::vector<duplicate_candidate> DuplicateCandidates(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder, const duplicate_options& options = {},
+		duplicate_stats* stats = nullptr);
+
+	// Finds the duplicates among 'candidates' reading as little as possible: files that share a size are told
+	// apart by hashing their first and last partial_bytes, and only files that still match are hashed in full,
+	// with large sequential reads. Hashing runs on the threads of 'pool'. Fills the rest of 'stats'. Groups are
+	// ordered by reclaimable bytes, biggest first.
+	//
+	// Contents are compared by a 64-bit hash (xxHash64), files are never compared byte by byte.
+	std::vector<duplicate_group> FindDuplicates(std::vector<duplicate_candidate> candidates, const duplicate_options& options = {},
+		duplicate_stats* stats = nullptr, ScanPool& pool = ScanPool::Shared(), std::stop_token stop_token = {});
+}
+
+#endif // !ANALYZE_DUPLICATES
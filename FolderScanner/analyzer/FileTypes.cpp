@@ -0,0 +1,155 @@
+#include "FileTypes.h"
+
+#include <algorithm>
+#include <type_traits>
+
+namespace anal
+{
+	namespace
+	{
+		bool Numeric(fs_tree::native_string_view text)
+		{
+			return !text.empty() && std::all_of(text.begin(), text.end(), [](const auto c) { return c >= '0' && c <= '9'; });
+		}
+
+		const char* category_names[category_num] = { "other", "image", "video", "audio", "document", "archive", "code", "build", "log", "database" };
+
+		std::unordered_map<std::string_view, file_category> CategoryTable()
+		{
+			std::unordered_map<std::string_view, file_category> table;
+			const auto add = [&](file_category category, std::initializer_list<std::string_view> extensions)
+			{
+				for (const auto extension : extensions) table.emplace(extension, category);
+			};
+
+			add(file_category::image, { "jpg", "jpeg", "png", "gif", "bmp", "tif", "tiff", "webp", "heic", "heif", "svg", "ico", "psd", "raw", "cr2", "nef", "dng", "xcf" });
+			add(file_category::video, { "mp4", "mkv", "avi", "mov", "wmv", "flv", "webm", "m4v", "mpg", "mpeg", "m2ts", "vob", "3gp" });
+			add(file_category::audio, { "mp3", "wav", "flac", "aac", "ogg", "m4a", "wma", "opus", "aiff", "mid" });
+			add(file_category::document, { "pdf", "doc", "docx", "xls", "xlsx", "ppt", "pptx", "odt", "ods", "odp", "txt", "md", "rtf", "csv", "epub", "tex" });
+			add(file_category::archive, { "zip", "tar", "gz", "tgz", "bz2", "xz", "zst", "7z", "rar", "iso", "dmg", "deb", "rpm", "jar", "whl", "cab", "msi", "img", "vhd", "vhdx", "vmdk", "qcow2" });
+			add(file_category::code, { "c", "cc", "cpp", "cxx", "h", "hh", "hpp", "hxx", "inl", "py", "js", "mjs", "ts", "tsx", "jsx", "java", "kt", "cs", "go", "rs", "rb", "php",
+				"swift", "m", "sh", "ps1", "bat", "pl", "lua", "html", "htm", "css", "scss", "json", "xml", "yaml", "yml", "toml", "ini", "cmake", "sql" });
+			add(file_category::build, { "o", "obj", "a", "lib", "so", "dll", "exe", "pdb", "ilk", "pch", "gch", "idb", "ipdb", "iobj", "class", "pyc", "pyo", "dylib", "tlog", "lo", "d", "dex", "wasm" });
+			add(file_category::log, { "log", "trace", "etl", "dmp", "core" });
+			add(file_category::database, { "db", "sqlite", "sqlite3", "mdb", "accdb", "ldf", "mdf", "ibd", "frm", "dbf", "realm", "leveldb" });
+			return table;
+		}
+	}
+
+	std::string_view FileExtension(fs_tree::native_string_view name, char (&buffer)[max_extension])
+	{
+		auto dot = name.rfind('.');
+		// Versions of shared libraries (libssl.so.3, libc++.so.1.0) count for the extension before them, a
+		// name with nothing but numbers after its first dot keeps the last one.
+		auto stem = name;
+		auto stem_dot = dot;
+		while (stem_dot != fs_tree::native_string_view::npos && stem_dot > 0 && Numeric(stem.substr(stem_dot + 1)))
+		{
+			stem = stem.substr(0, stem_dot);
+			stem_dot = stem.rfind('.');
+		}
+		if (stem_dot != fs_tree::native_string_view::npos && stem_dot > 0 && stem_dot != dot)
+		{
+			name = stem;
+			dot = stem_dot;
+		}
+		// A leading dot makes a hidden file, not an extension.
+		if (dot == fs_tree::native_string_view::npos || dot == 0 || name.size() - dot - 1 > max_extension) return {};
+
+		std::size_t size = 0;
+		for (const auto c : name.substr(dot + 1))
+		{
+			const auto code = static_cast<std::make_unsigned_t<fs_tree::native_char>>(c);
+			if (code >= 0x80) return {};
+			buffer[size++] = static_cast<char>(code >= 'A' && code <= 'Z' ? code - 'A' + 'a' : code);
+		}
+		return std::string_view(buffer, size);
+	}
+
+	const char* CategoryName(file_category category)
+	{
+		return category_names[static_cast<std::size_t>(category)];
+	}
+
+	file_category CategoryOf(std::string_view extension)
+	{
+		static const auto table = CategoryTable();
+		const auto search = table.find(extension);
+		return search != table.end() ? search->second : file_category::other;
+	}
+
+	void TypeTable::Add(fs_tree::native_string_view name, std::uintmax_t size, std::uintmax_t allocated)
+	{
+		char buffer[max_extension];
+		const auto extension = FileExtension(name, buffer);
+
+		auto search = extensions_.find(extension);
+		if (search == extensions_.end()) search = extensions_.emplace(std::string(extension), type_totals{}).first;
+		search->second += { 1, size, allocated };
+	}
+
+	void TypeTable::AddFiles(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder)
+	{
+		for (const auto file : tree.Files(folder))
+		{
+			// Like the folder totals: the blocks of a hard-linked inode count once, at the link that owns them.
+			const auto size = tree.FileSize(file);
+			Add(tree.FileName(file), size, tree.FileUniqueSize(file) == size ? tree.FileAllocated(file) : 0);
+		}
+	}
+
+	TypeTable& TypeTable::operator+=(const TypeTable& other)
+	{
+		for (const auto& [extension, totals] : other.extensions_)
+		{
+			extensions_[extension] += totals;
+		}
+		return *this;
+	}
+
+	std::vector<std::pair<std::string, type_totals>> TypeTable::Extensions(fs_tree::size_kind kind) const
+	{
+		std::vector<std::pair<std::string, type_totals>> extensions(extensions_.begin(), extensions_.end());
+		const auto size = [kind](const type_totals& totals) { return kind == fs_tree::size_kind::allocated ? totals.allocated : totals.size; };
+		std::sort(extensions.begin(), extensions.end(), [&](const auto& lhs, const auto& rhs) { return size(lhs.second) > size(rhs.second); });
+		return extensions;
+	}
+
+	std::vector<type_totals> TypeTable::Categories() const
+	{
+		std::vector<type_totals> categories(category_num);
+		for (const auto& [extension, totals] : extensions_)
+		{
+			categories[static_cast<std::size_t>(CategoryOf(extension))] += totals;
+		}
+		return categories;
+	}
+
+	type_totals TypeTable::Total() const
+	{
+		type_totals total;
+		for (const auto& [extension, totals] : extensions_)
+		{
+			total += totals;
+		}
+		return total;
+	}
+
+	TypeTable SubtreeTypes(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder)
+	{
+		TypeTable types;
+		std::vector<fs_tree::FolderId> stack{ folder };
+		while (!stack.empty())
+		{
+			const auto current = stack.back();
+			stack.pop_back();
+
+			types.AddFiles(tree, current);
+			for (const auto subfolder : tree.SubFolders(current))
+			{
+				stack.push_back(subfolder);
+			}
+		}
+		return types;
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef ANALYZE_FILE_TYPES
+#define ANALYZE_FILE_TYPES
+
+#include "../fs_tree/FilesystemTree.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace anal
+{
+	// Broad kinds of files, picked by extension.
+	enum class file_category : std::uint8_t
+	{
+		other,
+		image,
+		video,
+		audio,
+		document,
+		archive,
+		code,
+		// Objects, libraries, debug symbols and other things a build can recreate.
+		build,
+		log,
+		database,
+		count
+	};
+
+	constexpr std::size_t category_num = static_cast<std::size_t>(file_category::count);
+
+	// Longer suffixes are rather part of the name (versions, hashes) and count as no extension.
+	constexpr std::size_t max_extension = 15;
+
+	// The extension of a file name as TypeTable counts it: lower case and without the dot, "" for none. The view
+	// points into 'buffer'.
+	std::string_view FileExtension(fs_tree::native_string_view name, char (&buffer)[max_extension]);
+
+	const char* CategoryName(file_category category);
+	file_category CategoryOf(std::string_view extension);
+
+	struct type_totals
+	{
+		std::uint64_t files = 0;
+		std::uintmax_t size = 0;
+		std::uintmax_t allocated = 0;
+
+		type_totals& operator+=(const type_totals& other)
+		{
+			files += other.files;
+			size += other.size;
+			allocated += other.allocated;
+			return *this;
+		}
+	};
+
+	// Totals of files by extension, lower case and without the dot ("" for files without one). Every loader keeps
+	// its own table while scanning and the tables are added up at the end, so counting costs one lookup in a small
+	// thread-local map per file.
+	class TypeTable
+	{
+	private:
+		struct string_hash
+		{
+			using is_transparent = void;
+
+			std::size_t operator()(std::string_view text) const
+			{
+				return std::hash<std::string_view>{}(text);
+			}
+		};
+
+		std::unordered_map<std::string, type_totals, string_hash, std::equal_to<>> extensions_;
+
+	public:
+		void Add(fs_tree::native_string_view name, std::uintmax_t size, std::uintmax_t allocated);
+		// Adds the files of 'folder' itself, not of its subfolders.
+		void AddFiles(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder);
+		TypeTable& operator+=(const TypeTable& other);
+
+		// Extensions with their totals, biggest by 'kind' first.
+		std::vector<std::pair<std::string, type_totals>> Extensions(fs_tree::size_kind kind = fs_tree::size_kind::apparent) const;
+		std::vector<type_totals> Categories() const;
+		type_totals Total() const;
+	};
+
+	// The types of everything below 'folder', from the files of the loaded tree.
+	TypeTable SubtreeTypes(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder);
+}
+
+#endif // !ANALYZE_FILE_TYPES
@@ -0,0 +1,534 @@
+#include "Query.h"
+#include "FileTypes.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <deque>
+#include <regex>
+#include <stdexcept>
+
+namespace anal
+{
+	namespace
+	{
+		constexpr std::string_view comparison_chars = "<>=!";
+		constexpr std::string_view numeric_fields[] = { "size", "alloc", "allocated", "atime", "mtime", "ctime", "used", "depth" };
+
+		bool IsNumericField(std::string_view word)
+		{
+			return std::find(std::begin(numeric_fields), std::end(numeric_fields), word) != std::end(numeric_fields);
+		}
+
+		// Splits on whitespace, makes parentheses tokens of their own and keeps quoted text together. Comparisons
+		// can be written without spaces ("size>1G"), so they are split off a numeric field or a value.
+		std::vector<std::string> Tokenize(std::string_view expression)
+		{
+			// Words with whether they were quoted, those are never split.
+			std::vector<std::pair<std::string, bool>> words;
+			std::string current;
+			bool quoted = false;
+			bool was_quoted = false;
+			bool pending = false;
+			const auto finish = [&]()
+			{
+				if (pending) words.emplace_back(std::move(current), was_quoted);
+				current.clear();
+				pending = false;
+				was_quoted = false;
+			};
+
+			for (const auto c : expression)
+			{
+				if (quoted)
+				{
+					if (c == '"') quoted = false;
+					else current.push_back(c);
+				}
+				else if (c == '"')
+				{
+					quoted = true;
+					was_quoted = true;
+					pending = true;
+				}
+				else if (std::isspace(static_cast<unsigned char>(c)))
+				{
+					finish();
+				}
+				else if (c == '(' || c == ')')
+				{
+					finish();
+					words.emplace_back(std::string(1, c), false);
+				}
+				else
+				{
+					current.push_back(c);
+					pending = true;
+				}
+			}
+			if (quoted) throw std::runtime_error("Unterminated quote");
+			finish();
+
+			std::vector<std::string> tokens;
+			bool operand = false;
+			for (auto& [word, was_quoted] : words)
+			{
+				// The pattern after name, ext or type is taken as it is, "name !important*" included.
+				if (operand)
+				{
+					tokens.push_back(std::move(word));
+					operand = false;
+					continue;
+				}
+
+				// A leading '!' negates what follows ("!size>1G"), unless it starts a '!=' comparison.
+				while (!was_quoted && word.size() > 1 && word[0] == '!' && word[1] != '=')
+				{
+					tokens.emplace_back("!");
+					word.erase(0, 1);
+				}
+				operand = word == "name" || word == "ext" || word == "type";
+
+				const auto op = was_quoted ? std::string::npos : word.find_first_of(comparison_chars);
+				const auto op_end = op != std::string::npos ? word.find_first_not_of(comparison_chars, op) : std::string::npos;
+				if (op == std::string::npos || (op > 0 && !IsNumericField(std::string_view(word).substr(0, op))) || word.size() == 1)
+				{
+					tokens.push_back(std::move(word));
+					continue;
+				}
+
+				if (op > 0) tokens.push_back(word.substr(0, op));
+				tokens.push_back(word.substr(op, op_end == std::string::npos ? std::string::npos : op_end - op));
+				if (op_end != std::string::npos) tokens.push_back(word.substr(op_end));
+			}
+			return tokens;
+		}
+
+		// Parses the number at the start of 'text' and returns the rest, which is lower case unit letters.
+		std::pair<std::uint64_t, std::string> SplitNumber(const std::string& text)
+		{
+			std::uint64_t number = 0;
+			const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+			if (error != std::errc() || end == text.data()) throw std::runtime_error("Invalid number '" + text + "'");
+
+			std::string unit(end, text.data() + text.size());
+			std::transform(unit.begin(), unit.end(), unit.begin(), [](const char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+			return { number, unit };
+		}
+
+		std::uint64_t ParseSize(const std::string& text)
+		{
+			auto [number, unit] = SplitNumber(text);
+			if (unit.size() > 1 && unit.back() == 'b') unit.pop_back();
+			if (unit.empty() || unit == "b") return number;
+
+			const std::string_view units = "kmgtp";
+			const auto power = unit.size() == 1 ? units.find(unit[0]) : std::string_view::npos;
+			if (power == std::string_view::npos) throw std::runtime_error("Invalid size '" + text + "'");
+			const auto shift = 10 * (power + 1);
+			if (number > (std::numeric_limits<std::uint64_t>::max() >> shift)) throw std::runtime_error("Size too big '" + text + "'");
+			return number << shift;
+		}
+
+		std::uint64_t ParseAge(const std::string& text)
+		{
+			// Months and years are 30 and 365 days, like the age buckets.
+			constexpr std::uint64_t day = 24 * 60 * 60;
+			const auto [number, unit] = SplitNumber(text);
+			std::uint64_t seconds = 0;
+			if (unit == "s") seconds = 1;
+			else if (unit == "min") seconds = 60;
+			else if (unit == "h") seconds = 60 * 60;
+			else if (unit.empty() || unit == "d") seconds = day;
+			else if (unit == "w") seconds = 7 * day;
+			else if (unit == "m") seconds = 30 * day;
+			else if (unit == "y") seconds = 365 * day;
+			else throw std::runtime_error("Invalid age '" + text + "', use s, min, h, d, w, m or y");
+
+			if (number > std::numeric_limits<std::uint64_t>::max() / seconds) throw std::runtime_error("Age too big '" + text + "'");
+			return number * seconds;
+		}
+	}
+
+	// Recursive descent over the tokens, lowest precedence first: 'or', then 'and', then 'not' and parentheses.
+	class Query::Parser
+	{
+	private:
+		std::vector<std::string> tokens_;
+		std::size_t next_ = 0;
+		std::vector<node>& nodes_;
+
+		bool Peek(std::string_view token) const
+		{
+			return next_ < tokens_.size() && tokens_[next_] == token;
+		}
+
+		bool Accept(std::string_view token)
+		{
+			if (!Peek(token)) return false;
+			next_++;
+			return true;
+		}
+
+		const std::string& Take(const char* what)
+		{
+			if (next_ == tokens_.size())
+			{
+				throw std::runtime_error(std::string("Expected ") + what + (next_ > 0 ? " after '" + tokens_[next_ - 1] + "'" : ""));
+			}
+			return tokens_[next_++];
+		}
+
+		static node Node(node_kind kind, comparison op = comparison::equal)
+		{
+			node result;
+			result.kind = kind;
+			result.op = op;
+			return result;
+		}
+
+		std::uint32_t Add(node value)
+		{
+			nodes_.push_back(std::move(value));
+			return static_cast<std::uint32_t>(nodes_.size() - 1);
+		}
+
+		std::uint32_t Any()
+		{
+			auto any = Node(node_kind::any);
+			any.operands.push_back(All());
+			while (Accept("or"))
+			{
+				any.operands.push_back(All());
+			}
+			return any.operands.size() == 1 ? any.operands[0] : Add(std::move(any));
+		}
+
+		std::uint32_t All()
+		{
+			auto all = Node(node_kind::all);
+			all.operands.push_back(Unary());
+			while (next_ < tokens_.size() && !Peek("or") && !Peek(")"))
+			{
+				Accept("and");
+				all.operands.push_back(Unary());
+			}
+			return all.operands.size() == 1 ? all.operands[0] : Add(std::move(all));
+		}
+
+		std::uint32_t Unary()
+		{
+			if (Accept("not") || Accept("!"))
+			{
+				auto negation = Node(node_kind::negation);
+				negation.operands.push_back(Unary());
+				return Add(std::move(negation));
+			}
+			if (Accept("("))
+			{
+				const auto inner = Any();
+				if (!Accept(")")) throw std::runtime_error(next_ < tokens_.size() ? "Expected ')' before '" + tokens_[next_] + "'" : "Expected ')'");
+				return inner;
+			}
+			return Predicate();
+		}
+
+		std::uint32_t Predicate()
+		{
+			const auto field = Take("a predicate");
+			if (IsNumericField(field))
+			{
+				static const std::pair<std::string_view, comparison> comparisons[] = {
+					{ "<", comparison::less }, { "<=", comparison::less_equal }, { ">", comparison::greater },
+					{ ">=", comparison::greater_equal }, { "=", comparison::equal }, { "==", comparison::equal }, { "!=", comparison::not_equal }
+				};
+				const auto& op = Take("a comparison");
+				const auto found = std::find_if(std::begin(comparisons), std::end(comparisons), [&](const auto& entry) { return entry.first == op; });
+				if (found == std::end(comparisons)) throw std::runtime_error("Expected a comparison after '" + field + "', not '" + op + "'");
+
+				const auto& value = Take("a value");
+				auto predicate = Node(node_kind::depth, found->second);
+				if (field == "size" || field == "alloc" || field == "allocated")
+				{
+					predicate.kind = field == "size" ? node_kind::size : node_kind::allocated;
+					predicate.value = ParseSize(value);
+				}
+				else if (field == "depth")
+				{
+					const auto [depth, unit] = SplitNumber(value);
+					if (!unit.empty()) throw std::runtime_error("Invalid depth '" + value + "', depths have no unit");
+					predicate.value = depth;
+				}
+				else
+				{
+					predicate.kind = field == "atime" ? node_kind::accessed : field == "mtime" ? node_kind::modified : field == "ctime" ? node_kind::changed : node_kind::used;
+					predicate.value = ParseAge(value);
+				}
+				return Add(std::move(predicate));
+			}
+
+			if (field == "name")
+			{
+				const auto& pattern = Take("a name pattern");
+				auto names = std::make_shared<fs_tree::NameMatcher>();
+				try
+				{
+					names->Add(pattern);
+				}
+				catch (const std::regex_error&)
+				{
+					throw std::runtime_error("Invalid regular expression '" + pattern + "'");
+				}
+				auto predicate = Node(node_kind::name);
+				predicate.names = std::move(names);
+				return Add(std::move(predicate));
+			}
+
+			if (field == "ext")
+			{
+				auto extension = Take("an extension");
+				if (extension.starts_with('.')) extension.erase(0, 1);
+				std::transform(extension.begin(), extension.end(), extension.begin(), [](const char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+				auto predicate = Node(node_kind::extension);
+				predicate.extension = std::move(extension);
+				return Add(std::move(predicate));
+			}
+
+			if (field == "type")
+			{
+				const auto& type = Take("f or d");
+				if (type != "f" && type != "d") throw std::runtime_error("Expected f or d after 'type', not '" + type + "'");
+				auto predicate = Node(node_kind::type);
+				predicate.value = type == "d" ? 1 : 0;
+				return Add(std::move(predicate));
+			}
+
+			throw std::runtime_error("Unknown predicate '" + field + "'");
+		}
+
+	public:
+		Parser(std::string_view expression, std::vector<node>& nodes) : tokens_(Tokenize(expression)), nodes_(nodes)
+		{
+		}
+
+		std::uint32_t Parse()
+		{
+			if (tokens_.empty()) throw std::runtime_error("Empty query");
+			const auto root = Any();
+			if (next_ < tokens_.size()) throw std::runtime_error("Unexpected '" + tokens_[next_] + "'");
+			return root;
+		}
+	};
+
+	Query::Query(std::string_view expression)
+	{
+		root_ = Parser(expression, nodes_).Parse();
+		bounds_ = Bounds(root_);
+	}
+
+	Query::bounds Query::Bounds(std::uint32_t index) const
+	{
+		const auto& current = nodes_[index];
+		const auto lower = [&]() -> std::uint64_t
+		{
+			switch (current.op)
+			{
+			case comparison::greater: return current.value == std::numeric_limits<std::uint64_t>::max() ? current.value : current.value + 1;
+			case comparison::greater_equal:
+			case comparison::equal: return current.value;
+			default: return 0;
+			}
+		};
+
+		bounds result;
+		switch (current.kind)
+		{
+		case node_kind::all:
+			for (const auto operand : current.operands)
+			{
+				const auto inner = Bounds(operand);
+				result.min_size = std::max(result.min_size, inner.min_size);
+				result.min_allocated = std::max(result.min_allocated, inner.min_allocated);
+				result.max_depth = std::min(result.max_depth, inner.max_depth);
+			}
+			break;
+		case node_kind::any:
+			result = Bounds(current.operands[0]);
+			for (const auto operand : current.operands)
+			{
+				const auto inner = Bounds(operand);
+				result.min_size = std::min(result.min_size, inner.min_size);
+				result.min_allocated = std::min(result.min_allocated, inner.min_allocated);
+				result.max_depth = std::max(result.max_depth, inner.max_depth);
+			}
+			break;
+		case node_kind::size:
+			result.min_size = lower();
+			break;
+		case node_kind::allocated:
+			result.min_allocated = lower();
+			break;
+		case node_kind::depth:
+		{
+			const auto depth = static_cast<std::uint32_t>(std::min<std::uint64_t>(current.value, result.max_depth));
+			if (current.op == comparison::less) result.max_depth = depth > 0 ? depth - 1 : 0;
+			else if (current.op == comparison::less_equal || current.op == comparison::equal) result.max_depth = depth;
+			break;
+		}
+		default:
+			// A negation can match anything its operand rules out.
+			break;
+		}
+		return result;
+	}
+
+	bool Query::Matches(const fs_tree::FilesystemTree& tree, std::uint32_t index, const subject& subject) const
+	{
+		const auto& current = nodes_[index];
+		const auto compare = [&](std::uint64_t value)
+		{
+			switch (current.op)
+			{
+			case comparison::less: return value < current.value;
+			case comparison::less_equal: return value <= current.value;
+			case comparison::greater: return value > current.value;
+			case comparison::greater_equal: return value >= current.value;
+			case comparison::equal: return value == current.value;
+			case comparison::not_equal: return value != current.value;
+			}
+			return false;
+		};
+		const auto age = [&](std::int64_t time)
+		{
+			return static_cast<std::uint64_t>(std::max<std::int64_t>(tree.ScanTime() - time, 0));
+		};
+
+		switch (current.kind)
+		{
+		case node_kind::all:
+			return std::all_of(current.operands.begin(), current.operands.end(), [&](const auto operand) { return Matches(tree, operand, subject); });
+		case node_kind::any:
+			return std::any_of(current.operands.begin(), current.operands.end(), [&](const auto operand) { return Matches(tree, operand, subject); });
+		case node_kind::negation:
+			return !Matches(tree, current.operands[0], subject);
+		case node_kind::size:
+			return compare(subject.folder ? tree.FolderSize(subject.id) : tree.FileSize(subject.id));
+		case node_kind::allocated:
+		{
+			// Like the folder totals, which the pruning relies on.
+			if (subject.folder) return compare(tree.FolderAllocated(subject.id));
+			const auto size = tree.FileSize(subject.id);
+			return compare(tree.FileUniqueSize(subject.id) == size ? tree.FileAllocated(subject.id) : 0);
+		}
+		case node_kind::accessed:
+		case node_kind::modified:
+		case node_kind::changed:
+		case node_kind::used:
+		{
+			if (subject.folder) return false;
+			const auto times = tree.FileTimes(subject.id);
+			const auto time = current.kind == node_kind::accessed ? times.accessed
+				: current.kind == node_kind::modified ? times.modified
+				: current.kind == node_kind::changed ? times.changed
+				: std::max(times.accessed, times.modified);
+			return compare(age(time));
+		}
+		case node_kind::depth:
+			return compare(subject.depth);
+		case node_kind::name:
+			return current.names->Matches(subject.folder ? tree.FolderName(subject.id) : tree.FileName(subject.id));
+		case node_kind::extension:
+		{
+			if (subject.folder) return false;
+			char buffer[max_extension];
+			return FileExtension(tree.FileName(subject.id), buffer) == current.extension;
+		}
+		case node_kind::type:
+			return subject.folder == (current.value == 1);
+		}
+		return false;
+	}
+
+	query_matches Query::Run(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder, query_stats* stats, ScanPool& pool) const
+	{
+		struct work
+		{
+			fs_tree::FolderId folder;
+			std::uint32_t depth;
+		};
+
+		struct output
+		{
+			query_matches matches;
+			query_stats stats;
+		};
+
+		// Matches the files and subfolders of one folder and hands the subfolders that can still contain matches
+		// to 'descend'. Subfolders too small (or too deep) for any match are skipped with everything below them.
+		const auto visit = [&](const work& item, output& out, auto&& descend)
+		{
+			const auto depth = item.depth + 1;
+			out.stats.folders++;
+			if (depth > bounds_.max_depth) return;
+
+			for (const auto file : tree.Files(item.folder))
+			{
+				out.stats.files++;
+				if (Matches(tree, root_, { false, file, depth })) out.matches.files.push_back(file);
+			}
+			for (const auto subfolder : tree.SubFolders(item.folder))
+			{
+				if (tree.FolderSize(subfolder) < bounds_.min_size || tree.FolderAllocated(subfolder) < bounds_.min_allocated)
+				{
+					out.stats.pruned++;
+					continue;
+				}
+				if (Matches(tree, root_, { true, subfolder, depth })) out.matches.folders.push_back(subfolder);
+				if (depth < bounds_.max_depth) descend(work{ subfolder, depth });
+			}
+		};
+
+		// The top of the tree is split breadth first until there are enough subtrees to keep every thread busy.
+		output top;
+		std::deque<work> frontier{ { folder, 0 } };
+		const auto subtree_target = static_cast<std::size_t>(pool.ThreadNum()) * 8;
+		while (!frontier.empty() && frontier.size() < subtree_target)
+		{
+			const auto item = frontier.front();
+			frontier.pop_front();
+			visit(item, top, [&](const work& next) { frontier.push_back(next); });
+		}
+
+		// Biggest subtrees first, so none of them is started last and leaves one thread working alone.
+		std::vector<work> subtrees(frontier.begin(), frontier.end());
+		std::sort(subtrees.begin(), subtrees.end(), [&](const work& lhs, const work& rhs) { return tree.FolderEntries(lhs.folder) > tree.FolderEntries(rhs.folder); });
+
+		std::vector<output> outputs(subtrees.size());
+		ParallelFor(pool, subtrees.size(), [&](std::size_t i)
+		{
+			std::vector<work> stack{ subtrees[i] };
+			while (!stack.empty())
+			{
+				const auto item = stack.back();
+				stack.pop_back();
+				visit(item, outputs[i], [&](const work& next) { stack.push_back(next); });
+			}
+		});
+
+		auto result = std::move(top.matches);
+		auto result_stats = top.stats;
+		for (auto& out : outputs)
+		{
+			result.folders.insert(result.folders.end(), out.matches.folders.begin(), out.matches.folders.end());
+			result.files.insert(result.files.end(), out.matches.files.begin(), out.matches.files.end());
+			result_stats.folders += out.stats.folders;
+			result_stats.files += out.stats.files;
+			result_stats.pruned += out.stats.pruned;
+		}
+		std::sort(result.folders.begin(), result.folders.end());
+		std::sort(result.files.begin(), result.files.end());
+
+		if (stats) *stats = result_stats;
+		return result;
+	}
+}
@@ -0,0 +1,134 @@
+#ifndef ANALYZE_QUERY
+#define ANALYZE_QUERY
+
+#include "../fs_tree/FilesystemTree.h"
+#include "../fs_tree/NameMatcher.h"
+#include "ScanPool.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace anal
+{
+	// Files and folders a query matched, each ordered by id.
+	struct query_matches
+	{
+		std::vector<fs_tree::FolderId> folders;
+		std::vector<fs_tree::FileId> files;
+	};
+
+	// How much of the tree a query looked at. 'pruned' counts the subtrees skipped without visiting them.
+	struct query_stats
+	{
+		std::uint64_t folders = 0;
+		std::uint64_t files = 0;
+		std::uint64_t pruned = 0;
+	};
+
+	// A find-like filter over the files and folders of a tree, compiled from an expression such as
+	//
+	//     size > 1G and mtime > 6m and (name *.tmp or ext log)
+	//
+	// Predicates compare a field with a value:
+	//
+	//     size, alloc              the size or allocated size (of the whole subtree for folders; a hard link counts
+	//                              its blocks only at the link that owns them), like 512, 100K, 20M or 1G
+	//     atime, mtime, ctime      how long before the scan a file was accessed, modified or changed, and 'used'
+	//                              for the newer of access and modification, like 90d, 12h, 26w, 6m or 1y
+	//     depth                    levels below the queried folder, 1 for its own files and subfolders
+	//
+	// with <, <=, >, >=, = or !=, and match names:
+	//
+	//     name <glob>, name re:<regex>    see NameMatcher; quote names with spaces ("My Documents")
+	//     ext <extension>                 lower case, without the dot, see FileExtension
+	//     type f, type d                  files or folders only
+	//
+	// Predicates combine with 'and' (or just one after another), 'or', 'not' (or a leading '!', as in !size>1G)
+	// and parentheses. The pattern after name, ext or type is never split, "name !important*" matches names
+	// starting with '!'. Folders have no times or extensions, predicates on them never match a folder.
+	//
+	// Evaluation prunes with the subtree totals: the lowest size (and allocated size) and the highest depth any
+	// match can have are derived from the expression, and subtrees that are smaller or deeper are skipped without
+	// being visited.
+	class Query
+	{
+	private:
+		enum class node_kind : std::uint8_t
+		{
+			all,
+			any,
+			negation,
+			size,
+			allocated,
+			accessed,
+			modified,
+			changed,
+			used,
+			depth,
+			name,
+			extension,
+			type
+		};
+
+		enum class comparison : std::uint8_t
+		{
+			less,
+			less_equal,
+			greater,
+			greater_equal,
+			equal,
+			not_equal
+		};
+
+		// A node of the expression, its operands (for all, any and negation) are other nodes. 'value' is bytes,
+		// seconds or levels, or 1 for 'type d'.
+		struct node
+		{
+			node_kind kind = node_kind::all;
+			comparison op = comparison::equal;
+			std::uint64_t value = 0;
+			std::vector<std::uint32_t> operands;
+			std::shared_ptr<const fs_tree::NameMatcher> names;
+			std::string extension;
+		};
+
+		// What every match has at least, or at most, so subtrees without any can be skipped.
+		struct bounds
+		{
+			std::uintmax_t min_size = 0;
+			std::uintmax_t min_allocated = 0;
+			std::uint32_t max_depth = std::numeric_limits<std::uint32_t>::max();
+		};
+
+		// A file or folder being matched.
+		struct subject
+		{
+			bool folder;
+			std::uint32_t id;
+			std::uint32_t depth;
+		};
+
+		class Parser;
+
+		std::vector<node> nodes_;
+		std::uint32_t root_ = 0;
+		bounds bounds_;
+
+		bounds Bounds(std::uint32_t index) const;
+		bool Matches(const fs_tree::FilesystemTree& tree, std::uint32_t index, const subject& subject) const;
+
+	public:
+		// Throws std::runtime_error describing the first error in 'expression'.
+		explicit Query(std::string_view expression);
+
+		// Every file and folder below 'folder' that matches, 'folder' itself excluded. Subtrees are matched on the
+		// threads of 'pool', the tree must have finished loading.
+		query_matches Run(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder, query_stats* stats = nullptr, ScanPool& pool = ScanPool::Shared()) const;
+	};
+}
+
+#endif // !ANALYZE_QUERY
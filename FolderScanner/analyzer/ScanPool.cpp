@@ -0,0 +1,91 @@
+#include "ScanPool.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace anal
+{
+    namespace
+    {
+        void PinCurrentThread(std::uint32_t index)
+        {
+#if defined(_WIN32)
+            const auto mask = static_cast<DWORD_PTR>(1) << (index % (sizeof(DWORD_PTR) * 8));
+            SetThreadAffinityMask(GetCurrentThread(), mask);
+            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+#elif defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(index % std::max(std::thread::hardware_concurrency(), 1u), &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+        }
+    }
+
+    ScanPool::ScanPool(std::uint32_t thread_num)
+    {
+        if (thread_num == 0) thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+        for (std::uint32_t i = 0; i < thread_num; i++)
+        {
+            threads_.emplace_back(&ScanPool::Run, this, i);
+        }
+    }
+
+    ScanPool::~ScanPool()
+    {
+        {
+            std::unique_lock lock(mutex_);
+            stopping_ = true;
+        }
+        condition_variable_.notify_all();
+
+        for (auto& thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    void ScanPool::Run(std::uint32_t index)
+    {
+        PinCurrentThread(index);
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                condition_variable_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    void ScanPool::Post(std::function<void()> task)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        condition_variable_.notify_one();
+    }
+
+    std::uint32_t ScanPool::ThreadNum() const
+    {
+        return static_cast<std::uint32_t>(threads_.size());
+    }
+
+    ScanPool& ScanPool::Shared()
+    {
+        static ScanPool pool;
+        return pool;
+    }
+}
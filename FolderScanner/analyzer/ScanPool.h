@@ -0,0 +1,86 @@
+#ifndef ANALYZE_SCAN_POOL
+#define ANALYZE_SCAN_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace anal
+{
+	// A fixed number of worker threads that run the loaders of every Scanner using the pool, so any number of
+	// concurrent scans never use more threads than that. Tasks run in the order they were posted; loaders give
+	// their thread back after a short time slice (see Scanner), so scans started later aren't starved by a big one.
+	// Workers are pinned to one CPU each.
+	class ScanPool
+	{
+	private:
+		std::mutex mutex_;
+		std::condition_variable condition_variable_;
+		std::deque<std::function<void()>> tasks_;
+		bool stopping_ = false;
+		std::vector<std::thread> threads_;
+
+		void Run(std::uint32_t index);
+
+	public:
+		// 0 starts one worker per hardware thread.
+		explicit ScanPool(std::uint32_t thread_num = 0);
+		ScanPool(const ScanPool&) = delete;
+		ScanPool& operator=(const ScanPool&) = delete;
+		// Runs the tasks that are still queued, then joins the workers. Scanners using the pool must have
+		// finished or been cancelled before.
+		~ScanPool();
+
+		void Post(std::function<void()> task);
+		std::uint32_t ThreadNum() const;
+
+		// The pool of scanners that don't get one, one worker per hardware thread. Created on first use.
+		static ScanPool& Shared();
+	};
+
+	// Runs 'task(i)' for every i below 'count' on the threads of 'pool' and waits for all of them. The first
+	// exception a task throws stops the remaining ones and is rethrown here. Must not be called from a pool thread.
+	template<typename Task>
+	void ParallelFor(ScanPool& pool, std::size_t count, Task task)
+	{
+		const auto worker_num = std::min<std::size_t>(pool.ThreadNum(), count);
+		if (worker_num == 0) return;
+
+		std::atomic_size_t next = 0;
+		std::mutex error_mutex;
+		std::exception_ptr error;
+		std::latch done(static_cast<std::ptrdiff_t>(worker_num));
+		for (std::size_t i = 0; i < worker_num; i++)
+		{
+			pool.Post([&]()
+			{
+				try
+				{
+					for (auto index = next.fetch_add(1); index < count; index = next.fetch_add(1))
+					{
+						task(index);
+					}
+				}
+				catch (...)
+				{
+					std::lock_guard lock(error_mutex);
+					if (!error) error = std::current_exception();
+					next.store(count);
+				}
+				done.count_down();
+			});
+		}
+		done.wait();
+		if (error) std::rethrow_exception(error);
+	}
+}
+
+#endif // !ANALYZE_SCAN_POOL
@@ -0,0 +1,179 @@
+#include "ScanStats.h"
+
+#include <iomanip>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <time.h>
+#endif
+
+namespace anal
+{
+	namespace
+	{
+		const char* phase_names[phase_num] = { "read", "stat", "insert", "aggregate", "idle" };
+
+		double Seconds(std::uint64_t ns)
+		{
+			return static_cast<double>(ns) / 1e9;
+		}
+
+		double PerSecond(std::uint64_t count, std::uint64_t ns)
+		{
+			return ns == 0 ? 0.0 : static_cast<double>(count) / Seconds(ns);
+		}
+
+		std::string BucketLabel(std::size_t bucket)
+		{
+			if (bucket == 0) return "0";
+			const auto low = std::uint64_t(1) << (bucket - 1);
+			if (bucket == histogram_buckets - 1) return std::to_string(low) + "+";
+			if (bucket == 1) return "1";
+			return std::to_string(low) + "-" + std::to_string((low << 1) - 1);
+		}
+
+		void PrintHistogram(std::ostream& out, const char* title, const std::uint64_t (&histogram)[histogram_buckets])
+		{
+			std::uint64_t total = 0;
+			std::size_t last = 0;
+			for (std::size_t i = 0; i < histogram_buckets; i++)
+			{
+				total += histogram[i];
+				if (histogram[i] > 0) last = i;
+			}
+
+			out << title << "\n";
+			if (total == 0) return;
+			for (std::size_t i = 0; i <= last; i++)
+			{
+				out << "  " << std::setw(12) << BucketLabel(i) << " | " << std::setw(10) << histogram[i] << " | "
+					<< std::setw(5) << std::setprecision(1) << 100.0 * static_cast<double>(histogram[i]) / static_cast<double>(total) << "%\n";
+			}
+		}
+
+#if defined(_WIN32)
+		std::uint64_t FileTimeNanoseconds(const FILETIME& time)
+		{
+			return ((static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100;
+		}
+#endif
+	}
+
+	loader_stats& loader_stats::operator+=(const loader_stats& other)
+	{
+		wall_ns += other.wall_ns;
+		cpu_ns += other.cpu_ns;
+		for (std::size_t i = 0; i < phase_num; i++)
+		{
+			phase_ns[i] += other.phase_ns[i];
+		}
+		folders += other.folders;
+		entries += other.entries;
+		reused += other.reused;
+		errors += other.errors;
+		reads += other.reads;
+		for (std::size_t i = 0; i < histogram_buckets; i++)
+		{
+			queue_depth[i] += other.queue_depth[i];
+			idle_us[i] += other.idle_us[i];
+		}
+		return *this;
+	}
+
+	std::uint64_t Nanoseconds(std::chrono::steady_clock::duration duration)
+	{
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	}
+
+	std::uint64_t ThreadCpuNanoseconds()
+	{
+#if defined(_WIN32)
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0;
+		return FileTimeNanoseconds(kernel) + FileTimeNanoseconds(user);
+#elif defined(__linux__)
+		timespec time;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) return 0;
+		return static_cast<std::uint64_t>(time.tv_sec) * 1'000'000'000ull + static_cast<std::uint64_t>(time.tv_nsec);
+#else
+		return 0;
+#endif
+	}
+
+	std::uint64_t ProcessCpuNanoseconds()
+	{
+#if defined(_WIN32)
+		FILETIME creation, exit, kernel, user;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0;
+		return FileTimeNanoseconds(kernel) + FileTimeNanoseconds(user);
+#elif defined(__linux__)
+		timespec time;
+		if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) return 0;
+		return static_cast<std::uint64_t>(time.tv_sec) * 1'000'000'000ull + static_cast<std::uint64_t>(time.tv_nsec);
+#else
+		return 0;
+#endif
+	}
+
+	void PrintScanStats(const scan_stats& stats, std::ostream& out)
+	{
+		const auto flags = out.flags();
+		const auto precision = out.precision();
+		const auto& total = stats.total;
+		out << std::fixed;
+
+		const auto state = stats.running ? "Scan running" : (stats.cancelled ? "Scan cancelled" : (stats.budget_exceeded ? "Scan stopped by its budget" : "Scan finished"));
+		out << state << ": "
+			<< std::setprecision(3) << Seconds(stats.wall_ns) << " s wall, " << Seconds(stats.cpu_ns) << " s CPU";
+		if (stats.wall_ns > 0) out << " (" << std::setprecision(1) << static_cast<double>(stats.cpu_ns) / static_cast<double>(stats.wall_ns) << " cores)";
+		out << ", " << stats.accessed << " files and folders (" << std::setprecision(0) << PerSecond(stats.accessed, stats.wall_ns) << "/s), "
+			<< stats.thread_num << " loaders\n";
+
+		if (stats.running)
+		{
+			out << "The numbers of the loaders are added up when the scan has finished.\n";
+		}
+		if (stats.loaders.empty())
+		{
+			out.flags(flags);
+			out.precision(precision);
+			return;
+		}
+
+		std::uint64_t phase_total = 0;
+		for (const auto ns : total.phase_ns) phase_total += ns;
+
+		out << "-------------------------------\n";
+		out << "phase     |  total s | share\n";
+		for (std::size_t i = 0; i < phase_num; i++)
+		{
+			const auto share = phase_total == 0 ? 0.0 : 100.0 * static_cast<double>(total.phase_ns[i]) / static_cast<double>(phase_total);
+			out << std::left << std::setw(9) << phase_names[i] << std::right << " | " << std::setw(8) << std::setprecision(3) << Seconds(total.phase_ns[i])
+				<< " | " << std::setw(4) << std::setprecision(1) << share << "%\n";
+		}
+		out << "-------------------------------\n";
+
+		const auto& reads = total.reads;
+		out << "System calls: " << reads.opens << " directory opens, " << reads.reads << " directory reads, " << reads.stats << " stats\n";
+		out << "Errors: " << total.errors << " folders failed (" << reads.failed_opens << " couldn't be opened, " << reads.failed_reads << " couldn't be read), " << reads.failed_stats << " stats failed\n";
+		if (total.reused > 0) out << "Reused: " << total.reused << " folders from the previous scan\n";
+
+		out << "-----------------------------------------------------------------------------\n";
+		out << "loader |   wall s |    CPU s |    folders |    entries |  entries/s |  idle s\n";
+		for (const auto& loader : stats.loaders)
+		{
+			out << std::setw(6) << loader.thread << " | " << std::setprecision(3) << std::setw(8) << Seconds(loader.wall_ns) << " | " << std::setw(8) << Seconds(loader.cpu_ns)
+				<< " | " << std::setw(10) << loader.folders << " | " << std::setw(10) << loader.entries << " | " << std::setprecision(0) << std::setw(10)
+				<< PerSecond(loader.entries, loader.wall_ns) << " | " << std::setprecision(3) << std::setw(7) << Seconds(loader.phase_ns[static_cast<std::size_t>(scan_phase::idle)]) << "\n";
+		}
+		out << "-----------------------------------------------------------------------------\n";
+
+		PrintHistogram(out, "Queued folders when a loader asked for work:", total.queue_depth);
+		PrintHistogram(out, "Waits for work in microseconds:", total.idle_us);
+
+		out.flags(flags);
+		out.precision(precision);
+	}
+}
@@ -0,0 +1,88 @@
+#ifndef ANALYZE_SCAN_STATS
+#define ANALYZE_SCAN_STATS
+
+#include "../fs_tree/DirectoryReader.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace anal
+{
+	// Where the time of a loader thread goes. 'read' is opening and listing directories (and checking stamps on
+	// rescans), 'stat' the stat batches for file sizes, 'insert' adding the entries to the tree and queueing the
+	// subfolders, 'aggregate' propagating finished sizes to the ancestors, 'idle' waiting for work.
+	enum class scan_phase : std::uint8_t
+	{
+		read,
+		stat,
+		insert,
+		aggregate,
+		idle,
+		count
+	};
+
+	constexpr std::size_t phase_num = static_cast<std::size_t>(scan_phase::count);
+
+	// Power of two buckets: 0 holds zero, bucket i holds [2^(i-1), 2^i), the last one everything above.
+	constexpr std::size_t histogram_buckets = 16;
+
+	inline std::size_t HistogramBucket(std::uint64_t value)
+	{
+		return std::min<std::size_t>(static_cast<std::size_t>(std::bit_width(value)), histogram_buckets - 1);
+	}
+
+	// Counters of one loader thread. Every loader fills its own copy without synchronization and hands it over
+	// when it exits, so the instrumentation costs a few clock reads per folder.
+	struct loader_stats
+	{
+		std::uint32_t thread = 0;
+		std::uint64_t wall_ns = 0;
+		std::uint64_t cpu_ns = 0;
+		std::uint64_t phase_ns[phase_num] = {};
+
+		std::uint64_t folders = 0;
+		std::uint64_t entries = 0;
+		// Folders copied from the previous scan of an incremental rescan.
+		std::uint64_t reused = 0;
+		// Folders that couldn't be read or failed while loading.
+		std::uint64_t errors = 0;
+		fs_tree::read_counters reads;
+
+		// Number of queued folders whenever the loader asked for work, and how long it waited for it in microseconds.
+		std::uint64_t queue_depth[histogram_buckets] = {};
+		std::uint64_t idle_us[histogram_buckets] = {};
+
+		loader_stats& operator+=(const loader_stats& other);
+	};
+
+	struct scan_stats
+	{
+		// True while the scan runs, the loaders' counters are only merged when it has finished.
+		bool running = false;
+		bool budget_exceeded = false;
+		bool cancelled = false;
+		std::uint32_t thread_num = 0;
+		std::uint64_t accessed = 0;
+		// From the start of the scan until loading finished (or until now while it runs), and the CPU time of the
+		// whole process over that span.
+		std::uint64_t wall_ns = 0;
+		std::uint64_t cpu_ns = 0;
+
+		std::vector<loader_stats> loaders;
+		loader_stats total;
+	};
+
+	std::uint64_t Nanoseconds(std::chrono::steady_clock::duration duration);
+	// CPU time of the calling thread and of the process, 0 where the platform doesn't tell.
+	std::uint64_t ThreadCpuNanoseconds();
+	std::uint64_t ProcessCpuNanoseconds();
+
+	// Prints the totals, the time per phase, system calls, errors, one line per loader and the histograms.
+	void PrintScanStats(const scan_stats& stats, std::ostream& out);
+}
+
+#endif // !ANALYZE_SCAN_STATS
@@ -0,0 +1,351 @@
+#include "TreeWatcher.h"
+
+#include "../fs_tree/NameMatcher.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace anal
+{
+	namespace
+	{
+		// A refresh waits until no event has arrived for quiet_period, but never longer than max_delay after the
+		// first change, so a folder that is written to all the time still gets updated.
+		constexpr auto quiet_period = std::chrono::milliseconds(100);
+		constexpr auto max_delay = std::chrono::milliseconds(1000);
+		constexpr auto stop_check_period = std::chrono::milliseconds(250);
+	}
+
+#if defined(__linux__)
+	namespace
+	{
+		constexpr std::uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_ONLYDIR | IN_EXCL_UNLINK;
+	}
+
+	TreeWatcher::TreeWatcher(fs_tree::FilesystemTree& tree, const scan_options& options)
+		: tree_(tree), writer_(tree.CreateWriter()), read_options_(ReadOptionsFor(options, tree.GetRootPath()))
+	{
+		if (tree_.ReadOnly()) throw std::runtime_error("Trees opened from a snapshot can't be watched, rescan first");
+		if (read_options_.follow_symlinks) throw std::runtime_error("Scans that follow symlinks can't be watched");
+
+		fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd_ < 0) throw std::runtime_error("Can't initialize inotify");
+
+		thread_ = std::jthread([this](std::stop_token stop_token) { Run(stop_token); });
+	}
+
+	TreeWatcher::~TreeWatcher()
+	{
+		thread_.request_stop();
+		thread_.join();
+		close(fd_);
+	}
+
+	void TreeWatcher::Watch(fs_tree::FolderId folder, bool check_modified)
+	{
+		const auto path = tree_.FolderPath(folder);
+		const auto wd = inotify_add_watch(fd_, path.c_str(), watch_mask);
+		if (wd < 0)
+		{
+			unwatched_.fetch_add(1);
+			return;
+		}
+
+		watched_folders_[wd] = folder;
+		folder_watches_[folder] = wd;
+
+		// Catches the changes made between loading the folder and watching it.
+		std::uint64_t modified = 0;
+		if (check_modified && fs_tree::ReadDirectoryModified(path, modified) && modified != tree_.FolderModified(folder))
+		{
+			dirty_.insert(wd);
+		}
+	}
+
+	void TreeWatcher::Unwatch(fs_tree::FolderId folder)
+	{
+		std::vector<fs_tree::FolderId> stack{ folder };
+		while (!stack.empty())
+		{
+			const auto current = stack.back();
+			stack.pop_back();
+
+			const auto watch = folder_watches_.find(current);
+			if (watch != folder_watches_.end())
+			{
+				// A folder moved within the tree keeps its inode and with it the watch, which may already belong
+				// to the folder's new place.
+				const auto watched = watched_folders_.find(watch->second);
+				if (watched != watched_folders_.end() && watched->second == current)
+				{
+					inotify_rm_watch(fd_, watch->second);
+					watched_folders_.erase(watched);
+				}
+				folder_watches_.erase(watch);
+			}
+
+			for (const auto subfolder : tree_.SubFolders(current))
+			{
+				stack.push_back(subfolder);
+			}
+		}
+	}
+
+	void TreeWatcher::WatchAll()
+	{
+		std::vector<fs_tree::FolderId> stack{ tree_.GetRoot() };
+		while (!stack.empty())
+		{
+			const auto folder = stack.back();
+			stack.pop_back();
+
+			Watch(folder, true);
+			for (const auto subfolder : tree_.SubFolders(folder))
+			{
+				stack.push_back(subfolder);
+			}
+		}
+	}
+
+	bool TreeWatcher::ReadEvents()
+	{
+		alignas(inotify_event) char buffer[64 * 1024];
+
+		bool any = false;
+		while (true)
+		{
+			const auto read_size = read(fd_, buffer, sizeof(buffer));
+			if (read_size <= 0) break;
+
+			for (long offset = 0; offset < read_size;)
+			{
+				const auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+				any = true;
+
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					// Events were lost, every folder has to be checked.
+					overflowed_ = true;
+				}
+				else if (event->mask & IN_IGNORED)
+				{
+					// The folder itself is gone, its parent's refresh unlinks it.
+					watched_folders_.erase(event->wd);
+				}
+				else if ((event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) && !(event->mask & IN_ISDIR) && event->len > 0)
+				{
+					written_[event->wd].emplace(event->name);
+				}
+				else
+				{
+					dirty_.insert(event->wd);
+				}
+			}
+		}
+		return any;
+	}
+
+	bool TreeWatcher::Pending() const
+	{
+		return overflowed_ || !dirty_.empty() || !written_.empty();
+	}
+
+	bool TreeWatcher::UpdateFile(fs_tree::FileId file, const std::filesystem::path& folder_path)
+	{
+		fs_tree::directory_listing::entry entry{};
+		if (!fs_tree::ReadFileEntry(folder_path / tree_.FileName(file), entry)) return false;
+
+		const fs_tree::inode_key key{ entry.device, entry.inode };
+		return tree_.UpdateFile(file, entry.size, entry.allocated, entry.times, entry.inode != 0 ? &key : nullptr);
+	}
+
+	void TreeWatcher::UpdateWritten()
+	{
+		const auto exclude = read_options_.exclude && !read_options_.exclude->Empty() ? read_options_.exclude.get() : nullptr;
+
+		const auto written = std::move(written_);
+		written_.clear();
+		for (const auto& [wd, names] : written)
+		{
+			const auto watched = watched_folders_.find(wd);
+			if (dirty_.contains(wd) || watched == watched_folders_.end()) continue;
+
+			// A file that was created, replaced or renamed since is only found once its folder is relinked.
+			const auto folder = watched->second;
+			const auto path = tree_.FolderPath(folder);
+			for (const auto& name : names)
+			{
+				if (exclude && exclude->Matches(name)) continue;
+
+				const auto file = tree_.FindFile(folder, name);
+				if (!file || !UpdateFile(*file, path))
+				{
+					dirty_.insert(wd);
+					break;
+				}
+			}
+		}
+	}
+
+	void TreeWatcher::CheckAll()
+	{
+		for (const auto& [wd, folder] : watched_folders_)
+		{
+			const auto path = tree_.FolderPath(folder);
+			std::uint64_t modified = 0;
+			if (!fs_tree::ReadDirectoryModified(path, modified) || modified != tree_.FolderModified(folder))
+			{
+				dirty_.insert(wd);
+				continue;
+			}
+
+			// Same entries as before, only their contents can have changed.
+			for (const auto file : tree_.Files(folder))
+			{
+				if (!UpdateFile(file, path))
+				{
+					dirty_.insert(wd);
+					break;
+				}
+			}
+		}
+	}
+
+	void TreeWatcher::Refresh(fs_tree::FolderId folder)
+	{
+		thread_local fs_tree::directory_listing listing;
+
+		// A folder that can't be read anymore was removed or moved away, its parent's refresh takes care of it.
+		if (!fs_tree::ReadDirectory(tree_.FolderPath(folder), listing, read_options_)) return;
+
+		const auto old_totals = tree_.FolderTotals(folder);
+		const auto old_histogram = tree_.FolderHistogram(folder);
+		const auto result = tree_.RelinkChildren(writer_, folder, listing);
+
+		for (const auto& [old_folder, new_folder] : result.relocated)
+		{
+			const auto watch = folder_watches_.find(old_folder);
+			if (watch == folder_watches_.end()) continue;
+
+			const auto wd = watch->second;
+			folder_watches_.erase(watch);
+			folder_watches_[new_folder] = wd;
+			watched_folders_[wd] = new_folder;
+		}
+
+		for (const auto removed : result.removed)
+		{
+			Unwatch(removed);
+		}
+
+		tree_.PropagateChange(folder, old_totals, old_histogram);
+
+		// New subtrees are loaded right here. Each folder is watched before it's read, so nothing created while
+		// reading it is missed.
+		const auto first_loaded = tree_.FolderNum();
+		std::vector<fs_tree::FolderId> stack(result.added.begin(), result.added.end());
+		while (!stack.empty())
+		{
+			const auto current = stack.back();
+			stack.pop_back();
+
+			Watch(current, false);
+			if (!fs_tree::ReadDirectory(tree_.FolderPath(current), listing, read_options_)) continue;
+			for (const auto subfolder : tree_.AddChildren(writer_, current, listing))
+			{
+				stack.push_back(subfolder);
+			}
+		}
+		tree_.FinishSubtrees(result.added, first_loaded);
+
+		for (const auto added : result.added)
+		{
+			tree_.PropagateChange(added, {}, {});
+		}
+
+		refreshed_.fetch_add(1);
+	}
+
+	void TreeWatcher::Run(std::stop_token stop_token)
+	{
+		WatchAll();
+
+		using clock = std::chrono::steady_clock;
+		auto first_change = clock::now();
+		auto last_change = clock::now();
+
+		while (!stop_token.stop_requested())
+		{
+			const auto timeout = Pending() ? quiet_period : stop_check_period;
+			pollfd poll_fd{ fd_, POLLIN, 0 };
+			if (poll(&poll_fd, 1, static_cast<int>(timeout.count())) > 0)
+			{
+				const auto was_clean = !Pending();
+				if (ReadEvents())
+				{
+					last_change = clock::now();
+					if (was_clean) first_change = last_change;
+				}
+			}
+
+			const auto now = clock::now();
+			if (!Pending() || (now - last_change < quiet_period && now - first_change < max_delay)) continue;
+
+			std::unique_lock lock(mutex_);
+			if (overflowed_)
+			{
+				overflowed_ = false;
+				written_.clear();
+				CheckAll();
+			}
+			UpdateWritten();
+
+			const auto dirty = std::move(dirty_);
+			dirty_.clear();
+
+			for (const auto wd : dirty)
+			{
+				// Looked up one by one, refreshing a parent moves its subfolders to new ids.
+				const auto watched = watched_folders_.find(wd);
+				if (watched != watched_folders_.end())
+				{
+					Refresh(watched->second);
+				}
+			}
+			tree_.ClearOrders();
+		}
+	}
+#else
+	TreeWatcher::TreeWatcher(fs_tree::FilesystemTree& tree, const scan_options&) : tree_(tree), writer_(tree.CreateWriter())
+	{
+		throw std::runtime_error("Watching is only supported on Linux");
+	}
+
+	TreeWatcher::~TreeWatcher()
+	{
+	}
+#endif
+
+	std::shared_lock<std::shared_mutex> TreeWatcher::ReadLock()
+	{
+		return std::shared_lock(mutex_);
+	}
+
+	std::uint64_t TreeWatcher::RefreshedCount() const
+	{
+		return refreshed_.load();
+	}
+
+	std::uint32_t TreeWatcher::UnwatchedCount() const
+	{
+		return unwatched_.load();
+	}
+}
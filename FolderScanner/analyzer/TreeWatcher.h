@@ -0,0 +1,86 @@
+#ifndef ANALYZE_TREE_WATCHER
+#define ANALYZE_TREE_WATCHER
+
+#include "Analyzer.h"
+#include "../fs_tree/FilesystemTree.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace anal
+{
+	// Keeps a fully loaded tree in sync with the filesystem. Every folder gets an inotify watch. A file that is
+	// written to is stat'ed again and updated in place with FilesystemTree::UpdateFile. A folder that reports a
+	// created, deleted or moved entry is read again and relinked with FilesystemTree::RelinkChildren, new
+	// subfolders are loaded and watched; either way only the sizes along its ancestor chain are updated. Events are
+	// collected until the tree has been quiet for a moment, so a burst of changes (an extracted archive, a build)
+	// costs one refresh per folder. When events were lost, folders whose stamp changed are relinked and the files
+	// of the others are stat'ed again. inotify only reports the link a file was written through, its other hard
+	// links keep their old size until their own folder changes.
+	//
+	// Changes are applied from a background thread, anything that reads the tree while the watcher runs has to
+	// hold ReadLock().
+	//
+	// Linux only. fanotify filesystem marks would avoid one watch per folder but need CAP_SYS_ADMIN and file
+	// handles instead of paths, so inotify is used; folders beyond fs.inotify.max_user_watches aren't watched.
+	class TreeWatcher
+	{
+	private:
+		fs_tree::FilesystemTree& tree_;
+		fs_tree::FilesystemTree::Writer writer_;
+		fs_tree::read_options read_options_;
+
+		std::shared_mutex mutex_;
+
+		int fd_ = -1;
+		std::unordered_map<int, fs_tree::FolderId> watched_folders_;
+		std::unordered_map<fs_tree::FolderId, int> folder_watches_;
+		std::unordered_set<int> dirty_;
+		// Names of the files written to in each folder, updated in place unless the folder is relinked anyway.
+		std::unordered_map<int, std::unordered_set<std::string>> written_;
+		bool overflowed_ = false;
+
+		std::atomic_uint64_t refreshed_ = 0;
+		std::atomic_uint32_t unwatched_ = 0;
+
+		std::jthread thread_;
+
+		void Watch(fs_tree::FolderId folder, bool check_modified);
+		void Unwatch(fs_tree::FolderId folder);
+		void WatchAll();
+		bool ReadEvents();
+		bool Pending() const;
+		// Stats 'file' in 'folder_path' again and updates it, returns false if its folder has to be relinked.
+		bool UpdateFile(fs_tree::FileId file, const std::filesystem::path& folder_path);
+		void UpdateWritten();
+		void CheckAll();
+		void Refresh(fs_tree::FolderId folder);
+		void Run(std::stop_token stop_token);
+
+	public:
+		// Starts watching 'tree', which must have finished loading and must outlive the watcher. Changed folders
+		// are read with the read options of 'options', which should be the ones the tree was scanned with. Throws
+		// std::runtime_error where watching isn't supported, inotify can't be initialized or symlinks are followed
+		// (new links could form cycles the watcher doesn't track).
+		TreeWatcher(fs_tree::FilesystemTree& tree, const scan_options& options);
+		TreeWatcher(const TreeWatcher&) = delete;
+		TreeWatcher& operator=(const TreeWatcher&) = delete;
+		~TreeWatcher();
+
+		std::shared_lock<std::shared_mutex> ReadLock();
+
+		// Number of folders that have been read again because of changes.
+		std::uint64_t RefreshedCount() const;
+		// Number of folders that couldn't be watched (usually because of the watch limit).
+		std::uint32_t UnwatchedCount() const;
+	};
+}
+
+#endif // !ANALYZE_TREE_WATCHER
@@ -0,0 +1,101 @@
+#include "WorkStealingScheduler.h"
+
+#include <algorithm>
+
+namespace anal
+{
+    namespace
+    {
+        bool Lighter(const load_work& lhs, const load_work& rhs)
+        {
+            return lhs.weight < rhs.weight;
+        }
+    }
+
+    void WorkStealingScheduler::Reset(std::uint32_t thread_num, bool prioritized)
+    {
+        queues_.clear();
+        for (std::uint32_t i = 0; i < thread_num; i++)
+        {
+            queues_.push_back(std::make_unique<LocalQueue>());
+        }
+        queued_.store(0);
+        stopped_.store(false);
+        prioritized_ = prioritized;
+    }
+
+    void WorkStealingScheduler::Push(std::uint32_t tid, load_work work)
+    {
+        // Counted before it's queued, so a loader that sees Size() == 0 can't miss it.
+        queued_.fetch_add(1);
+
+        auto& queue = *queues_[tid % queues_.size()];
+        std::unique_lock lock(queue.mutex);
+        queue.deque.push_back(work);
+        if (prioritized_) std::push_heap(queue.deque.begin(), queue.deque.end(), Lighter);
+    }
+
+    std::optional<load_work> WorkStealingScheduler::PopLocal(std::uint32_t tid)
+    {
+        auto& queue = *queues_[tid];
+        std::unique_lock lock(queue.mutex);
+        if (queue.deque.empty()) return std::nullopt;
+        return Take(queue, false);
+    }
+
+    std::optional<load_work> WorkStealingScheduler::Steal(std::uint32_t tid)
+    {
+        const auto queue_num = static_cast<std::uint32_t>(queues_.size());
+        for (std::uint32_t i = 1; i < queue_num; i++)
+        {
+            auto& queue = *queues_[(tid + i) % queue_num];
+            std::unique_lock lock(queue.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || queue.deque.empty()) continue;
+            return Take(queue, true);
+        }
+        return std::nullopt;
+    }
+
+    load_work WorkStealingScheduler::Take(LocalQueue& queue, bool front)
+    {
+        if (prioritized_)
+        {
+            std::pop_heap(queue.deque.begin(), queue.deque.end(), Lighter);
+        }
+        else if (front)
+        {
+            auto work = queue.deque.front();
+            queue.deque.pop_front();
+            return work;
+        }
+
+        auto work = queue.deque.back();
+        queue.deque.pop_back();
+        return work;
+    }
+
+    std::optional<load_work> WorkStealingScheduler::TryPop(std::uint32_t tid)
+    {
+        if (stopped_.load()) return std::nullopt;
+
+        auto work = PopLocal(tid);
+        if (!work) work = Steal(tid);
+        if (work) queued_.fetch_sub(1);
+        return work;
+    }
+
+    void WorkStealingScheduler::Stop()
+    {
+        stopped_.store(true);
+    }
+
+    bool WorkStealingScheduler::Stopped() const
+    {
+        return stopped_.load();
+    }
+
+    std::uint64_t WorkStealingScheduler::Size() const
+    {
+        return queued_.load();
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef ANALYZE_WORK_STEALING_SCHEDULER
+#define ANALYZE_WORK_STEALING_SCHEDULER
+
+#include "../fs_tree/Folder.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace anal
+{
+	// A folder to load, with the folder at the same path in the previous scan when rescanning incrementally
+	// (fs_tree::invalid_folder if there is none). 'weight' is the estimated size of the folder's subtree in bytes,
+	// only used by a prioritized scheduler.
+	struct load_work
+	{
+		fs_tree::FolderId folder;
+		fs_tree::FolderId previous = fs_tree::invalid_folder;
+		std::uint64_t weight = 0;
+	};
+
+	// Distributes folders between loader threads. Every loader owns a deque: it pushes the subfolders it finds to
+	// the back and pops from the back (depth first, the data is still hot), while idle loaders steal from the front
+	// of other deques (the oldest entries, which are the closest to the root and usually the largest subtrees).
+	// Each deque has its own mutex, so the only contention left is between an owner and a thief of the same deque.
+	// Loaders never block in the scheduler: when there's nothing to take they return their thread to the ScanPool
+	// and the Scanner starts a loader again once work is pushed.
+	//
+	// A prioritized scheduler keeps every deque as a max-heap on load_work::weight instead, owners and thieves both
+	// take the heaviest folder. The order is only global per deque, but thieves keep the heavy branches spread
+	// over all loaders.
+	class WorkStealingScheduler
+	{
+	private:
+		struct alignas(64) LocalQueue
+		{
+			std::mutex mutex;
+			std::deque<load_work> deque;
+		};
+
+		std::vector<std::unique_ptr<LocalQueue>> queues_;
+
+		std::atomic_uint64_t queued_ = 0;
+		std::atomic_bool stopped_ = false;
+		bool prioritized_ = false;
+
+		std::optional<load_work> PopLocal(std::uint32_t tid);
+		std::optional<load_work> Steal(std::uint32_t tid);
+		load_work Take(LocalQueue& queue, bool front);
+
+	public:
+		void Reset(std::uint32_t thread_num, bool prioritized = false);
+
+		void Push(std::uint32_t tid, load_work work);
+
+		// Returns the next folder for the loader 'tid', its own newest or another loader's oldest. Returns
+		// std::nullopt when nothing is queued or the deques holding work were busy, and once the scheduler has been
+		// stopped.
+		std::optional<load_work> TryPop(std::uint32_t tid);
+
+		void Stop();
+		bool Stopped() const;
+		std::uint64_t Size() const;
+	};
+}
+
+#endif // !ANALYZE_WORK_STEALING_SCHEDULER
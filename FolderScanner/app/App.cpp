@@ -1,7 +1,17 @@
 #include "App.h"
 #include "../analyzer/Analyzer.h"
+#include "../analyzer/Duplicates.h"
+#include "../analyzer/FileTypes.h"
+#include "../analyzer/Query.h"
+#include "../bench/Benchmark.h"
+#include "../fs_tree/NameMatcher.h"
 #include <thread>
+#include <chrono>
+#include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
 std::optional<std::pair<std::string, std::vector<std::string>>> app::App::GetCommandAndArgs()
 {
 	std::string command;
@@ -46,7 +56,7 @@ void app::App::Exit()
 
 void app::App::Scan(const std::vector<std::string>& args)
 {
-	std::cout << "Processing. Wait for the results..." << std::endl;
+	std::cout << "Scanning in the background, 'ls' shows the results so far." << std::endl;
 	
 	std::filesystem::path path;
 
@@ -61,31 +71,66 @@ void app::App::Scan(const std::vector<std::string>& args)
 
 	std::cout << path << std::endl;
 
+	StopUpdates();
+	previous_tree_.reset();
 	filesystem_tree_ = std::make_unique<fs_tree::FilesystemTree>(path);
-	current_root = filesystem_tree_->GetRoot();
-	anal::AnalyzeFilesystemTree(filesystem_tree_.get());
+	current_folder_ = std::filesystem::path();
+	StartScan(nullptr);
+}
+
+void app::App::Rescan(const std::vector<std::string>&)
+{
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' or 'load' first." << std::endl;
+		return;
+	}
+
+	std::cout << "Scanning in the background, 'ls' shows the results so far." << std::endl;
+	std::cout << filesystem_tree_->GetRootPath() << std::endl;
+
+	StopUpdates();
+	previous_tree_ = std::move(filesystem_tree_);
+	filesystem_tree_ = std::make_unique<fs_tree::FilesystemTree>(previous_tree_->GetRootPath());
+	current_folder_ = std::filesystem::path();
+	StartScan(previous_tree_.get());
 }
 
 void app::App::Ls(const std::vector<std::string>& args)
 {
-	//std::uint64_t min_size = 0;
-	//std::uint64_t max_size = std::numeric_limits<std::uint64_t>::max();
-	//
-	//if (args.size() > 0)
-	//{
-	//	min_size = std::stoi(args[0]);
-	//}
-	//
-	//if (args.size() > 1)
-	//{
-	//	max_size = std::stoi(args[1]);
-	//}
-	//
-	//if (!filesystem_tree_)
-	//{
-	//	std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
-	//	return;
-	//}
+	std::uint32_t limit = fs_tree::all_children;
+	if (args.size() > 1 && args[0].size())
+	{
+		try
+		{
+			limit = static_cast<std::uint32_t>(std::stoul(args[0]));
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Invalid count!" << std::endl;
+			return;
+		}
+	}
+
+	std::uintmax_t min_size = 0;
+	if (args.size() > 2 && args[1].size())
+	{
+		try
+		{
+			min_size = ParseSize(args[1]);
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Invalid size!" << std::endl;
+			return;
+		}
+	}
+
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
+	}
 	
 	const auto additional_spaces = [](std::uint64_t num) -> std::string
 	{
@@ -97,50 +142,532 @@ void app::App::Ls(const std::vector<std::string>& args)
 		return return_value.str();
 	};
 
-	auto& folders = current_root->GetFolders();
-	auto& files = current_root->GetFiles();
+	// The watcher can't change the tree while it's being printed.
+	std::shared_lock<std::shared_mutex> watcher_lock;
+	if (watcher_) watcher_lock = watcher_->ReadLock();
+
+	auto& tree = *filesystem_tree_;
+	auto current_folder = tree.GetRoot();
+	if (args.size() > 3 && args[2].size())
+	{
+		const auto path = ScanPath(args[2]);
+		if (const auto folder = tree.GetFolder(path))
+		{
+			current_folder = *folder;
+		}
+		else if (const auto file = tree.GetFile(path))
+		{
+			const auto info = tree.FileDisplayInfo(*file);
+			std::cout << "name: " << info.path << " | size: " << info.size << " " << info.unit << std::endl;
+			return;
+		}
+		else
+		{
+			std::cout << "Not found in the scan!" << std::endl;
+			return;
+		}
+	}
+	else if (const auto folder = CurrentFolder())
+	{
+		current_folder = *folder;
+	}
+	else
+	{
+		return;
+	}
+
+	const auto kind = size_kind_;
+	const auto allocated = kind == fs_tree::size_kind::allocated;
+	const auto progress_size = [&](const fs_tree::subtree_progress& progress) { return allocated ? progress.allocated : progress.size; };
+
+	std::vector<std::pair<fs_tree::FolderId, fs_tree::subtree_progress>> folders;
+	std::vector<fs_tree::FileId> files;
+	// A scan stopped by its budget leaves folders that will never be complete, they're listed like a running scan.
+	const auto tree_complete = ScanFinished() && tree.FolderComplete(tree.GetRoot());
+	if (tree_complete)
+	{
+		// Children are kept in load order, the tree sorts (and caches) only the folders that are listed.
+		for (const auto folder : tree.SortedSubFolders(current_folder, limit, kind))
+		{
+			folders.emplace_back(folder, tree.FolderProgress(folder));
+		}
+		const auto sorted_files = tree.SortedFiles(current_folder, limit, kind);
+		files.assign(sorted_files.begin(), sorted_files.end());
+	}
+	else
+	{
+		// Totals keep changing while the scan runs, so the children loaded so far are ranked by their current
+		// progress and nothing is cached.
+		for (const auto folder : tree.SubFolders(current_folder))
+		{
+			folders.emplace_back(folder, tree.FolderProgress(folder));
+		}
+		const auto folder_count = std::min<std::size_t>(limit, folders.size());
+		std::partial_sort(folders.begin(), folders.begin() + folder_count, folders.end(), [&](const auto& lhs, const auto& rhs) { return progress_size(lhs.second) > progress_size(rhs.second); });
+		folders.resize(folder_count);
+
+		files.assign(tree.Files(current_folder).begin(), tree.Files(current_folder).end());
+		const auto file_count = std::min<std::size_t>(limit, files.size());
+		std::partial_sort(files.begin(), files.begin() + file_count, files.end(), [&](const auto lhs, const auto rhs) { return tree.FileSize(lhs, kind) > tree.FileSize(rhs, kind); });
+		files.resize(file_count);
+	}
+
+	// Both lists are ordered biggest first, so everything from the first entry below the minimum goes.
+	const auto small_folder = std::find_if(folders.begin(), folders.end(), [&](const auto& folder) { return progress_size(folder.second) < min_size; });
+	folders.erase(small_folder, folders.end());
+	const auto small_file = std::find_if(files.begin(), files.end(), [&](const auto file) { return tree.FileSize(file, kind) < min_size; });
+	files.erase(small_file, files.end());
 
 	std::cout << "--------------------------------------\n";
 	std::cout << "Folders: \n";
 
-	std::vector<fs_tree::display_info> info_vector;
+	std::vector<std::pair<fs_tree::display_info, fs_tree::subtree_progress>> folder_infos;
 	std::uint64_t longest_path = 0;
 
-	auto root_info = current_root->GetDisplayInfo();
-	longest_path = std::max(longest_path, static_cast<std::uint64_t>(root_info.path.size()));
-	info_vector.push_back(std::move(root_info));
+	const auto root_progress = tree.FolderProgress(current_folder);
+	folders.insert(folders.begin(), { current_folder, root_progress });
 
-	for (const auto& folder : folders)
+	for (const auto& [folder, progress] : folders)
 	{
-		const auto info = folder->GetDisplayInfo();
+		fs_tree::display_info info(tree.FolderName(folder), progress_size(progress));
 		longest_path = std::max(longest_path, static_cast<std::uint64_t>(info.path.size()));
-		info_vector.emplace_back(folder->GetDisplayInfo());
+		folder_infos.emplace_back(std::move(info), progress);
+	}
+
+	const auto incomplete_note = ScanFinished() ? " (partial)" : " (still scanning)";
+	for (const auto& [info, progress] : folder_infos)
+	{
+		std::cout << "name: " << info.path << additional_spaces(longest_path - info.path.size()) << " | size: " << info.size << " " << info.unit;
+		if (allocated)
+		{
+			const fs_tree::display_info apparent(fs_tree::native_string_view(), progress.size);
+			std::cout << " (" << apparent.size << " " << apparent.unit << " apparent)";
+		}
+		else if (progress.unique_size != progress.size)
+		{
+			const fs_tree::display_info unique(fs_tree::native_string_view(), progress.unique_size);
+			std::cout << " (" << unique.size << " " << unique.unit << " with hard links counted once)";
+		}
+		std::cout << (progress.complete ? "" : incomplete_note) << std::endl;
 	}
 
-	for (const auto& info : info_vector)
+	if (!root_progress.complete && ScanFinished())
 	{
-		//if (info.size < min_size || info.size > max_size) continue;
-		std::cout << "name: " << info.path << additional_spaces(longest_path - info.path.size()) << " | size: " << info.size << " " << info.unit << std::endl;
+		std::cout << "Scan stopped by its budget, " << root_progress.entries << " files and folders were loaded.\n";
 	}
-	
+	else if (!root_progress.complete)
+	{
+		std::cout << "Scan in progress, " << root_progress.entries << " files and folders loaded so far.\n";
+	}
+
+	std::vector<std::pair<fs_tree::display_info, fs_tree::FileId>> info_vector;
 	std::cout << "--------------------------------------\n";
 	std::cout << "Files: \n";
 
-	info_vector.clear();
 	longest_path = 0;
 
-	for (const auto& file : files)
+	for (const auto file : files)
 	{
-		const auto info = file->GetDisplayInfo();
+		fs_tree::display_info info(tree.FileName(file), tree.FileSize(file, kind));
 		longest_path = std::max(longest_path, static_cast<std::uint64_t>(info.path.size()));
-		info_vector.emplace_back(file->GetDisplayInfo());
+		info_vector.emplace_back(std::move(info), file);
+	}
+
+	for (const auto& [info, file] : info_vector)
+	{
+		std::cout << "name: " << info.path << additional_spaces(longest_path - info.path.size()) << " | size: " << info.size << " " << info.unit;
+
+		// Holes (or compression) leave a file with fewer blocks than its size.
+		if (tree.FileAllocated(file) < tree.FileSize(file))
+		{
+			const fs_tree::display_info other(fs_tree::native_string_view(), allocated ? tree.FileSize(file) : tree.FileAllocated(file));
+			std::cout << " (sparse, " << other.size << " " << other.unit << (allocated ? " apparent)" : " on disk)");
+		}
+		std::cout << std::endl;
+	}
+}
+
+std::uintmax_t app::App::ParseSize(const std::string& size)
+{
+	// Sizes like 512, 100K, 20M or 1G, in the units the sizes are displayed in.
+	std::size_t end = 0;
+	auto bytes = static_cast<std::uintmax_t>(std::stoull(size, &end));
+	const std::string_view units = "KMGTP";
+	const auto unit = end < size.size() ? units.find(static_cast<char>(std::toupper(size[end]))) : std::string_view::npos;
+	if (unit != std::string_view::npos) bytes <<= 10 * (unit + 1);
+	return bytes;
+}
+
+void app::App::Dupes(const std::vector<std::string>& args)
+{
+	std::size_t limit = 10;
+	anal::duplicate_options options;
+	try
+	{
+		if (args.size() > 1 && args[0].size()) limit = std::stoul(args[0]);
+		if (args.size() > 2 && args[1].size()) options.min_size = std::max<std::uintmax_t>(ParseSize(args[1]), 1);
+	}
+	catch (const std::exception&)
+	{
+		std::cout << "Invalid count or size!" << std::endl;
+		return;
+	}
+
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
+	}
+
+	if (!ScanFinished())
+	{
+		std::cout << "The scan is still running!" << std::endl;
+		return;
+	}
+
+	const auto size_text = [](std::uintmax_t size)
+	{
+		const fs_tree::display_info info(fs_tree::native_string_view(), size);
+		std::stringstream text;
+		text << info.size << " " << info.unit;
+		return text.str();
+	};
+
+	// The watcher only waits while the candidates are taken from the tree, hashing them can take minutes.
+	anal::duplicate_stats stats;
+	std::vector<anal::duplicate_candidate> candidates;
+	{
+		std::shared_lock<std::shared_mutex> watcher_lock;
+		if (watcher_) watcher_lock = watcher_->ReadLock();
+
+		const auto folder = CurrentFolder();
+		if (!folder) return;
+		candidates = anal::DuplicateCandidates(*filesystem_tree_, *folder, options, &stats);
+	}
+
+	const auto groups = anal::FindDuplicates(std::move(candidates), options, &stats, pool_ ? *pool_ : anal::ScanPool::Shared());
+
+	std::uintmax_t reclaimable = 0;
+	for (const auto& group : groups)
+	{
+		reclaimable += group.Reclaimable();
+	}
+
+	std::cout << "--------------------------------------\n";
+	for (std::size_t i = 0; i < std::min(limit, groups.size()); i++)
+	{
+		const auto& group = groups[i];
+		std::cout << "reclaimable: " << size_text(group.Reclaimable()) << " | " << group.files.size() << " copies of " << size_text(group.size) << "\n";
+		for (const auto& file : group.files)
+		{
+			std::cout << "    " << file.string() << "\n";
+		}
+	}
+	std::cout << "--------------------------------------\n";
+	std::cout << groups.size() << " groups of duplicates, " << size_text(reclaimable) << " reclaimable.\n";
+	std::cout << stats.same_size << " of " << stats.files << " files share their size (" << size_text(stats.same_size_bytes) << "), " << stats.same_partial
+		<< " also their first and last bytes. Read " << size_text(stats.partial_read_bytes) << " for partial hashes and " << size_text(stats.full_read_bytes) << " in full.\n";
+	if (stats.errors > 0) std::cout << stats.errors << " files couldn't be read.\n";
+	std::cout.flush();
+}
+
+void app::App::Types(const std::vector<std::string>& args)
+{
+	std::size_t limit = 20;
+	try
+	{
+		if (args.size() > 1 && args[0].size()) limit = std::stoul(args[0]);
+	}
+	catch (const std::exception&)
+	{
+		std::cout << "Invalid count!" << std::endl;
+		return;
+	}
+
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
+	}
+
+	std::shared_lock<std::shared_mutex> watcher_lock;
+	if (watcher_) watcher_lock = watcher_->ReadLock();
+
+	const auto& tree = *filesystem_tree_;
+	auto folder = tree.GetRoot();
+	if (args.size() > 2 && args[1].size())
+	{
+		const auto found = tree.GetFolder(ScanPath(args[1]));
+		if (!found)
+		{
+			std::cout << "Not found in the scan!" << std::endl;
+			return;
+		}
+		folder = *found;
+	}
+	else if (const auto current = CurrentFolder())
+	{
+		folder = *current;
+	}
+	else
+	{
+		return;
+	}
+
+	// The loaders counted the whole tree while scanning, other folders (and trees the watcher changed) are
+	// counted from their files.
+	const auto from_scan = folder == tree.GetRoot() && scanner_types_ && ScanFinished();
+	const auto types = from_scan ? scanner_->Types() : anal::SubtreeTypes(tree, folder);
+
+	const auto kind = size_kind_;
+	const auto size_of = [kind](const anal::type_totals& totals) { return kind == fs_tree::size_kind::allocated ? totals.allocated : totals.size; };
+	const auto total = types.Total();
+	const auto print = [&](const std::string& name, const anal::type_totals& totals)
+	{
+		const fs_tree::display_info info(fs_tree::native_string_view(), size_of(totals));
+		std::stringstream share;
+		share << std::fixed << std::setprecision(1) << (size_of(total) > 0 ? 100.0 * static_cast<double>(size_of(totals)) / static_cast<double>(size_of(total)) : 0.0) << "%";
+		std::cout << "name: " << std::left << std::setw(16) << name << std::right << " | size: " << info.size << " " << info.unit << " | files: " << totals.files
+			<< " | " << share.str() << "\n";
+	};
+
+	auto categories = types.Categories();
+	std::vector<std::size_t> order(categories.size());
+	for (std::size_t i = 0; i < order.size(); i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [&](const auto lhs, const auto rhs) { return size_of(categories[lhs]) > size_of(categories[rhs]); });
+
+	std::cout << "--------------------------------------\n";
+	std::cout << "Categories: \n";
+	for (const auto category : order)
+	{
+		if (categories[category].files > 0) print(anal::CategoryName(static_cast<anal::file_category>(category)), categories[category]);
+	}
+	std::cout << "--------------------------------------\n";
+	std::cout << "Extensions: \n";
+	const auto extensions = types.Extensions(kind);
+	for (std::size_t i = 0; i < std::min(limit, extensions.size()); i++)
+	{
+		print(extensions[i].first.empty() ? "(none)" : "." + extensions[i].first, extensions[i].second);
+	}
+	std::cout << "--------------------------------------\n";
+	const fs_tree::display_info info(fs_tree::native_string_view(), size_of(total));
+	std::cout << total.files << " files in " << extensions.size() << " extensions, " << info.size << " " << info.unit;
+	if (!tree.FolderComplete(folder)) std::cout << " (partial)";
+	std::cout << std::endl;
+}
+
+void app::App::Age(const std::vector<std::string>& args)
+{
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
+	}
+
+	std::shared_lock<std::shared_mutex> watcher_lock;
+	if (watcher_) watcher_lock = watcher_->ReadLock();
+
+	const auto& tree = *filesystem_tree_;
+	auto folder = tree.GetRoot();
+	if (args.size() > 1 && args[0].size())
+	{
+		const auto found = tree.GetFolder(ScanPath(args[0]));
+		if (!found)
+		{
+			std::cout << "Not found in the scan!" << std::endl;
+			return;
+		}
+		folder = *found;
+	}
+	else if (const auto current = CurrentFolder())
+	{
+		folder = *current;
+	}
+	else
+	{
+		return;
+	}
+
+	// Kept up to date by the loaders for every folder, nothing is read here.
+	const auto histogram = tree.FolderHistogram(folder);
+	std::uint64_t total_files = 0;
+	std::uintmax_t total_bytes = 0;
+	for (std::uint32_t i = 0; i < fs_tree::age_bucket_num; i++)
+	{
+		total_files += histogram.age_files[i];
+		total_bytes += histogram.age_bytes[i];
+	}
+
+	const auto size_text = [](std::uintmax_t size)
+	{
+		const fs_tree::display_info info(fs_tree::native_string_view(), size);
+		std::stringstream text;
+		text << info.size << " " << info.unit;
+		return text.str();
+	};
+	const auto share_text = [total_bytes](std::uintmax_t bytes)
+	{
+		std::stringstream share;
+		share << std::fixed << std::setprecision(1) << (total_bytes > 0 ? 100.0 * static_cast<double>(bytes) / static_cast<double>(total_bytes) : 0.0) << "%";
+		return share.str();
+	};
+	const auto print = [&](const std::string& name, std::uint64_t files, std::uintmax_t bytes)
+	{
+		std::cout << std::left << std::setw(20) << name << std::right << " | size: " << size_text(bytes) << " | files: " << files << " | " << share_text(bytes) << "\n";
+	};
+	const auto days_text = [](std::uint32_t days)
+	{
+		if (days >= 365 && days % 365 == 0) return std::to_string(days / 365) + (days == 365 ? " year" : " years");
+		return std::to_string(days) + (days == 1 ? " day" : " days");
+	};
+	// Bucket bounds are powers of two, printed exactly instead of rounded like other sizes.
+	const auto bound_text = [](std::uint64_t size)
+	{
+		const char* units[] = { "B", "KB", "MB", "GB" };
+		std::size_t unit = 0;
+		while (size >= 1024 && unit + 1 < std::size(units))
+		{
+			size /= 1024;
+			unit++;
+		}
+		return std::to_string(size) + " " + units[unit];
+	};
+
+	std::cout << "--------------------------------------\n";
+	std::cout << "Last used (newest of access and modification time) before the scan: \n";
+	for (std::uint32_t i = 0; i < fs_tree::age_bucket_num; i++)
+	{
+		const auto name = i == 0 ? "under " + days_text(fs_tree::age_bucket_days[1])
+			: i + 1 == fs_tree::age_bucket_num ? "over " + days_text(fs_tree::age_bucket_days[i])
+			: days_text(fs_tree::age_bucket_days[i]) + " - " + days_text(fs_tree::age_bucket_days[i + 1]);
+		print(name, histogram.age_files[i], histogram.age_bytes[i]);
+	}
+	std::cout << "--------------------------------------\n";
+	std::cout << "Unused for at least: \n";
+	for (std::uint32_t i = 1; i < fs_tree::age_bucket_num; i++)
+	{
+		std::uint64_t files = 0;
+		std::uintmax_t bytes = 0;
+		for (auto older = i; older < fs_tree::age_bucket_num; older++)
+		{
+			files += histogram.age_files[older];
+			bytes += histogram.age_bytes[older];
+		}
+		print(days_text(fs_tree::age_bucket_days[i]), files, bytes);
+	}
+	std::cout << "--------------------------------------\n";
+	std::cout << "File sizes: \n";
+	for (std::uint32_t i = 0; i < fs_tree::size_bucket_num; i++)
+	{
+		if (histogram.size_files[i] == 0) continue;
+		const auto name = i == 0 ? std::string("empty")
+			: i + 1 == fs_tree::size_bucket_num ? bound_text(fs_tree::SizeBucketMin(i)) + " and more"
+			: bound_text(fs_tree::SizeBucketMin(i)) + " - " + bound_text(fs_tree::SizeBucketMin(i + 1));
+		print(name, histogram.size_files[i], histogram.size_bytes[i]);
+	}
+	std::cout << "--------------------------------------\n";
+	std::cout << total_files << " files, " << size_text(total_bytes);
+	if (!tree.FolderComplete(folder)) std::cout << " (partial)";
+	std::cout << std::endl;
+}
+
+void app::App::Find(const std::vector<std::string>& args)
+{
+	// An expression never starts with a number, so a leading one is the count.
+	std::size_t limit = 100;
+	std::size_t first = 0;
+	if (!args.empty() && !args[0].empty() && std::all_of(args[0].begin(), args[0].end(), [](const char c) { return std::isdigit(static_cast<unsigned char>(c)); }))
+	{
+		try
+		{
+			limit = std::stoul(args[0]);
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Invalid count!" << std::endl;
+			return;
+		}
+		first = 1;
+	}
+
+	std::string expression;
+	for (auto arg = args.begin() + static_cast<std::ptrdiff_t>(std::min(first, args.size())); arg != args.end(); arg++)
+	{
+		if (arg->empty()) continue;
+		if (!expression.empty()) expression += ' ';
+		expression += *arg;
+	}
+
+	std::optional<anal::Query> query;
+	try
+	{
+		query.emplace(expression);
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cout << "Invalid query: " << e.what() << std::endl;
+		return;
+	}
+
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
 	}
 
-	for (const auto& info : info_vector)
+	if (!ScanFinished())
 	{
-		//if (info.size < min_size || info.size > max_size) continue;
-		std::cout << "name: " << info.path << additional_spaces(longest_path - info.path.size()) << " | size: " << info.size << " " << info.unit << std::endl;
+		std::cout << "The scan is still running!" << std::endl;
+		return;
 	}
+
+	std::shared_lock<std::shared_mutex> watcher_lock;
+	if (watcher_) watcher_lock = watcher_->ReadLock();
+
+	const auto& tree = *filesystem_tree_;
+	const auto size_text = [](std::uintmax_t size)
+	{
+		const fs_tree::display_info info(fs_tree::native_string_view(), size);
+		std::stringstream text;
+		text << info.size << " " << info.unit;
+		return text.str();
+	};
+
+	anal::query_stats stats;
+	const auto current_folder = CurrentFolder();
+	if (!current_folder) return;
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto matches = query->Run(tree, *current_folder, &stats, pool_ ? *pool_ : anal::ScanPool::Shared());
+	const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// Biggest first, folders and files together.
+	const auto kind = size_kind_;
+	std::vector<std::pair<std::uintmax_t, std::pair<bool, std::uint32_t>>> order;
+	order.reserve(matches.folders.size() + matches.files.size());
+	std::uintmax_t file_bytes = 0;
+	for (const auto folder : matches.folders)
+	{
+		order.push_back({ tree.FolderSize(folder, kind), { true, folder } });
+	}
+	for (const auto file : matches.files)
+	{
+		order.push_back({ tree.FileSize(file, kind), { false, file } });
+		file_bytes += tree.FileSize(file, kind);
+	}
+	const auto count = std::min(limit, order.size());
+	std::partial_sort(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(count), order.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+
+	std::cout << "--------------------------------------\n";
+	for (std::size_t i = 0; i < count; i++)
+	{
+		const auto [folder, id] = order[i].second;
+		std::cout << "size: " << std::left << std::setw(12) << size_text(order[i].first) << std::right << " | " << (folder ? tree.FolderPath(id).string() + std::string(1, static_cast<char>(std::filesystem::path::preferred_separator)) : tree.FilePath(id).string()) << "\n";
+	}
+	std::cout << "--------------------------------------\n";
+	std::cout << matches.files.size() << " files (" << size_text(file_bytes) << ") and " << matches.folders.size() << " folders match.\n";
+	std::cout << "Checked " << stats.files << " files in " << stats.folders << " folders, skipped " << stats.pruned << " subtrees by their totals, in "
+		<< std::fixed << std::setprecision(1) << elapsed << " ms." << std::defaultfloat << std::endl;
 }
 
 void app::App::Cd(const std::vector<std::string>& args)
@@ -153,10 +680,25 @@ void app::App::Cd(const std::vector<std::string>& args)
 
 	if (args.size() == 2)
 	{
+		// Folders of the scan are looked up in its path index, relative to the folder 'ls' lists, and are found
+		// even if they have been deleted since.
+		if (filesystem_tree_)
+		{
+			std::shared_lock<std::shared_mutex> watcher_lock;
+			if (watcher_) watcher_lock = watcher_->ReadLock();
+
+			const auto path = ScanPath(args[0]);
+			if (const auto folder = filesystem_tree_->GetFolder(path))
+			{
+				current_path_ = filesystem_tree_->FolderPath(*folder);
+				current_folder_ = current_path_.lexically_relative(filesystem_tree_->GetRootPath());
+				return;
+			}
+		}
+
 		if (args[0] == "..")
 		{
 			current_path_ = current_path_.parent_path();
-			return;
 		}
 		else
 		{
@@ -175,6 +717,11 @@ void app::App::Cd(const std::vector<std::string>& args)
 				return;
 			}
 		}
+
+		// Above the root or in another folder on disk, the scan's commands only work again back inside it.
+		std::shared_lock<std::shared_mutex> watcher_lock;
+		if (watcher_) watcher_lock = watcher_->ReadLock();
+		UpdateCurrentFolder();
 	}
 }
 
@@ -186,6 +733,275 @@ void app::App::Rmdir(const std::vector<std::string>& args)
 	}
 }
 
+void app::App::Save(const std::vector<std::string>& args)
+{
+	if (args.size() < 2 || args[0].empty())
+	{
+		std::cout << "No path provided!" << std::endl;
+		return;
+	}
+
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
+	}
+
+	if (!ScanFinished())
+	{
+		std::cout << "The scan is still running!" << std::endl;
+		return;
+	}
+
+	if (!filesystem_tree_->FolderComplete(filesystem_tree_->GetRoot()))
+	{
+		std::cout << "The scan was stopped by its budget, only a full scan can be saved!" << std::endl;
+		return;
+	}
+
+	try
+	{
+		std::shared_lock<std::shared_mutex> watcher_lock;
+		if (watcher_) watcher_lock = watcher_->ReadLock();
+
+		filesystem_tree_->Save(args[0]);
+		std::cout << "Saved " << filesystem_tree_->FolderNum() << " folders and " << filesystem_tree_->FileNum() << " files." << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+}
+
+void app::App::Load(const std::vector<std::string>& args)
+{
+	if (args.size() < 2 || args[0].empty())
+	{
+		std::cout << "No path provided!" << std::endl;
+		return;
+	}
+
+	try
+	{
+		auto tree = std::make_unique<fs_tree::FilesystemTree>(std::make_unique<fs_tree::Snapshot>(args[0]));
+		StopUpdates();
+		previous_tree_.reset();
+		filesystem_tree_ = std::move(tree);
+		current_folder_ = std::filesystem::path();
+		scanner_types_ = false;
+		std::cout << "Loaded " << filesystem_tree_->GetRootPath() << " (" << filesystem_tree_->FolderNum() << " folders and " << filesystem_tree_->FileNum() << " files)." << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+}
+
+void app::App::Bench(const std::vector<std::string>& args)
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "FolderScanner_bench";
+	if (args.size() > 1 && args[0].size())
+	{
+		path = args[0];
+	}
+
+	std::uint32_t max_thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+	if (args.size() > 2 && args[1].size())
+	{
+		try
+		{
+			max_thread_num = std::max(std::stoi(args[1]), 1);
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Invalid thread count!" << std::endl;
+			return;
+		}
+	}
+
+	// The benchmark runs its own scans.
+	StopUpdates();
+
+	if (!std::filesystem::exists(path))
+	{
+		std::cout << "Generating synthetic tree in " << path << std::endl;
+		const auto created = bench::GenerateSyntheticTree(path, {});
+		std::cout << "Created " << created << " files and folders." << std::endl;
+	}
+
+	bench::RunLoaderScaling(path, max_thread_num, scan_options_);
+}
+
+void app::App::Stats(const std::vector<std::string>&)
+{
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
+	}
+
+	anal::PrintScanStats(scanner_ ? scanner_->Statistics() : anal::scan_stats{}, std::cout);
+	std::cout.flush();
+}
+
+void app::App::Watch(const std::vector<std::string>& args)
+{
+	if (args.size() > 1 && args[0] == "off")
+	{
+		if (watcher_)
+		{
+			std::cout << "Stopped watching, " << watcher_->RefreshedCount() << " folders were updated." << std::endl;
+		}
+		watcher_.reset();
+		return;
+	}
+
+	if (!filesystem_tree_)
+	{
+		std::cout << "No scan has been performed yet! Use 'scan' first." << std::endl;
+		return;
+	}
+
+	if (!ScanFinished())
+	{
+		std::cout << "The scan is still running!" << std::endl;
+		return;
+	}
+
+	if (!filesystem_tree_->FolderComplete(filesystem_tree_->GetRoot()))
+	{
+		std::cout << "The scan was stopped by its budget, only a full scan can be watched!" << std::endl;
+		return;
+	}
+
+	if (watcher_)
+	{
+		std::cout << "Already watching, " << watcher_->RefreshedCount() << " folders were updated so far";
+		if (watcher_->UnwatchedCount() > 0)
+		{
+			std::cout << ", " << watcher_->UnwatchedCount() << " folders couldn't be watched (see fs.inotify.max_user_watches)";
+		}
+		std::cout << "." << std::endl;
+		return;
+	}
+
+	try
+	{
+		watcher_ = std::make_unique<anal::TreeWatcher>(*filesystem_tree_, scan_options_);
+		scanner_types_ = false;
+		std::cout << "Watching " << filesystem_tree_->GetRootPath() << " for changes." << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
+}
+
+void app::App::Set(const std::vector<std::string>& args)
+{
+	if (args.size() < 3 || args[0].empty())
+	{
+		PrintOptions();
+		return;
+	}
+
+	const auto& name = args[0];
+	const auto& value = args[1];
+	const auto on = value == "on" || value == "1" || value == "true";
+
+	try
+	{
+		if (name == "threads")
+		{
+			scan_options_.thread_num = static_cast<std::uint32_t>(std::stoul(value));
+		}
+		else if (name == "async_stat")
+		{
+			scan_options_.read.async_stat = on;
+		}
+		else if (name == "io_depth")
+		{
+			scan_options_.read.io_depth = std::max(static_cast<std::uint32_t>(std::stoul(value)), 1u);
+		}
+		else if (name == "size")
+		{
+			if (value != "apparent" && value != "allocated") throw std::invalid_argument("size");
+			size_kind_ = value == "allocated" ? fs_tree::size_kind::allocated : fs_tree::size_kind::apparent;
+		}
+		else if (name == "one_filesystem")
+		{
+			scan_options_.one_filesystem = on;
+		}
+		else if (name == "follow_symlinks")
+		{
+			scan_options_.read.follow_symlinks = on;
+		}
+		else if (name == "exclude")
+		{
+			// Every 'set exclude' adds a rule, 'off' drops them all. The matcher is rebuilt so running scans keep
+			// the one they started with.
+			auto rules = value == "off" ? std::vector<std::string>() : exclude_rules_;
+			if (value != "off") rules.push_back(value);
+
+			auto matcher = std::make_shared<fs_tree::NameMatcher>();
+			for (const auto& rule : rules)
+			{
+				matcher->Add(rule);
+			}
+			exclude_rules_ = std::move(rules);
+			scan_options_.read.exclude = std::move(matcher);
+		}
+		else if (name == "largest_first")
+		{
+			scan_options_.largest_first = on;
+		}
+		else if (name == "entry_budget")
+		{
+			scan_options_.entry_budget = std::stoull(value);
+		}
+		else if (name == "time_budget")
+		{
+			scan_options_.time_budget_ms = static_cast<std::uint32_t>(std::stoul(value));
+		}
+		else if (name == "progress")
+		{
+			scan_options_.progress_interval_ms = static_cast<std::uint32_t>(std::stoul(value));
+		}
+		else
+		{
+			std::cout << "Unknown option!" << std::endl;
+			return;
+		}
+	}
+	catch (const std::exception&)
+	{
+		std::cout << "Invalid value!" << std::endl;
+		return;
+	}
+
+	PrintOptions();
+}
+
+void app::App::PrintOptions()
+{
+	std::cout << "threads         " << scan_options_.thread_num << " (0 = one per hardware thread)" << std::endl;
+	std::cout << "async_stat      " << (scan_options_.read.async_stat ? "on" : "off") << std::endl;
+	std::cout << "io_depth        " << scan_options_.read.io_depth << std::endl;
+	std::cout << "size            " << (size_kind_ == fs_tree::size_kind::allocated ? "allocated" : "apparent") << " (size 'ls' sorts and filters by)" << std::endl;
+	std::cout << "one_filesystem  " << (scan_options_.one_filesystem ? "on" : "off") << " (don't cross into other mounted filesystems)" << std::endl;
+	std::cout << "follow_symlinks " << (scan_options_.read.follow_symlinks ? "on" : "off") << std::endl;
+	std::cout << "exclude         ";
+	for (const auto& rule : exclude_rules_)
+	{
+		std::cout << rule << " ";
+	}
+	std::cout << "(names or globs like *.tmp, re:<regex> for regular expressions, 'off' clears)" << std::endl;
+	std::cout << "largest_first   " << (scan_options_.largest_first ? "on" : "off") << " (load the biggest folders first)" << std::endl;
+	std::cout << "entry_budget    " << scan_options_.entry_budget << " (files and folders, 0 = no limit)" << std::endl;
+	std::cout << "time_budget     " << scan_options_.time_budget_ms << " (milliseconds, 0 = no limit)" << std::endl;
+	std::cout << "progress        " << scan_options_.progress_interval_ms << " (milliseconds between progress lines while scanning, 0 = none)" << std::endl;
+}
+
 std::vector<std::string> app::App::ParseCommand(const std::string& command)
 {
 	std::vector<std::string> return_value;
@@ -217,40 +1033,102 @@ void app::App::RunCommand(const std::string& command, const std::vector<std::str
 	{
 		return;
 	}
-	search->second.first(args);
+
+	// Reading a corrupt snapshot throws as soon as a bad entry is used.
+	try
+	{
+		search->second.first(args);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << e.what() << std::endl;
+	}
 }
 
 app::App::App()
 {
 }
 
-app::App::App(wchar_t* path)
+app::App::App(const std::filesystem::path& path)
 {
-	current_path_ = std::filesystem::path(path);
+	current_path_ = path;
 	std::cout << "current_path_: " << current_path_ << std::endl;
 }
 
 app::App::~App()
 {
+	StopUpdates();
+}
+
+void app::App::StopUpdates()
+{
+	watcher_.reset();
+	if (scanner_) scanner_->Cancel();
+}
+
+void app::App::StartScan(const fs_tree::FilesystemTree* previous_tree)
+{
+	const auto thread_num = scan_options_.thread_num == 0 ? std::max(std::thread::hardware_concurrency(), 1u) : scan_options_.thread_num;
+	if (!pool_ || pool_->ThreadNum() != thread_num)
+	{
+		scanner_.reset();
+		pool_ = std::make_unique<anal::ScanPool>(thread_num);
+		scanner_ = std::make_unique<anal::Scanner>(*pool_);
+	}
+	scanner_->Start(filesystem_tree_.get(), scan_options_, previous_tree);
+	scanner_types_ = true;
+}
+
+std::filesystem::path app::App::ScanPath(const std::string& path) const
+{
+	// Relative to the root, so it also works when the scan was started with a relative path.
+	if (current_folder_) return *current_folder_ / path;
+	return std::filesystem::absolute(current_path_) / path;
+}
+
+std::optional<fs_tree::FolderId> app::App::CurrentFolder() const
+{
+	if (!current_folder_)
+	{
+		std::cout << "The current folder isn't part of the scan! Use 'cd' to go back to it." << std::endl;
+		return std::nullopt;
+	}
+
+	const auto folder = filesystem_tree_->GetFolder(*current_folder_);
+	if (!folder) std::cout << "The current folder no longer exists in the scan!" << std::endl;
+	return folder;
+}
+
+void app::App::UpdateCurrentFolder()
+{
+	current_folder_.reset();
+	if (!filesystem_tree_) return;
+
+	std::error_code ec;
+	const auto path = std::filesystem::absolute(current_path_, ec);
+	if (ec) return;
+	if (const auto folder = filesystem_tree_->GetFolder(path))
+	{
+		current_folder_ = filesystem_tree_->FolderPath(*folder).lexically_relative(filesystem_tree_->GetRootPath());
+	}
+}
+
+bool app::App::ScanFinished() const
+{
+	return !scanner_ || scanner_->Finished();
 }
 
 void app::App::Run()
 {	
 	std::cout << "Welcome to FolderScanner!" << std::endl;
 	std::cout << "Type 'help' and than press 'enter' to see a list of all available commands with their descriptions." << std::endl;
+	// Commands are accepted while a scan runs, 'ls' then shows what has been loaded so far.
 	while (!app_finished_)
 	{
-		if (anal::ProcessingFinished())
-		{
-			if (const auto o = GetCommandAndArgs())
-			{
-				const auto [command, args] = o.value();
-				RunCommand(command, args);
-			}
-		}
-		else
+		if (const auto o = GetCommandAndArgs())
 		{
-			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			const auto [command, args] = o.value();
+			RunCommand(command, args);
 		}
 	}
 }
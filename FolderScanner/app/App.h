@@ -11,6 +11,8 @@
 #include <vector>
 #include <filesystem>
 #include <memory>
+#include "../analyzer/Analyzer.h"
+#include "../analyzer/TreeWatcher.h"
 #include "../fs_tree/FilesystemTree.h"
 
 
@@ -25,21 +27,25 @@ namespace app
 			{ 
 				"cls", 
 				{
-					[this](const std::vector<std::string>& args) { system("cls"); },
+#if defined(_WIN32)
+					[](const std::vector<std::string>&) { system("cls"); },
+#else
+					[](const std::vector<std::string>&) { system("clear"); },
+#endif
 					" |Cleans screen.                                         | 0 arguments"
 				}
 			},
 			{ 
 				"exit", 
 				{
-					[this](const std::vector<std::string>& args) { Exit(); },        
+					[this](const std::vector<std::string>&) { Exit(); },        
 					"|Exits the application.                                 | 0 arguments"
 				}
 			},
 			{ 
 				"help", 
 				{
-					[this](const std::vector<std::string>& args) { Help(); },        
+					[this](const std::vector<std::string>&) { Help(); },        
 					"|Prints all available commands with their descriptions. | 0 arguments"
 				}
 			},
@@ -51,19 +57,32 @@ namespace app
 					"        |                                                       | if no arguments are passed - scans the current folder"
 				}
 			},
+			{
+				"rescan",
+				{
+					[this](const std::vector<std::string>& args) { Rescan(args); },
+					"|Scans the last scanned or loaded folder again, only    | 0 arguments\n"
+					"        |reading the folders that changed since then. Files     |\n"
+					"        |written in place don't change their folder, they keep  |\n"
+					"        |their old size and times until it changes (or 'scan'). |"
+				}
+			},
 			{
 				"ls",
 				{
 					[this](const std::vector<std::string>& args) { Ls(args); },
-					"  |Prints the results of the scan.                        | argument 1: minimum size in bytes of displayed file\\folder\n"
-					"        |                                                       | argument 2: maximum size in bytes of displayed file\\folder"
+					"  |Prints the results of the scan.                        | argument 1: number of the biggest folders and files to display\n"
+					"        |                                                       | argument 2: minimum size to display (e.g. 100K, 20M, 1G)\n"
+					"        |                                                       | argument 3: folder or file of the scan to display instead of the current one\n"
+					"        |                                                       | if no arguments are passed - displays all of them"
 				}			
 			},
 			{
 				"cd",
 				{
 					[this](const std::vector<std::string>& args) { Cd(args); },
-					"  |Changes the current directory.                         | argument 1: path to a folder (don't use \"\")"
+					"  |Changes the current directory, inside the scan also    | argument 1: path to a folder (don't use \"\")\n"
+					"        |the folder 'ls' displays.                              |"
 				}
 			},
 			{
@@ -72,6 +91,84 @@ namespace app
 					[this](const std::vector<std::string>& args) { Rmdir(args); },
 					"|Removes the specified folder.                          | argument 1: path to a folder (don't use \"\")"
 				}
+			},
+			{
+				"watch",
+				{
+					[this](const std::vector<std::string>& args) { Watch(args); },
+					"|Keeps the results of the scan up to date with changes. | argument 1: 'off' stops watching\n"
+					"        |                                                       | if no arguments are passed - starts watching"
+				}
+			},
+			{
+				"set",
+				{
+					[this](const std::vector<std::string>& args) { Set(args); },
+					" |Changes a scan option, no arguments lists them all.    | argument 1: option name\n"
+					"        |                                                       | argument 2: new value"
+				}
+			},
+			{
+				"save",
+				{
+					[this](const std::vector<std::string>& args) { Save(args); },
+					" |Saves the results of the scan to a snapshot file.      | argument 1: path to the snapshot file"
+				}
+			},
+			{
+				"load",
+				{
+					[this](const std::vector<std::string>& args) { Load(args); },
+					" |Opens a snapshot saved with 'save' instead of scanning.| argument 1: path to the snapshot file"
+				}
+			},
+			{
+				"stats",
+				{
+					[this](const std::vector<std::string>& args) { Stats(args); },
+					"|Prints where the time of the last scan went.           | 0 arguments"
+				}
+			},
+			{
+				"dupes",
+				{
+					[this](const std::vector<std::string>& args) { Dupes(args); },
+					"|Finds duplicate files below the current folder.        | argument 1: number of the biggest groups to display (default 10)\n"
+					"        |                                                       | argument 2: minimum file size (e.g. 100K, 20M, 1G)"
+				}
+			},
+			{
+				"types",
+				{
+					[this](const std::vector<std::string>& args) { Types(args); },
+					"|Prints sizes by file type and extension.               | argument 1: number of the biggest extensions to display (default 20)\n"
+					"        |                                                       | argument 2: folder of the scan to use instead of the current one"
+				}
+			},
+			{
+				"age",
+				{
+					[this](const std::vector<std::string>& args) { Age(args); },
+					"  |Prints sizes by the time files were last used and by   | argument 1: folder of the scan to use instead of the current one\n"
+					"        |file size.                                             |"
+				}
+			},
+			{
+				"find",
+				{
+					[this](const std::vector<std::string>& args) { Find(args); },
+					"|Lists the files and folders below the current folder   | argument 1: number of the biggest matches to display (default 100, optional)\n"
+					"        |that match an expression, e.g.                         | rest: the expression, see README\n"
+					"        |size > 1G and mtime > 6m and name *.tmp                |"
+				}
+			},
+			{
+				"bench",
+				{
+					[this](const std::vector<std::string>& args) { Bench(args); },
+					"|Measures loader scaling on a synthetic tree.           | argument 1: folder for the synthetic tree (created if missing)\n"
+					"        |                                                       | argument 2: maximum number of loader threads"
+				}
 			}
 		};
 
@@ -79,7 +176,26 @@ namespace app
 
 		std::unique_ptr<fs_tree::FilesystemTree> filesystem_tree_;
 
-		fs_tree::Folder* current_root = nullptr;
+		// The tree a running rescan copies unchanged folders from.
+		std::unique_ptr<fs_tree::FilesystemTree> previous_tree_;
+
+		// Declared after the trees, they have to stop before the tree they update is destroyed. The pool is only
+		// recreated when the number of threads changes, the scanner lives as long as its pool.
+		std::unique_ptr<anal::TreeWatcher> watcher_;
+		std::unique_ptr<anal::ScanPool> pool_;
+		std::unique_ptr<anal::Scanner> scanner_;
+		// True while the scanner's type tables still describe filesystem_tree_: it was scanned and not loaded or
+		// changed by the watcher since.
+		bool scanner_types_ = false;
+
+		anal::scan_options scan_options_;
+		fs_tree::size_kind size_kind_ = fs_tree::size_kind::apparent;
+		// The rules behind scan_options_.read.exclude, for printing.
+		std::vector<std::string> exclude_rules_;
+
+		// The folder 'ls' and the other commands work in, relative to the root of the scan. It's looked up again by
+		// every command since the watcher moves folders it reads again to new ids. Nothing after 'cd' left the scan.
+		std::optional<std::filesystem::path> current_folder_;
 
 		std::filesystem::path current_path_;
 
@@ -90,12 +206,39 @@ namespace app
 		void Help();
 		void Exit();
 		void Scan(const std::vector<std::string>& args);
+		void Rescan(const std::vector<std::string>& args);
 		void Ls(const std::vector<std::string>& args);
 		void Cd(const std::vector<std::string>& args);
 		void Rmdir(const std::vector<std::string>& args);
+		void Save(const std::vector<std::string>& args);
+		void Load(const std::vector<std::string>& args);
+		void Bench(const std::vector<std::string>& args);
+		void Stats(const std::vector<std::string>& args);
+		void Dupes(const std::vector<std::string>& args);
+		void Types(const std::vector<std::string>& args);
+		void Age(const std::vector<std::string>& args);
+		void Find(const std::vector<std::string>& args);
+		// Parses sizes like 512, 100K, 20M or 1G, throws std::invalid_argument or std::out_of_range.
+		static std::uintmax_t ParseSize(const std::string& size);
+		void Watch(const std::vector<std::string>& args);
+		void Set(const std::vector<std::string>& args);
+		void PrintOptions();
+
+		// Stops the watcher and any running scan, so the trees can be replaced.
+		void StopUpdates();
+		// Starts scanning filesystem_tree_ on a pool with scan_options_.thread_num threads.
+		void StartScan(const fs_tree::FilesystemTree* previous_tree);
+		// True unless a scan is running, a loaded snapshot counts as finished.
+		bool ScanFinished() const;
+		// 'path' relative to the folder 'ls' displays, as a path for FilesystemTree::GetFolder and GetFile.
+		std::filesystem::path ScanPath(const std::string& path) const;
+		// The id of current_folder_, or nothing after printing why if it's outside the scan or was deleted.
+		std::optional<fs_tree::FolderId> CurrentFolder() const;
+		// Points current_folder_ at current_path_ after 'cd' moved it without the scan.
+		void UpdateCurrentFolder();
 	public:
 		App();
-		App(wchar_t* path);
+		App(const std::filesystem::path& path);
 		~App();
 		void Run();
 	};
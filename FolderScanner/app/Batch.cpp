@@ -0,0 +1,590 @@
+#include "Batch.h"
+#include "../bench/Benchmark.h"
+#include "../fs_tree/NameMatcher.h"
+#include "../fs_tree/Snapshot.h"
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+namespace app
+{
+	namespace
+	{
+		using native_string = std::filesystem::path::string_type;
+
+		struct entry_record
+		{
+			bool file;
+			std::uint32_t depth;
+			fs_tree::subtree_progress totals;
+		};
+
+		// Entries picked for --top, only their ids are kept until the end.
+		struct candidate
+		{
+			std::uintmax_t size;
+			std::uint32_t id;
+			std::uint32_t depth;
+			bool file;
+		};
+
+		// Orders biggest first, ties by id so the output doesn't depend on the heap.
+		bool Bigger(const candidate& a, const candidate& b)
+		{
+			return a.size != b.size ? a.size > b.size : (a.file != b.file ? !a.file : a.id < b.id);
+		}
+
+#if !defined(_WIN32)
+		// Length of the well-formed UTF-8 sequence at the start of 'text', 0 if there is none (stray continuation
+		// bytes, truncated, overlong or surrogate encodings, code points above U+10FFFF).
+		std::size_t Utf8SequenceLength(std::string_view text)
+		{
+			const auto byte = [&](std::size_t i) { return i < text.size() ? static_cast<unsigned char>(text[i]) : 0; };
+			const auto lead = byte(0);
+			if (lead < 0x80) return 1;
+
+			std::size_t length = 0;
+			unsigned char low = 0x80;
+			unsigned char high = 0xBF;
+			if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+			else if (lead >= 0xE0 && lead <= 0xEF)
+			{
+				length = 3;
+				if (lead == 0xE0) low = 0xA0;
+				else if (lead == 0xED) high = 0x9F;
+			}
+			else if (lead >= 0xF0 && lead <= 0xF4)
+			{
+				length = 4;
+				if (lead == 0xF0) low = 0x90;
+				else if (lead == 0xF4) high = 0x8F;
+			}
+			else return 0;
+
+			// Only the second byte has a narrower range.
+			if (byte(1) < low || byte(1) > high) return 0;
+			for (std::size_t i = 2; i < length; i++)
+			{
+				if (byte(i) < 0x80 || byte(i) > 0xBF) return 0;
+			}
+			return length;
+		}
+#endif
+
+		// Paths are written as UTF-8. On Linux names are bytes in no particular encoding, every byte that isn't part
+		// of a well-formed UTF-8 sequence is written as U+FFFD, so the output stays valid JSON and CSV text.
+		std::string_view Utf8(const native_string& path, std::string& buffer)
+		{
+#if defined(_WIN32)
+			const auto utf8 = std::filesystem::path(path).u8string();
+			buffer.assign(utf8.begin(), utf8.end());
+			return buffer;
+#else
+			const std::string_view text = path;
+			std::size_t valid = 0;
+			while (valid < text.size())
+			{
+				const auto length = Utf8SequenceLength(text.substr(valid));
+				if (length == 0) break;
+				valid += length;
+			}
+			if (valid == text.size()) return text;
+
+			buffer.assign(text.substr(0, valid));
+			for (auto i = valid; i < text.size();)
+			{
+				const auto length = Utf8SequenceLength(text.substr(i));
+				if (length == 0)
+				{
+					buffer += "\xEF\xBF\xBD";
+					i++;
+					continue;
+				}
+				buffer += text.substr(i, length);
+				i += length;
+			}
+			return buffer;
+#endif
+		}
+
+		void AppendName(native_string& path, fs_tree::native_string_view name)
+		{
+			if (!path.empty() && path.back() != std::filesystem::path::preferred_separator)
+			{
+				path += std::filesystem::path::preferred_separator;
+			}
+			path += name;
+		}
+
+		// Writes one record per entry as soon as it gets it. JSON is a single array, JSON lines one object per line
+		// and CSV has a header row, in all of them files have no entry count and no complete flag.
+		class RecordWriter
+		{
+		private:
+			std::ostream& out_;
+			output_format format_;
+			bool first_ = true;
+			std::string buffer_;
+
+			void WriteJsonString(std::string_view text)
+			{
+				constexpr std::string_view hex = "0123456789abcdef";
+				out_ << '"';
+				for (const auto c : text)
+				{
+					const auto byte = static_cast<unsigned char>(c);
+					if (c == '"' || c == '\\') out_ << '\\' << c;
+					else if (byte < 0x20) out_ << "\\u00" << hex[byte >> 4] << hex[byte & 0xF];
+					else out_ << c;
+				}
+				out_ << '"';
+			}
+
+			void WriteCsvString(std::string_view text)
+			{
+				if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+				{
+					out_ << text;
+					return;
+				}
+
+				out_ << '"';
+				for (const auto c : text)
+				{
+					if (c == '"') out_ << '"';
+					out_ << c;
+				}
+				out_ << '"';
+			}
+
+		public:
+			RecordWriter(std::ostream& out, output_format format) : out_(out), format_(format)
+			{
+				if (format_ == output_format::json) out_ << "[\n";
+				else if (format_ == output_format::csv) out_ << "path,type,depth,size,allocated,unique_size,entries,complete\n";
+			}
+
+			void Write(const native_string& path, const entry_record& record)
+			{
+				const auto text = Utf8(path, buffer_);
+				const auto& totals = record.totals;
+
+				if (format_ == output_format::csv)
+				{
+					WriteCsvString(text);
+					out_ << (record.file ? ",file," : ",folder,") << record.depth << ',' << totals.size << ',' << totals.allocated << ',' << totals.unique_size << ',';
+					if (!record.file) out_ << totals.entries << ',' << (totals.complete ? "true" : "false");
+					else out_ << ',';
+					out_ << '\n';
+					return;
+				}
+
+				if (format_ == output_format::json && !first_) out_ << ",\n";
+				first_ = false;
+
+				out_ << "{\"path\":";
+				WriteJsonString(text);
+				out_ << ",\"type\":" << (record.file ? "\"file\"" : "\"folder\"") << ",\"depth\":" << record.depth << ",\"size\":" << totals.size << ",\"allocated\":" << totals.allocated << ",\"unique_size\":" << totals.unique_size;
+				if (!record.file) out_ << ",\"entries\":" << totals.entries << ",\"complete\":" << (totals.complete ? "true" : "false");
+				out_ << '}';
+				if (format_ == output_format::jsonl) out_ << '\n';
+			}
+
+			void Finish()
+			{
+				if (format_ == output_format::json) out_ << (first_ ? "]\n" : "\n]\n");
+				out_.flush();
+			}
+		};
+
+		entry_record FolderRecord(const fs_tree::FilesystemTree& tree, fs_tree::FolderId folder, std::uint32_t depth)
+		{
+			// Free for complete folders, after a budget stopped scan it counts what was loaded below the others.
+			return { false, depth, tree.FolderProgress(folder) };
+		}
+
+		entry_record FileRecord(const fs_tree::FilesystemTree& tree, fs_tree::FileId file, std::uint32_t depth)
+		{
+			entry_record record{ true, depth, {} };
+			record.totals.size = tree.FileSize(file);
+			record.totals.unique_size = tree.FileUniqueSize(file);
+			record.totals.allocated = tree.FileAllocated(file);
+			record.totals.entries = 1;
+			record.totals.complete = true;
+			return record;
+		}
+
+		// Visits every folder (and file) up to 'max_depth' depth first, parents before their children, with the
+		// path of the entry in a buffer that's only appended to and cut back. The stack holds one frame per level.
+		template<typename Visitor>
+		void Walk(const fs_tree::FilesystemTree& tree, std::uint32_t max_depth, bool files, Visitor&& visit)
+		{
+			struct frame
+			{
+				fs_tree::FolderId folder;
+				std::uint32_t next;
+				std::uint32_t depth;
+				std::size_t path_length;
+			};
+
+			native_string path = tree.GetRootPath().native();
+			std::vector<frame> stack;
+
+			const auto enter = [&](fs_tree::FolderId folder, std::uint32_t depth)
+			{
+				visit(path, false, folder, depth);
+				if (depth >= max_depth) return;
+
+				const auto path_length = path.size();
+				if (files)
+				{
+					for (const auto file : tree.Files(folder))
+					{
+						AppendName(path, tree.FileName(file));
+						visit(path, true, file, depth + 1);
+						path.resize(path_length);
+					}
+				}
+				stack.push_back({ folder, 0, depth, path_length });
+			};
+
+			enter(tree.GetRoot(), 0);
+			while (!stack.empty())
+			{
+				auto& top = stack.back();
+				const auto subfolders = tree.SubFolders(top.folder);
+				if (top.next == subfolders.size())
+				{
+					stack.pop_back();
+					continue;
+				}
+
+				const auto subfolder = subfolders[top.next++];
+				const auto depth = top.depth + 1;
+				path.resize(top.path_length);
+				AppendName(path, tree.FolderName(subfolder));
+				// 'top' may be invalidated from here on.
+				enter(subfolder, depth);
+			}
+		}
+
+		std::uint64_t ParseNumber(const std::string& option, const std::string& value)
+		{
+			try
+			{
+				// std::stoull skips whitespace and takes "-1" as the biggest number, so only digits are accepted.
+				std::size_t end = 0;
+				const auto number = value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])) ? 0 : std::stoull(value, &end);
+				if (end != 0 && end == value.size()) return number;
+			}
+			catch (const std::exception&)
+			{
+			}
+			throw std::runtime_error("Invalid value for " + option + ": " + value);
+		}
+	}
+
+	batch_options ParseBatchArguments(const std::vector<std::string>& args)
+	{
+		if (args.empty() || (args[0] != "scan" && args[0] != "load"))
+		{
+			throw std::runtime_error("Expected 'scan', 'load' or 'bench' as the first argument.");
+		}
+
+		batch_options options;
+		options.load = args[0] == "load";
+		std::vector<std::string> exclude_rules;
+
+		for (std::size_t i = 1; i < args.size(); i++)
+		{
+			const auto& arg = args[i];
+			const auto value = [&]() -> const std::string&
+			{
+				if (i + 1 >= args.size()) throw std::runtime_error("Missing value for " + arg);
+				return args[++i];
+			};
+
+			if (!arg.starts_with("--"))
+			{
+				if (!options.path.empty()) throw std::runtime_error("Unexpected argument: " + arg);
+				options.path = arg;
+			}
+			else if (arg == "--top") options.top = ParseNumber(arg, value());
+			else if (arg == "--depth") options.max_depth = static_cast<std::uint32_t>(std::min<std::uint64_t>(ParseNumber(arg, value()), options.max_depth));
+			else if (arg == "--files") options.files = true;
+			else if (arg == "--format")
+			{
+				const auto& format = value();
+				if (format == "json") options.format = output_format::json;
+				else if (format == "jsonl") options.format = output_format::jsonl;
+				else if (format == "csv") options.format = output_format::csv;
+				else throw std::runtime_error("Invalid value for --format: " + format);
+			}
+			else if (arg == "--size")
+			{
+				const auto& kind = value();
+				if (kind != "apparent" && kind != "allocated") throw std::runtime_error("Invalid value for --size: " + kind);
+				options.size_kind = kind == "allocated" ? fs_tree::size_kind::allocated : fs_tree::size_kind::apparent;
+			}
+			else if (arg == "--threads") options.scan.thread_num = static_cast<std::uint32_t>(ParseNumber(arg, value()));
+			else if (arg == "--async-stat") options.scan.read.async_stat = true;
+			else if (arg == "--io-depth") options.scan.read.io_depth = std::max(static_cast<std::uint32_t>(ParseNumber(arg, value())), 1u);
+			else if (arg == "--one-filesystem") options.scan.one_filesystem = true;
+			else if (arg == "--follow-symlinks") options.scan.read.follow_symlinks = true;
+			else if (arg == "--exclude") exclude_rules.push_back(value());
+			else if (arg == "--largest-first") options.scan.largest_first = true;
+			else if (arg == "--entry-budget") options.scan.entry_budget = ParseNumber(arg, value());
+			else if (arg == "--time-budget") options.scan.time_budget_ms = static_cast<std::uint32_t>(ParseNumber(arg, value()));
+			else if (arg == "--verbose") options.verbose = true;
+			else if (arg == "--progress") options.scan.progress_interval_ms = static_cast<std::uint32_t>(ParseNumber(arg, value()));
+			else if (arg == "--stats") options.stats = true;
+			else throw std::runtime_error("Unknown option: " + arg);
+		}
+
+		if (options.path.empty())
+		{
+			if (options.load) throw std::runtime_error("No snapshot file provided!");
+			options.path = std::filesystem::current_path();
+		}
+
+		if (!exclude_rules.empty())
+		{
+			auto matcher = std::make_shared<fs_tree::NameMatcher>();
+			for (const auto& rule : exclude_rules)
+			{
+				try
+				{
+					matcher->Add(rule);
+				}
+				catch (const std::exception&)
+				{
+					throw std::runtime_error("Invalid value for --exclude: " + rule);
+				}
+			}
+			options.scan.read.exclude = std::move(matcher);
+		}
+
+		options.scan.log = options.verbose || options.scan.progress_interval_ms > 0 ? &std::cerr : nullptr;
+		return options;
+	}
+
+	void WriteEntries(const fs_tree::FilesystemTree& tree, const batch_options& options, std::ostream& out)
+	{
+		RecordWriter writer(out, options.format);
+
+		if (options.top == 0)
+		{
+			Walk(tree, options.max_depth, options.files, [&](const native_string& path, bool file, std::uint32_t id, std::uint32_t depth)
+			{
+				writer.Write(path, file ? FileRecord(tree, id, depth) : FolderRecord(tree, id, depth));
+			});
+			writer.Finish();
+			return;
+		}
+
+		// A heap of the 'top' biggest entries seen so far with the smallest of them on top.
+		std::vector<candidate> heap;
+		const auto kind = options.size_kind;
+		Walk(tree, options.max_depth, options.files, [&](const native_string&, bool file, std::uint32_t id, std::uint32_t depth)
+		{
+			std::uintmax_t size = 0;
+			if (file)
+			{
+				size = tree.FileSize(id, kind);
+			}
+			else
+			{
+				const auto progress = tree.FolderProgress(id);
+				size = kind == fs_tree::size_kind::allocated ? progress.allocated : progress.size;
+			}
+
+			const candidate entry{ size, id, depth, file };
+			if (heap.size() < options.top)
+			{
+				heap.push_back(entry);
+				std::push_heap(heap.begin(), heap.end(), Bigger);
+			}
+			else if (Bigger(entry, heap.front()))
+			{
+				std::pop_heap(heap.begin(), heap.end(), Bigger);
+				heap.back() = entry;
+				std::push_heap(heap.begin(), heap.end(), Bigger);
+			}
+		});
+
+		std::sort_heap(heap.begin(), heap.end(), Bigger);
+		for (const auto& entry : heap)
+		{
+			const auto path = entry.file ? tree.FilePath(entry.id) : tree.FolderPath(entry.id);
+			writer.Write(path.native(), entry.file ? FileRecord(tree, entry.id, entry.depth) : FolderRecord(tree, entry.id, entry.depth));
+		}
+		writer.Finish();
+	}
+
+	bench::suite_options ParseBenchmarkArguments(const std::vector<std::string>& args)
+	{
+		bench::suite_options options;
+		for (std::size_t i = 1; i < args.size(); i++)
+		{
+			const auto& arg = args[i];
+			const auto value = [&]() -> const std::string&
+			{
+				if (i + 1 >= args.size()) throw std::runtime_error("Missing value for " + arg);
+				return args[++i];
+			};
+
+			if (!arg.starts_with("--"))
+			{
+				if (!options.root.empty()) throw std::runtime_error("Unexpected argument: " + arg);
+				options.root = arg;
+			}
+			else if (arg == "--shape")
+			{
+				const auto& shape = value();
+				bench::ShapePreset(shape);
+				options.shapes.push_back(shape);
+			}
+			else if (arg == "--threads")
+			{
+				std::stringstream list(value());
+				for (std::string thread_num; std::getline(list, thread_num, ',');)
+				{
+					options.thread_nums.push_back(std::max(static_cast<std::uint32_t>(ParseNumber(arg, thread_num)), 1u));
+				}
+			}
+			else if (arg == "--runs") options.runs = static_cast<std::uint32_t>(ParseNumber(arg, value()));
+			else if (arg == "--csv") options.csv = value();
+			else if (arg == "--async-stat") options.scan.read.async_stat = true;
+			else if (arg == "--io-depth") options.scan.read.io_depth = std::max(static_cast<std::uint32_t>(ParseNumber(arg, value())), 1u);
+			else if (arg == "--largest-first") options.scan.largest_first = true;
+			else throw std::runtime_error("Unknown option: " + arg);
+		}
+		return options;
+	}
+
+	void PrintBatchUsage(std::ostream& out)
+	{
+		out << "Usage: FolderScanner scan [folder] [options]\n"
+			"       FolderScanner load <snapshot> [options]\n"
+			"       FolderScanner bench [folder] [benchmark options]\n"
+			"Without arguments FolderScanner starts the interactive prompt.\n"
+			"\n"
+			"Output:\n"
+			"  --top N               only the N biggest entries, biggest first (default: all, in tree order)\n"
+			"  --depth D             entries at most D levels below the root (the root is level 0)\n"
+			"  --files               files as well as folders\n"
+			"  --format F            json (default), jsonl or csv\n"
+			"  --size S              apparent (default) or allocated, the size --top picks by\n"
+			"  --verbose             read errors and the scan summary on stderr\n"
+			"  --progress MS         a progress line on stderr every MS milliseconds while scanning\n"
+			"  --stats               where the time of the scan went, on stderr\n"
+			"Scan:\n"
+			"  --threads N           loader threads (default: one per hardware thread)\n"
+			"  --async-stat          batch the size lookups where the listing doesn't have them\n"
+			"  --io-depth N          size lookups in flight per loader with --async-stat\n"
+			"  --one-filesystem      list mount points below the folder as empty\n"
+			"  --follow-symlinks     descend into symlinked folders and count symlinked files\n"
+			"  --exclude RULE        skip names matching RULE (glob, or re:<regex>), repeatable\n"
+			"  --largest-first       load the folders estimated to be the biggest first\n"
+			"  --entry-budget N      stop after N files and folders\n"
+			"  --time-budget MS      stop after MS milliseconds\n"
+			"Benchmark:\n"
+			"  folder                where the synthetic trees are generated (default: /dev/shm or the temp folder)\n"
+			"  --shape S             deep, wide, tiny, mixed or hardlinks, repeatable (default: all of them)\n"
+			"  --threads N,N,...     loader thread counts (default: 1, 2, 4, ... hardware threads)\n"
+			"  --runs N              measured runs per configuration (default: 5)\n"
+			"  --csv FILE            also write the results to FILE\n"
+			"  --async-stat, --io-depth N, --largest-first as for scan\n"
+			"\n"
+			"Exit codes: 0 success, 1 error, 2 invalid arguments, 3 the scan hit its budget and the results are partial.\n";
+	}
+
+	int RunBatch(const std::vector<std::string>& args)
+	{
+		if (std::find(args.begin(), args.end(), "--help") != args.end() || std::find(args.begin(), args.end(), "-h") != args.end())
+		{
+			PrintBatchUsage(std::cout);
+			return 0;
+		}
+
+		if (!args.empty() && args[0] == "bench")
+		{
+			bench::suite_options suite;
+			try
+			{
+				suite = ParseBenchmarkArguments(args);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << e.what() << "\n";
+				PrintBatchUsage(std::cerr);
+				return 2;
+			}
+
+			try
+			{
+				bench::RunSuite(suite);
+				return 0;
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << e.what() << "\n";
+				return 1;
+			}
+		}
+
+		batch_options options;
+		try
+		{
+			options = ParseBatchArguments(args);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << "\n";
+			PrintBatchUsage(std::cerr);
+			return 2;
+		}
+
+		// Nothing else writes to the standard streams from here on.
+		std::ios::sync_with_stdio(false);
+
+		try
+		{
+			std::unique_ptr<fs_tree::FilesystemTree> tree;
+			bool partial = false;
+			if (options.load)
+			{
+				tree = std::make_unique<fs_tree::FilesystemTree>(std::make_unique<fs_tree::Snapshot>(options.path));
+			}
+			else
+			{
+				if (!std::filesystem::is_directory(options.path)) throw std::runtime_error("Not a folder: " + options.path.string());
+
+				tree = std::make_unique<fs_tree::FilesystemTree>(options.path);
+				anal::ScanPool pool(options.scan.thread_num);
+				anal::Scanner scanner(pool);
+				const auto stats = scanner.Start(tree.get(), options.scan).get();
+				partial = stats.budget_exceeded;
+				if (options.stats) anal::PrintScanStats(stats, std::cerr);
+			}
+
+			WriteEntries(*tree, options, std::cout);
+			if (!std::cout) throw std::runtime_error("Failed to write the output.");
+
+			if (partial)
+			{
+				std::cerr << "Scan budget reached, the results are partial.\n";
+				return 3;
+			}
+			return 0;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+	}
+}
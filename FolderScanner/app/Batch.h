@@ -0,0 +1,64 @@
+#ifndef APP_BATCH_H
+#define APP_BATCH_H
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "../analyzer/Analyzer.h"
+#include "../bench/Benchmark.h"
+#include "../fs_tree/FilesystemTree.h"
+
+
+namespace app
+{
+	enum class output_format
+	{
+		json,
+		jsonl,
+		csv
+	};
+
+	struct batch_options
+	{
+		// "scan" reads the folder at 'path', "load" opens the snapshot at 'path'.
+		bool load = false;
+		std::filesystem::path path;
+
+		// Number of the biggest entries to print, biggest first. 0 prints every entry in tree order.
+		std::uint64_t top = 0;
+		// Deepest level printed, the root is level 0.
+		std::uint32_t max_depth = std::numeric_limits<std::uint32_t>::max();
+		bool files = false;
+		output_format format = output_format::json;
+		fs_tree::size_kind size_kind = fs_tree::size_kind::apparent;
+		bool verbose = false;
+		// Prints ScanStatistics to std::cerr after the scan.
+		bool stats = false;
+
+		anal::scan_options scan;
+	};
+
+	// Parses the command line of a one-shot run, 'args' without the program name. Throws std::runtime_error for
+	// unknown options and invalid values.
+	batch_options ParseBatchArguments(const std::vector<std::string>& args);
+
+	// Writes the folders (and files) of the tree to 'out' as they are visited. Printing everything walks the tree
+	// depth first with one path buffer, and the biggest 'top' entries are picked with a heap of that size, so
+	// memory doesn't grow with the size of the tree in either case. Paths are UTF-8, on Linux the bytes of names
+	// that aren't valid UTF-8 are replaced with U+FFFD (one per byte). Call after loading has finished.
+	void WriteEntries(const fs_tree::FilesystemTree& tree, const batch_options& options, std::ostream& out);
+
+	// Runs a scan or loads a snapshot and prints the results to std::cout, or runs the benchmark suite. Errors go
+	// to std::cerr. Returns the exit code of the process.
+	int RunBatch(const std::vector<std::string>& args);
+
+	// The command line of the benchmark suite, 'args' starting with "bench".
+	bench::suite_options ParseBenchmarkArguments(const std::vector<std::string>& args);
+
+	void PrintBatchUsage(std::ostream& out);
+}
+
+#endif // !APP_BATCH_H
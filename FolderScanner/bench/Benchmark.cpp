@@ -0,0 +1,445 @@
+#include "Benchmark.h"
+
+#include "Measure.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace bench
+{
+	namespace
+	{
+		struct scaling_result
+		{
+			std::uint32_t thread_num;
+			double load_ms;
+			double total_ms;
+			std::uint64_t accessed;
+		};
+
+		// Fixed seed LCG, std::rand and the <random> distributions are not guaranteed to be identical across
+		// standard libraries.
+		std::uint32_t NextRandom(std::uint64_t& state)
+		{
+			state = state * 6364136223846793005ull + 1442695040888963407ull;
+			return static_cast<std::uint32_t>(state >> 33);
+		}
+
+		// Files up to this size are written, bigger ones are sparse.
+		constexpr std::uint32_t max_written_size = 64 * 1024;
+
+		struct generator_state
+		{
+			std::uint64_t random = 0x5eed;
+			std::string content;
+			// The last file that was written, the target of the next hard link.
+			std::filesystem::path previous_file;
+		};
+
+		std::uint64_t FileSize(const synthetic_tree_shape& shape, std::uint64_t& random)
+		{
+			if (shape.max_file_size == 0) return 0;
+			if (!shape.mixed_sizes) return NextRandom(random) % (shape.max_file_size + 1);
+
+			// A uniformly chosen number of bits, then a uniform size below that power of two.
+			const auto bits = NextRandom(random) % (std::bit_width(shape.max_file_size) + 1);
+			const auto limit = std::min<std::uint64_t>(std::uint64_t(1) << bits, std::uint64_t(shape.max_file_size) + 1);
+			return NextRandom(random) % limit;
+		}
+
+		std::uint64_t GenerateFolder(const std::filesystem::path& path, const synthetic_tree_shape& shape, std::uint32_t level, generator_state& state)
+		{
+			std::filesystem::create_directories(path);
+			std::uint64_t created = 1;
+
+			for (std::uint32_t i = 0; i < shape.files_per_folder; i++)
+			{
+				const auto file_path = path / ("f" + std::to_string(i) + ".bin");
+				created++;
+
+				if (shape.hard_link_percent > 0 && NextRandom(state.random) % 100 < shape.hard_link_percent && !state.previous_file.empty())
+				{
+					std::filesystem::create_hard_link(state.previous_file, file_path);
+					continue;
+				}
+
+				const auto size = FileSize(shape, state.random);
+				if (size <= max_written_size)
+				{
+					std::ofstream file(file_path, std::ios::binary);
+					file.write(state.content.data(), static_cast<std::streamsize>(size));
+				}
+				else
+				{
+					std::ofstream(file_path, std::ios::binary).close();
+					std::filesystem::resize_file(file_path, size);
+				}
+				state.previous_file = file_path;
+			}
+
+			if (level >= shape.depth) return created;
+
+			for (std::uint32_t i = 0; i < shape.fan_out; i++)
+			{
+				created += GenerateFolder(path / ("d" + std::to_string(i)), shape, level + 1, state);
+			}
+			return created;
+		}
+
+		// Describes a shape completely, a tree generated for a different description is generated again.
+		std::string ShapeSignature(const synthetic_tree_shape& shape)
+		{
+			std::ostringstream signature;
+			signature << "depth=" << shape.depth << " fan_out=" << shape.fan_out << " files_per_folder=" << shape.files_per_folder
+				<< " max_file_size=" << shape.max_file_size << " mixed_sizes=" << shape.mixed_sizes << " hard_link_percent=" << shape.hard_link_percent;
+			return signature.str();
+		}
+
+		struct phase_result
+		{
+			std::uint64_t entries;
+			double load_ms;
+			double aggregate_ms;
+			double sort_ms;
+			double list_ms;
+			allocation_counts allocations;
+			std::uint64_t peak_rss;
+		};
+
+		struct suite_result
+		{
+			std::string shape;
+			std::uint32_t thread_num;
+			phase_result median;
+			// (slowest - fastest) / median load time, in percent.
+			double load_spread;
+		};
+
+		double Milliseconds(std::chrono::steady_clock::duration duration)
+		{
+			return std::chrono::duration<double, std::milli>(duration).count();
+		}
+
+		double Median(std::vector<double> values)
+		{
+			std::sort(values.begin(), values.end());
+			const auto middle = values.size() / 2;
+			return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+		}
+
+		// Generates the tree of 'shape' in 'path' unless the one there was generated for the same shape, which is
+		// recorded in a file next to it. The marker is written before generating, so only folders this function
+		// created are ever deleted; anything else already at 'path' throws std::runtime_error.
+		void PrepareTree(const std::filesystem::path& path, const std::string& name, const synthetic_tree_shape& shape)
+		{
+			constexpr std::string_view generating = "generating";
+			auto marker_path = path;
+			marker_path += ".shape";
+			const auto signature = ShapeSignature(shape);
+
+			std::string existing;
+			std::getline(std::ifstream(marker_path), existing);
+			if (existing == signature && std::filesystem::is_directory(path)) return;
+
+			// A different shape, or a generation that didn't finish.
+			const auto generated = existing == generating || existing.starts_with("depth=");
+			if (std::filesystem::exists(path) && !generated)
+			{
+				throw std::runtime_error(path.string() + " exists and wasn't generated by the benchmark, remove it or use another folder");
+			}
+
+			std::cout << "Generating '" << name << "' in " << path << std::endl;
+			std::ofstream(marker_path) << generating << "\n";
+			std::filesystem::remove_all(path);
+			const auto created = GenerateSyntheticTree(path, shape);
+			std::ofstream(marker_path) << signature << "\n";
+			std::cout << "Created " << created << " files and folders." << std::endl;
+		}
+
+		phase_result RunPhases(const std::filesystem::path& root, std::uint32_t thread_num, anal::scan_options options)
+		{
+			// The workers are started before measuring, like the shared pool of a long running process.
+			anal::ScanPool pool(thread_num);
+			anal::Scanner scanner(pool);
+
+			ResetPeakResident();
+			const auto allocations = Allocations();
+			auto tree = std::make_unique<fs_tree::FilesystemTree>(root);
+
+			options.thread_num = thread_num;
+			options.log = nullptr;
+			const auto start = std::chrono::steady_clock::now();
+			const auto scan = scanner.Start(tree.get(), options);
+			scanner.Wait();
+			const auto loaded = std::chrono::steady_clock::now();
+			const auto stats = scan.get();
+
+			const auto sort_start = std::chrono::steady_clock::now();
+			for (fs_tree::FolderId folder = 0; folder < tree->FolderNum(); folder++)
+			{
+				tree->SortedSubFolders(folder);
+				tree->SortedFiles(folder);
+			}
+			const auto sorted = std::chrono::steady_clock::now();
+
+			// Summed so the display info can't be optimized away.
+			double checksum = 0;
+			for (fs_tree::FolderId folder = 0; folder < tree->FolderNum(); folder++)
+			{
+				for (const auto subfolder : tree->SortedSubFolders(folder))
+				{
+					checksum += tree->FolderDisplayInfo(subfolder).size;
+				}
+				for (const auto file : tree->SortedFiles(folder))
+				{
+					checksum += tree->FileDisplayInfo(file).size;
+				}
+			}
+			const auto listed = std::chrono::steady_clock::now();
+			static volatile double sink = 0;
+			sink = sink + checksum;
+
+			return
+			{
+				stats.accessed,
+				Milliseconds(loaded - start),
+				static_cast<double>(stats.total.phase_ns[static_cast<std::size_t>(anal::scan_phase::aggregate)]) / 1e6,
+				Milliseconds(sorted - sort_start),
+				Milliseconds(listed - sorted),
+				Allocations() - allocations,
+				PeakResidentBytes()
+			};
+		}
+
+		suite_result RunShape(const std::string& shape, const std::filesystem::path& root, std::uint32_t thread_num, const suite_options& options)
+		{
+			// Warms up the page and dentry caches and the allocator.
+			RunPhases(root, thread_num, options.scan);
+
+			std::vector<phase_result> runs;
+			for (std::uint32_t i = 0; i < std::max(options.runs, 1u); i++)
+			{
+				runs.push_back(RunPhases(root, thread_num, options.scan));
+			}
+
+			const auto median = [&](double phase_result::* field)
+			{
+				std::vector<double> values;
+				for (const auto& run : runs) values.push_back(run.*field);
+				return Median(values);
+			};
+
+			suite_result result{ shape, thread_num, runs.back(), 0 };
+			result.median.load_ms = median(&phase_result::load_ms);
+			result.median.aggregate_ms = median(&phase_result::aggregate_ms);
+			result.median.sort_ms = median(&phase_result::sort_ms);
+			result.median.list_ms = median(&phase_result::list_ms);
+
+			const auto [fastest, slowest] = std::minmax_element(runs.begin(), runs.end(), [](const auto& a, const auto& b) { return a.load_ms < b.load_ms; });
+			result.load_spread = result.median.load_ms > 0 ? 100.0 * (slowest->load_ms - fastest->load_ms) / result.median.load_ms : 0;
+			return result;
+		}
+
+		void WriteSuiteCsv(const std::filesystem::path& path, const std::vector<suite_result>& results)
+		{
+			std::ofstream csv(path);
+			if (!csv) throw std::runtime_error("Can't write " + path.string());
+
+			csv << "shape,threads,entries,load_ms,load_spread_percent,entries_per_s,aggregate_ms,sort_ms,list_ms,allocations,allocated_bytes,peak_rss_bytes\n";
+			for (const auto& result : results)
+			{
+				const auto& median = result.median;
+				csv << result.shape << ',' << result.thread_num << ',' << median.entries << ',' << median.load_ms << ',' << result.load_spread << ','
+					<< median.entries / (median.load_ms / 1000.0) << ',' << median.aggregate_ms << ',' << median.sort_ms << ',' << median.list_ms << ','
+					<< median.allocations.count << ',' << median.allocations.bytes << ',' << median.peak_rss << '\n';
+			}
+		}
+
+		scaling_result RunOnce(const std::filesystem::path& root, std::uint32_t thread_num, anal::scan_options options)
+		{
+			anal::ScanPool pool(thread_num);
+			anal::Scanner scanner(pool);
+			auto tree = std::make_unique<fs_tree::FilesystemTree>(root);
+
+			const auto start = std::chrono::steady_clock::now();
+			options.thread_num = thread_num;
+			const auto scan = scanner.Start(tree.get(), options);
+			scanner.Wait();
+			const auto loaded = std::chrono::steady_clock::now();
+			// Ready once the summary has been reported.
+			const auto stats = scan.get();
+			const auto processed = std::chrono::steady_clock::now();
+
+			return
+			{
+				thread_num,
+				std::chrono::duration<double, std::milli>(loaded - start).count(),
+				std::chrono::duration<double, std::milli>(processed - start).count(),
+				stats.accessed
+			};
+		}
+	}
+
+	std::uint64_t GenerateSyntheticTree(const std::filesystem::path& root, const synthetic_tree_shape& shape)
+	{
+		generator_state state;
+		state.content.assign(std::min(shape.max_file_size, max_written_size), 'x');
+		return GenerateFolder(root, shape, 0, state);
+	}
+
+	synthetic_tree_shape ShapePreset(std::string_view name)
+	{
+		synthetic_tree_shape shape;
+		if (name == "deep")
+		{
+			shape = { 13, 2, 3, 4096 };
+		}
+		else if (name == "wide")
+		{
+			shape = { 1, 4096, 16, 4096 };
+		}
+		else if (name == "tiny")
+		{
+			shape = { 2, 32, 64, 64 };
+		}
+		else if (name == "mixed")
+		{
+			shape = { 4, 6, 40, 1u << 30 };
+			shape.mixed_sizes = true;
+		}
+		else if (name == "hardlinks")
+		{
+			shape = { 3, 8, 110, 4096 };
+			shape.hard_link_percent = 50;
+		}
+		else
+		{
+			throw std::runtime_error("Unknown shape: " + std::string(name));
+		}
+		return shape;
+	}
+
+	const std::vector<std::string>& ShapePresetNames()
+	{
+		static const std::vector<std::string> names = { "deep", "wide", "tiny", "mixed", "hardlinks" };
+		return names;
+	}
+
+	std::filesystem::path DefaultBenchmarkRoot()
+	{
+		std::error_code ec;
+		if (std::filesystem::is_directory("/dev/shm", ec)) return "/dev/shm/FolderScanner_bench";
+		return std::filesystem::temp_directory_path() / "FolderScanner_bench";
+	}
+
+	void RunLoaderScaling(const std::filesystem::path& root, std::uint32_t max_thread_num, const anal::scan_options& options, std::uint32_t runs)
+	{
+		std::vector<std::uint32_t> thread_nums;
+		for (std::uint32_t t = 1; t < max_thread_num; t *= 2)
+		{
+			thread_nums.push_back(t);
+		}
+		thread_nums.push_back(max_thread_num);
+
+		// Warm up the page and dentry caches so the first configuration is not penalized.
+		RunOnce(root, max_thread_num, options);
+
+		std::vector<scaling_result> results;
+		for (const auto thread_num : thread_nums)
+		{
+			scaling_result best{ thread_num, std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), 0 };
+			for (std::uint32_t i = 0; i < std::max(runs, 1u); i++)
+			{
+				const auto result = RunOnce(root, thread_num, options);
+				best.load_ms = std::min(best.load_ms, result.load_ms);
+				best.total_ms = std::min(best.total_ms, result.total_ms);
+				best.accessed = result.accessed;
+			}
+			results.push_back(best);
+		}
+
+		const auto flags = std::cout.flags();
+		const auto precision = std::cout.precision();
+
+		std::cout << "--------------------------------------\n";
+		std::cout << "threads |    load ms |   total ms |  entries/s | speedup\n";
+		for (const auto& result : results)
+		{
+			std::cout << std::setw(7) << result.thread_num << " | "
+				<< std::setw(10) << std::fixed << std::setprecision(2) << result.load_ms << " | "
+				<< std::setw(10) << result.total_ms << " | "
+				<< std::setw(10) << std::setprecision(0) << result.accessed / (result.load_ms / 1000.0) << " | "
+				<< std::setprecision(2) << results.front().load_ms / result.load_ms << "x\n";
+		}
+		std::cout << "--------------------------------------\n";
+
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+	}
+
+	void RunSuite(const suite_options& options)
+	{
+		const auto& shapes = options.shapes.empty() ? ShapePresetNames() : options.shapes;
+		auto thread_nums = options.thread_nums;
+		if (thread_nums.empty())
+		{
+			const auto max_thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+			for (std::uint32_t t = 1; t < max_thread_num; t *= 2)
+			{
+				thread_nums.push_back(t);
+			}
+			thread_nums.push_back(max_thread_num);
+		}
+
+		const auto root = options.root.empty() ? DefaultBenchmarkRoot() : options.root;
+		std::vector<suite_result> results;
+		for (const auto& shape : shapes)
+		{
+			const auto path = root / shape;
+			PrepareTree(path, shape, ShapePreset(shape));
+			for (const auto thread_num : thread_nums)
+			{
+				results.push_back(RunShape(shape, path, thread_num, options));
+			}
+		}
+
+		const auto flags = std::cout.flags();
+		const auto precision = std::cout.precision();
+
+		std::cout << "-------------------------------------------------------------------------------------------------------------------------\n";
+		std::cout << "shape     | threads |  entries |  load ms |  +/- % |  entries/s | aggr. ms |  sort ms |  list ms |     allocs | alloc MB | peak MB\n";
+		for (const auto& result : results)
+		{
+			const auto& median = result.median;
+			std::cout << std::left << std::setw(9) << result.shape << std::right << " | " << std::setw(7) << result.thread_num << " | " << std::setw(8) << median.entries << " | "
+				<< std::fixed << std::setprecision(2) << std::setw(8) << median.load_ms << " | " << std::setw(6) << std::setprecision(1) << result.load_spread << " | "
+				<< std::setw(10) << std::setprecision(0) << median.entries / (median.load_ms / 1000.0) << " | " << std::setprecision(2) << std::setw(8) << median.aggregate_ms << " | "
+				<< std::setw(8) << median.sort_ms << " | " << std::setw(8) << median.list_ms << " | " << std::setw(10) << median.allocations.count << " | "
+				<< std::setprecision(1) << std::setw(8) << static_cast<double>(median.allocations.bytes) / (1 << 20) << " | " << std::setw(7) << static_cast<double>(median.peak_rss) / (1 << 20) << "\n";
+		}
+		std::cout << "-------------------------------------------------------------------------------------------------------------------------\n";
+		std::cout << "Times are medians of " << std::max(options.runs, 1u) << " runs, aggregate time is summed over the loaders, allocations and peak RSS are from the last run.\n";
+		if (!allocations_counted) std::cout << "Allocations are only counted in builds with FOLDERSCANNER_COUNT_ALLOCATIONS defined.\n";
+
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+
+		if (!options.csv.empty())
+		{
+			WriteSuiteCsv(options.csv, results);
+			std::cout << "Results written to " << options.csv << std::endl;
+		}
+	}
+}
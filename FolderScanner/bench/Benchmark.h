@@ -0,0 +1,67 @@
+#ifndef BENCH_BENCHMARK_H
+#define BENCH_BENCHMARK_H
+
+#include "../analyzer/Analyzer.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bench
+{
+	struct synthetic_tree_shape
+	{
+		std::uint32_t depth = 4;
+		std::uint32_t fan_out = 8;
+		std::uint32_t files_per_folder = 16;
+		std::uint32_t max_file_size = 4096;
+		// Spreads sizes log-uniformly up to max_file_size instead of uniformly. Files above 64 KiB only get their
+		// length set (sparse), so big sizes cost no space.
+		bool mixed_sizes = false;
+		// Percentage of the files that are created as hard links to the previous file instead.
+		std::uint32_t hard_link_percent = 0;
+	};
+
+	// The shapes of the suite: "deep" (a binary tree 13 levels below its root, 16383 folders), "wide" (4096 folders
+	// in one), "tiny" (tiny files, 64 per folder), "mixed" (log-uniform sizes up to 1 GiB) and "hardlinks" (half of
+	// the files are links). Each has 60-70 thousand entries. Throws std::runtime_error for other names.
+	synthetic_tree_shape ShapePreset(std::string_view name);
+	const std::vector<std::string>& ShapePresetNames();
+
+	struct suite_options
+	{
+		// Trees are generated in root/<shape> and reused while their shape doesn't change. Put it on a tmpfs (the
+		// default is /dev/shm where it exists) or a loop mount, so the disk doesn't end up in the numbers.
+		std::filesystem::path root;
+		// Every preset if empty.
+		std::vector<std::string> shapes;
+		// 1, 2, 4, ... hardware threads if empty.
+		std::vector<std::uint32_t> thread_nums;
+		std::uint32_t runs = 5;
+		// Everything but thread_num and log is taken from here.
+		anal::scan_options scan;
+		// Also writes the results there as CSV when set.
+		std::filesystem::path csv;
+	};
+
+	std::filesystem::path DefaultBenchmarkRoot();
+
+	// Creates a deterministic tree under 'root' (every run with the same shape produces the same names and sizes).
+	// Returns the number of created files and folders.
+	std::uint64_t GenerateSyntheticTree(const std::filesystem::path& root, const synthetic_tree_shape& shape);
+
+	// Scans 'root' with 1, 2, 4, ... max_thread_num loaders and prints load and total times with the speedup
+	// relative to the single threaded run. Everything but the thread count is taken from 'options'.
+	void RunLoaderScaling(const std::filesystem::path& root, std::uint32_t max_thread_num, const anal::scan_options& options = {}, std::uint32_t runs = 3);
+
+	// For every shape and thread count: a warm-up scan, then 'runs' measured ones. Each scan is timed end to end
+	// and by phase: load (Scanner::Start until Scanner::Wait returns), aggregate (the loaders' time in
+	// FinishFolder, summed over threads, sizes are aggregated while loading), sort (every folder's children
+	// sorted by size) and list (display info of every sorted child, like 'ls' in every folder). Prints the medians
+	// with the spread of the load times, allocations and peak RSS of the last run.
+	void RunSuite(const suite_options& options);
+}
+
+#endif // !BENCH_BENCHMARK_H
@@ -0,0 +1,85 @@
+#include "Measure.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+#if defined(FOLDERSCANNER_COUNT_ALLOCATIONS)
+namespace
+{
+	std::atomic_uint64_t allocation_count_ = 0;
+	std::atomic_uint64_t allocation_bytes_ = 0;
+}
+
+// The other forms of new and delete (arrays, nothrow) are implemented by the standard library in terms of these;
+// the aligned forms keep their own implementation and aren't counted.
+void* operator new(std::size_t size)
+{
+	allocation_count_.fetch_add(1, std::memory_order_relaxed);
+	allocation_bytes_.fetch_add(size, std::memory_order_relaxed);
+	while (true)
+	{
+		if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+		// Like the standard operator new, the new handler gets to free memory before giving up.
+		const auto handler = std::get_new_handler();
+		if (!handler) throw std::bad_alloc();
+		handler();
+	}
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+#endif
+
+namespace bench
+{
+	allocation_counts Allocations()
+	{
+#if defined(FOLDERSCANNER_COUNT_ALLOCATIONS)
+		return { allocation_count_.load(std::memory_order_relaxed), allocation_bytes_.load(std::memory_order_relaxed) };
+#else
+		return {};
+#endif
+	}
+
+	std::uint64_t PeakResidentBytes()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.PeakWorkingSetSize;
+#elif defined(__linux__)
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			if (line.starts_with("VmHWM:")) return std::stoull(line.substr(6)) * 1024;
+		}
+		return 0;
+#else
+		return 0;
+#endif
+	}
+
+	void ResetPeakResident()
+	{
+#if defined(__linux__)
+		std::ofstream clear_refs("/proc/self/clear_refs");
+		clear_refs << "5";
+#endif
+	}
+}
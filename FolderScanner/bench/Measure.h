@@ -0,0 +1,36 @@
+#ifndef BENCH_MEASURE_H
+#define BENCH_MEASURE_H
+
+#include <cstdint>
+
+namespace bench
+{
+	// Every operator new of the process since it started. Only builds with FOLDERSCANNER_COUNT_ALLOCATIONS defined
+	// count them: the global operator new and delete are replaced (see Measure.cpp) with versions that add to two
+	// relaxed atomic counters, which costs every allocation of the program. Other builds count nothing.
+#if defined(FOLDERSCANNER_COUNT_ALLOCATIONS)
+	constexpr bool allocations_counted = true;
+#else
+	constexpr bool allocations_counted = false;
+#endif
+
+	struct allocation_counts
+	{
+		std::uint64_t count = 0;
+		std::uint64_t bytes = 0;
+
+		allocation_counts operator-(const allocation_counts& other) const
+		{
+			return { count - other.count, bytes - other.bytes };
+		}
+	};
+
+	allocation_counts Allocations();
+
+	// Highest resident set size of the process since the last ResetPeakResident (Linux, resetting needs kernel
+	// 4.0) or since it started (Windows). 0 where it can't be read.
+	std::uint64_t PeakResidentBytes();
+	void ResetPeakResident();
+}
+
+#endif // !BENCH_MEASURE_H
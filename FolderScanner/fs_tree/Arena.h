@@ -0,0 +1,134 @@
+#ifndef FS_TREE_ARENA
+#define FS_TREE_ARENA
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+
+namespace fs_tree
+{
+	// Append-only table indexed by 32-bit ids. Entries live in big chunks that never move, so ids and references
+	// stay valid while other threads keep allocating, and dropping the table frees a handful of blocks instead of
+	// one allocation per entry.
+	//
+	// 'Chunk' is a structure of arrays with Chunk::size_bits describing the number of entries, so every column is
+	// contiguous in memory:
+	//
+	//     struct FileChunk { static constexpr std::uint32_t size_bits = 16; NameId name[1 << 16]; ... };
+	//     table.At(&FileChunk::name, id) = ...;
+	//
+	// The chunks are found through a two-level directory whose blocks are allocated with the first chunk they
+	// point to, so an empty or small table takes a few KB however small its chunks are.
+	template<typename Chunk>
+	class ChunkedTable
+	{
+	public:
+		static constexpr std::uint32_t chunk_bits = Chunk::size_bits;
+		static constexpr std::uint32_t chunk_size = 1u << chunk_bits;
+		static constexpr std::uint32_t chunk_mask = chunk_size - 1;
+		static constexpr std::uint32_t max_chunks = static_cast<std::uint32_t>((std::uint64_t(1) << 32) >> chunk_bits);
+
+	private:
+		static constexpr std::uint32_t block_num = 256;
+		static constexpr std::uint32_t block_size = max_chunks / block_num;
+
+		std::atomic<std::atomic<Chunk*>*> blocks_[block_num] = {};
+		std::atomic_uint64_t size_ = 0;
+
+		Chunk* GetChunk(std::uint32_t id) const
+		{
+			const auto index = id >> chunk_bits;
+			return blocks_[index / block_size].load(std::memory_order_acquire)[index % block_size].load(std::memory_order_acquire);
+		}
+
+		std::atomic<Chunk*>& EnsureBlock(std::uint32_t index)
+		{
+			auto& slot = blocks_[index / block_size];
+			auto current = slot.load(std::memory_order_acquire);
+			if (!current)
+			{
+				auto allocated = new std::atomic<Chunk*>[block_size]();
+				if (slot.compare_exchange_strong(current, allocated, std::memory_order_acq_rel))
+				{
+					current = allocated;
+				}
+				else
+				{
+					delete[] allocated;
+				}
+			}
+			return current[index % block_size];
+		}
+
+		void EnsureChunk(std::uint32_t index)
+		{
+			auto& slot = EnsureBlock(index);
+			if (slot.load(std::memory_order_acquire)) return;
+
+			auto chunk = new Chunk();
+			Chunk* expected = nullptr;
+			if (!slot.compare_exchange_strong(expected, chunk, std::memory_order_acq_rel))
+			{
+				delete chunk;
+			}
+		}
+
+	public:
+		ChunkedTable() = default;
+		ChunkedTable(const ChunkedTable&) = delete;
+		ChunkedTable& operator=(const ChunkedTable&) = delete;
+
+		~ChunkedTable()
+		{
+			for (auto& slot : blocks_)
+			{
+				const auto chunks = slot.load(std::memory_order_relaxed);
+				if (!chunks) continue;
+				for (std::uint32_t i = 0; i < block_size; i++)
+				{
+					delete chunks[i].load(std::memory_order_relaxed);
+				}
+				delete[] chunks;
+			}
+		}
+
+		// Reserves 'count' consecutive entries and returns the id of the first one. Thread safe.
+		std::uint32_t Allocate(std::uint32_t count)
+		{
+			const auto first = size_.fetch_add(count);
+			if (first + count > (std::uint64_t(1) << 32) - 1)
+			{
+				throw std::length_error("ChunkedTable is full");
+			}
+
+			if (count > 0)
+			{
+				const auto last = first + count - 1;
+				for (auto index = first >> chunk_bits; index <= (last >> chunk_bits); index++)
+				{
+					EnsureChunk(static_cast<std::uint32_t>(index));
+				}
+			}
+			return static_cast<std::uint32_t>(first);
+		}
+
+		std::uint32_t Size() const
+		{
+			return static_cast<std::uint32_t>(size_.load());
+		}
+
+		template<typename T, std::size_t N>
+		T& At(T(Chunk::* column)[N], std::uint32_t id)
+		{
+			return (GetChunk(id)->*column)[id & chunk_mask];
+		}
+
+		template<typename T, std::size_t N>
+		const T& At(T(Chunk::* column)[N], std::uint32_t id) const
+		{
+			return (GetChunk(id)->*column)[id & chunk_mask];
+		}
+	};
+}
+
+#endif // !FS_TREE_ARENA
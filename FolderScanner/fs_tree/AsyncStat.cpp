@@ -0,0 +1,396 @@
+#include "AsyncStat.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+namespace fs_tree
+{
+	namespace
+	{
+		constexpr std::uint32_t stat_pool_thread_num = 64;
+		constexpr std::size_t min_requests_per_job = 4;
+
+		void StatAt(int dirfd, stat_request& request)
+		{
+			struct stat st;
+			request.ok = fstatat(dirfd, request.name, &st, request.flags) == 0;
+			if (!request.ok) return;
+			request.mode = st.st_mode;
+			request.size = static_cast<std::uintmax_t>(st.st_size);
+			request.allocated = static_cast<std::uintmax_t>(st.st_blocks) * 512;
+			request.links = st.st_nlink;
+			request.device = st.st_dev;
+			request.inode = st.st_ino;
+			request.times = { st.st_atim.tv_sec, st.st_mtim.tv_sec, st.st_ctim.tv_sec };
+		}
+
+		// Minimal io_uring wrapper over the raw syscalls, so there is no dependency on liburing.
+		class IoUring
+		{
+		private:
+			int fd_ = -1;
+
+			void* sq_ring_ = MAP_FAILED;
+			void* cq_ring_ = MAP_FAILED;
+			std::size_t sq_ring_size_ = 0;
+			std::size_t cq_ring_size_ = 0;
+
+			io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+			std::size_t sqes_size_ = 0;
+
+			unsigned* sq_head_ = nullptr;
+			unsigned* sq_tail_ = nullptr;
+			unsigned* sq_array_ = nullptr;
+			unsigned sq_mask_ = 0;
+			unsigned sq_entries_ = 0;
+
+			unsigned* cq_head_ = nullptr;
+			unsigned* cq_tail_ = nullptr;
+			io_uring_cqe* cqes_ = nullptr;
+			unsigned cq_mask_ = 0;
+
+			template<typename T>
+			static T* At(void* ring, std::uint32_t offset)
+			{
+				return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+			}
+
+			bool SupportsStatx()
+			{
+				constexpr unsigned op_num = 256;
+				std::vector<char> buffer(sizeof(io_uring_probe) + op_num * sizeof(io_uring_probe_op), 0);
+				auto probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+
+				if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, op_num) < 0) return false;
+				return probe->last_op >= IORING_OP_STATX && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+			}
+
+		public:
+			IoUring() = default;
+			IoUring(const IoUring&) = delete;
+			IoUring& operator=(const IoUring&) = delete;
+
+			bool Init(unsigned entries)
+			{
+				io_uring_params params{};
+				fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+				if (fd_ < 0) return false;
+
+				sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				if (params.features & IORING_FEAT_SINGLE_MMAP)
+				{
+					sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+				}
+
+				sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+				if (sq_ring_ == MAP_FAILED) return false;
+
+				if (params.features & IORING_FEAT_SINGLE_MMAP)
+				{
+					cq_ring_ = sq_ring_;
+				}
+				else
+				{
+					cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+					if (cq_ring_ == MAP_FAILED) return false;
+				}
+
+				sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+				sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+				if (sqes_ == MAP_FAILED) return false;
+
+				sq_head_ = At<unsigned>(sq_ring_, params.sq_off.head);
+				sq_tail_ = At<unsigned>(sq_ring_, params.sq_off.tail);
+				sq_array_ = At<unsigned>(sq_ring_, params.sq_off.array);
+				sq_mask_ = *At<unsigned>(sq_ring_, params.sq_off.ring_mask);
+				sq_entries_ = params.sq_entries;
+
+				cq_head_ = At<unsigned>(cq_ring_, params.cq_off.head);
+				cq_tail_ = At<unsigned>(cq_ring_, params.cq_off.tail);
+				cqes_ = At<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+				cq_mask_ = *At<unsigned>(cq_ring_, params.cq_off.ring_mask);
+
+				return SupportsStatx();
+			}
+
+			~IoUring()
+			{
+				if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+				if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+				if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_size_);
+				if (fd_ >= 0) close(fd_);
+			}
+
+			unsigned Entries() const
+			{
+				return sq_entries_;
+			}
+
+			// Free submission slots, the kernel moves sq_head_ as it consumes entries.
+			unsigned Space() const
+			{
+				const auto head = std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+				return sq_entries_ - (*sq_tail_ - head);
+			}
+
+			void PrepareStatx(int dirfd, const char* name, int flags, struct statx* buffer, std::uint64_t user_data)
+			{
+				const auto tail = *sq_tail_;
+				const auto index = tail & sq_mask_;
+				auto sqe = &sqes_[index];
+
+				std::memset(sqe, 0, sizeof(*sqe));
+				sqe->opcode = IORING_OP_STATX;
+				sqe->fd = dirfd;
+				sqe->addr = reinterpret_cast<std::uint64_t>(name);
+				sqe->len = STATX_TYPE | STATX_SIZE | STATX_BLOCKS | STATX_NLINK | STATX_INO | STATX_ATIME | STATX_MTIME | STATX_CTIME;
+				sqe->off = reinterpret_cast<std::uint64_t>(buffer);
+				sqe->statx_flags = AT_STATX_SYNC_AS_STAT | flags;
+				sqe->user_data = user_data;
+
+				sq_array_[index] = index;
+				std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1, std::memory_order_release);
+			}
+
+			// Returns the number of consumed submissions or -errno.
+			int Enter(unsigned to_submit, unsigned min_complete)
+			{
+				const auto result = syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, IORING_ENTER_GETEVENTS, nullptr, 0);
+				return result < 0 ? -errno : static_cast<int>(result);
+			}
+
+			template<typename F>
+			unsigned Reap(F on_completion)
+			{
+				auto head = *cq_head_;
+				const auto tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+				unsigned reaped = 0;
+				for (; head != tail; head++, reaped++)
+				{
+					const auto& cqe = cqes_[head & cq_mask_];
+					on_completion(cqe.user_data, cqe.res);
+				}
+				std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+				return reaped;
+			}
+		};
+
+		class StatThreadPool
+		{
+		private:
+			struct job
+			{
+				int dirfd;
+				std::span<stat_request> requests;
+				std::latch* latch;
+			};
+
+			std::mutex mutex_;
+			std::condition_variable condition_variable_;
+			std::deque<job> jobs_;
+
+			void Work()
+			{
+				while (true)
+				{
+					job current;
+					{
+						std::unique_lock lock(mutex_);
+						condition_variable_.wait(lock, [&]() { return !jobs_.empty(); });
+						current = jobs_.front();
+						jobs_.pop_front();
+					}
+
+					for (auto& request : current.requests)
+					{
+						StatAt(current.dirfd, request);
+					}
+					current.latch->count_down();
+				}
+			}
+
+		public:
+			explicit StatThreadPool(std::uint32_t thread_num)
+			{
+				for (std::uint32_t i = 0; i < thread_num; i++)
+				{
+					std::thread worker([this]() { Work(); });
+					worker.detach();
+				}
+			}
+
+			void Run(int dirfd, std::span<stat_request> requests, std::uint32_t io_depth)
+			{
+				const auto max_job_num = std::max<std::size_t>(std::min<std::size_t>(io_depth, stat_pool_thread_num + 1), 1);
+				const auto job_num = std::clamp<std::size_t>(requests.size() / min_requests_per_job, 1, max_job_num);
+				const auto job_size = (requests.size() + job_num - 1) / job_num;
+
+				std::latch latch(static_cast<std::ptrdiff_t>(job_num - 1));
+				{
+					std::unique_lock lock(mutex_);
+					for (std::size_t i = 1; i < job_num; i++)
+					{
+						const auto begin = std::min(i * job_size, requests.size());
+						const auto end = std::min(begin + job_size, requests.size());
+						jobs_.push_back({ dirfd, requests.subspan(begin, end - begin), &latch });
+					}
+				}
+				condition_variable_.notify_all();
+
+				// The caller works on the first job instead of idling.
+				for (auto& request : requests.first(std::min(job_size, requests.size())))
+				{
+					StatAt(dirfd, request);
+				}
+				latch.wait();
+			}
+		};
+
+		// Process lifetime, the workers are detached and never joined.
+		StatThreadPool& GetStatThreadPool()
+		{
+			static auto pool = new StatThreadPool(stat_pool_thread_num);
+			return *pool;
+		}
+
+		enum class ring_state : std::uint8_t
+		{
+			untried,
+			available,
+			unavailable
+		};
+
+		thread_local ring_state ring_state_ = ring_state::untried;
+		thread_local std::unique_ptr<IoUring> ring_;
+
+		IoUring* GetRing(std::uint32_t io_depth)
+		{
+			if (ring_state_ == ring_state::untried)
+			{
+				ring_ = std::make_unique<IoUring>();
+				ring_state_ = ring_->Init(std::max(io_depth, 1u)) ? ring_state::available : ring_state::unavailable;
+				if (ring_state_ == ring_state::unavailable) ring_.reset();
+			}
+			return ring_.get();
+		}
+
+		// Returns false if the ring failed; every submitted statx has completed by then and the requests that were
+		// never submitted keep ok == false.
+		bool StatWithRing(IoUring& ring, int dirfd, std::span<stat_request> requests, std::uint32_t io_depth)
+		{
+			thread_local std::vector<struct statx> buffers;
+			buffers.resize(requests.size());
+
+			const auto depth = std::min(std::max(io_depth, 1u), ring.Entries());
+			std::size_t prepared = 0;
+			std::size_t consumed = 0;
+			std::size_t completed = 0;
+			bool failed = false;
+
+			const auto on_completion = [&](std::uint64_t index, int result)
+			{
+				auto& request = requests[index];
+				request.ok = result >= 0;
+				if (request.ok)
+				{
+					const auto& buffer = buffers[index];
+					request.mode = buffer.stx_mode;
+					request.size = buffer.stx_size;
+					request.allocated = buffer.stx_blocks * 512;
+					request.links = buffer.stx_nlink;
+					request.device = makedev(buffer.stx_dev_major, buffer.stx_dev_minor);
+					request.inode = buffer.stx_ino;
+					request.times = { buffer.stx_atime.tv_sec, buffer.stx_mtime.tv_sec, buffer.stx_ctime.tv_sec };
+				}
+				completed++;
+			};
+
+			while (completed < requests.size())
+			{
+				if (!failed)
+				{
+					while (prepared < requests.size() && prepared - completed < depth && ring.Space() > 0)
+					{
+						requests[prepared].ok = false;
+						ring.PrepareStatx(dirfd, requests[prepared].name, requests[prepared].flags, &buffers[prepared], prepared);
+						prepared++;
+					}
+				}
+
+				const auto to_submit = failed ? 0 : static_cast<unsigned>(prepared - consumed);
+				const auto result = ring.Enter(to_submit, 1);
+				if (result >= 0)
+				{
+					consumed += result;
+				}
+				else if (result != -EINTR && result != -EAGAIN && result != -EBUSY)
+				{
+					failed = true;
+				}
+
+				ring.Reap(on_completion);
+
+				// After a failure only the statx calls the kernel already took are waited for.
+				if (failed && completed == consumed) break;
+			}
+
+			if (failed)
+			{
+				for (std::size_t i = consumed; i < requests.size(); i++)
+				{
+					requests[i].ok = false;
+				}
+			}
+			return !failed;
+		}
+	}
+
+	void AsyncStatAt(int dirfd, std::span<stat_request> requests, std::uint32_t io_depth)
+	{
+		if (requests.empty()) return;
+
+		if (auto ring = GetRing(io_depth))
+		{
+			if (StatWithRing(*ring, dirfd, requests, io_depth)) return;
+
+			// Don't keep a broken ring around, finish this batch and the next ones through the pool.
+			ring_state_ = ring_state::unavailable;
+			ring_.reset();
+
+			for (std::size_t i = 0; i < requests.size(); i++)
+			{
+				if (!requests[i].ok) StatAt(dirfd, requests[i]);
+			}
+			return;
+		}
+
+		GetStatThreadPool().Run(dirfd, requests, io_depth);
+	}
+
+	bool AsyncStatUsesIoUring()
+	{
+		return ring_state_ == ring_state::available;
+	}
+}
+
+#endif // __linux__
@@ -0,0 +1,39 @@
+#ifndef FS_TREE_ASYNC_STAT
+#define FS_TREE_ASYNC_STAT
+
+#if defined(__linux__)
+
+#include "DirectoryReader.h"
+
+#include <cstdint>
+#include <span>
+
+namespace fs_tree
+{
+	struct stat_request
+	{
+		const char* name;
+		// 0 or AT_SYMLINK_NOFOLLOW.
+		int flags;
+		bool ok;
+		std::uint32_t mode;
+		std::uintmax_t size;
+		std::uintmax_t allocated;
+		std::uint64_t links;
+		std::uint64_t device;
+		std::uint64_t inode;
+		file_times times;
+	};
+
+	// Stats every request relative to 'dirfd' with up to 'io_depth' lookups in flight. Uses one io_uring per
+	// calling thread submitting IORING_OP_STATX; when the kernel (or a seccomp filter) doesn't allow that, the
+	// requests are split between a shared pool of blocking fstatat threads instead.
+	void AsyncStatAt(int dirfd, std::span<stat_request> requests, std::uint32_t io_depth);
+
+	// True if the calling thread submits through io_uring, false if it uses the thread pool fallback.
+	bool AsyncStatUsesIoUring();
+}
+
+#endif // __linux__
+
+#endif // !FS_TREE_ASYNC_STAT
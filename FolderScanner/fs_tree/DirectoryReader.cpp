@@ -0,0 +1,454 @@
+#include "DirectoryReader.h"
+#include "AsyncStat.h"
+#include "NameMatcher.h"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs_tree
+{
+	namespace
+	{
+		// For listings without allocation sizes, files are taken to occupy exactly their size.
+		void AddEntry(directory_listing& listing, native_string_view name, entry_type type, std::uintmax_t size, const file_times& times = {})
+		{
+			const auto offset = static_cast<std::uint32_t>(listing.names.size());
+			listing.names.insert(listing.names.end(), name.begin(), name.end());
+			listing.entries.push_back({ offset, static_cast<std::uint32_t>(name.size()), type, size, size, 0, 0, times });
+		}
+
+		bool IsDotOrDotDot(const native_char* name)
+		{
+			return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+		}
+
+#if defined(_WIN32)
+		std::int64_t UnixTime(const FILETIME& time)
+		{
+			// 100 ns intervals since 1601.
+			const auto intervals = (static_cast<std::int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+			return intervals / 10'000'000 - 11'644'473'600;
+		}
+#endif
+
+#if defined(__linux__)
+		struct linux_dirent64
+		{
+			ino64_t d_ino;
+			off64_t d_off;
+			unsigned short d_reclen;
+			unsigned char d_type;
+			char d_name[];
+		};
+
+		constexpr std::size_t getdents_buffer_size = 256 * 1024;
+
+		// Entries that still need a stat, with their names recorded as offsets into listing.names (followed by a
+		// terminating zero) so the getdents buffer can be reused for the next batch.
+		struct pending_stat
+		{
+			std::uint32_t name_offset;
+			std::uint32_t name_length;
+			bool type_known;
+		};
+
+		std::uint64_t Modified(const struct stat& st)
+		{
+			const auto nanoseconds = [](const timespec& time)
+			{
+				return static_cast<std::uint64_t>(time.tv_sec) * 1'000'000'000ull + static_cast<std::uint64_t>(time.tv_nsec);
+			};
+			return std::max(nanoseconds(st.st_mtim), nanoseconds(st.st_ctim));
+		}
+
+		// Closes the directory however ReadDirectory is left, growing the listing can throw.
+		struct fd_closer
+		{
+			int fd;
+
+			~fd_closer()
+			{
+				close(fd);
+			}
+		};
+#endif
+	}
+
+	read_counters& read_counters::operator+=(const read_counters& other)
+	{
+		opens += other.opens;
+		reads += other.reads;
+		stats += other.stats;
+		failed_stats += other.failed_stats;
+		failed_opens += other.failed_opens;
+		failed_reads += other.failed_reads;
+		stat_ns += other.stat_ns;
+		return *this;
+	}
+
+	read_counters read_counters::operator-(const read_counters& other) const
+	{
+		return { opens - other.opens, reads - other.reads, stats - other.stats, failed_stats - other.failed_stats, failed_opens - other.failed_opens, failed_reads - other.failed_reads, stat_ns - other.stat_ns };
+	}
+
+	read_counters& ThreadReadCounters()
+	{
+		thread_local read_counters counters;
+		return counters;
+	}
+
+#if defined(__linux__)
+	bool ReadDirectory(const std::filesystem::path& path, directory_listing& listing, const read_options& options)
+	{
+		listing.Clear();
+		auto& counters = ThreadReadCounters();
+
+		counters.opens++;
+		const int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			counters.failed_opens++;
+			return false;
+		}
+		const fd_closer closer{ fd };
+
+		// Taken before the entries are read, a change while reading makes the next rescan read the directory again.
+		struct stat directory_stat;
+		if (fstat(fd, &directory_stat) == 0)
+		{
+			listing.modified = Modified(directory_stat);
+			listing.device = directory_stat.st_dev;
+			listing.inode = directory_stat.st_ino;
+
+			// A mount point stays in the tree, but nothing of the other filesystem is read.
+			if (options.device != 0 && listing.device != options.device) return true;
+		}
+
+		const auto exclude = options.exclude && !options.exclude->Empty() ? options.exclude.get() : nullptr;
+
+		thread_local std::vector<char> buffer(getdents_buffer_size);
+		thread_local std::vector<pending_stat> pending;
+		pending.clear();
+
+		while (true)
+		{
+			const auto read = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+			counters.reads++;
+			if (read == 0) break;
+			if (read < 0)
+			{
+				// A partial listing would drop the entries that weren't read from the tree.
+				counters.failed_reads++;
+				return false;
+			}
+
+			for (long offset = 0; offset < read;)
+			{
+				const auto dirent = reinterpret_cast<const linux_dirent64*>(buffer.data() + offset);
+				offset += dirent->d_reclen;
+
+				if (IsDotOrDotDot(dirent->d_name)) continue;
+
+				const native_string_view name(dirent->d_name);
+				if (exclude && exclude->Matches(name)) continue;
+
+				switch (dirent->d_type)
+				{
+				case DT_DIR:
+					AddEntry(listing, name, entry_type::folder, 0);
+					break;
+				case DT_LNK:
+					if (!options.follow_symlinks) break;
+					[[fallthrough]];
+				case DT_REG:
+				case DT_UNKNOWN:
+				{
+					// Followed symlinks are resolved like directory_entry::status() did, DT_UNKNOWN comes from
+					// filesystems that don't fill d_type. Both need the stat to know what they are.
+					const auto name_offset = static_cast<std::uint32_t>(listing.names.size());
+					listing.names.insert(listing.names.end(), name.begin(), name.end());
+					listing.names.push_back('\0');
+					pending.push_back({ name_offset, static_cast<std::uint32_t>(name.size()), dirent->d_type == DT_REG });
+					break;
+				}
+				default:
+					break;
+				}
+			}
+		}
+
+		thread_local std::vector<stat_request> requests;
+		requests.resize(pending.size());
+		for (std::size_t i = 0; i < pending.size(); i++)
+		{
+			requests[i].name = listing.names.data() + pending[i].name_offset;
+			// Without following, a DT_UNKNOWN symlink stats as a link and is dropped below.
+			requests[i].flags = options.follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+		}
+
+		const auto stat_start = std::chrono::steady_clock::now();
+		if (options.async_stat && requests.size() > 1)
+		{
+			AsyncStatAt(fd, requests, options.io_depth);
+		}
+		else
+		{
+			for (auto& request : requests)
+			{
+				struct stat st;
+				request.ok = fstatat(fd, request.name, &st, request.flags) == 0;
+				if (!request.ok) continue;
+				request.mode = st.st_mode;
+				request.size = static_cast<std::uintmax_t>(st.st_size);
+				request.allocated = static_cast<std::uintmax_t>(st.st_blocks) * 512;
+				request.links = st.st_nlink;
+				request.device = st.st_dev;
+				request.inode = st.st_ino;
+				request.times = { st.st_atim.tv_sec, st.st_mtim.tv_sec, st.st_ctim.tv_sec };
+			}
+		}
+		counters.stats += requests.size();
+		counters.stat_ns += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - stat_start).count());
+
+		for (std::size_t i = 0; i < pending.size(); i++)
+		{
+			const auto& p = pending[i];
+			const auto& request = requests[i];
+			if (!request.ok)
+			{
+				counters.failed_stats++;
+				continue;
+			}
+
+			if (S_ISREG(request.mode))
+			{
+				// Only files with other links need their identity, everything else is counted as it is.
+				const auto linked = request.links > 1;
+				listing.entries.push_back({ p.name_offset, p.name_length, entry_type::file, request.size, request.allocated, linked ? request.device : 0, linked ? request.inode : 0, request.times });
+			}
+			else if (!p.type_known && S_ISDIR(request.mode))
+			{
+				listing.entries.push_back({ p.name_offset, p.name_length, entry_type::folder, 0, 0, 0, 0, {} });
+			}
+		}
+		return true;
+	}
+
+	bool ReadDirectoryModified(const std::filesystem::path& path, std::uint64_t& modified)
+	{
+		ThreadReadCounters().stats++;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+		modified = Modified(st);
+		return true;
+	}
+
+	bool ReadFileEntry(const std::filesystem::path& path, directory_listing::entry& entry)
+	{
+		auto& counters = ThreadReadCounters();
+		counters.stats++;
+		struct stat st;
+		if (lstat(path.c_str(), &st) != 0)
+		{
+			counters.failed_stats++;
+			return false;
+		}
+		if (!S_ISREG(st.st_mode)) return false;
+
+		const auto linked = st.st_nlink > 1;
+		entry.size = static_cast<std::uintmax_t>(st.st_size);
+		entry.allocated = static_cast<std::uintmax_t>(st.st_blocks) * 512;
+		entry.device = linked ? st.st_dev : 0;
+		entry.inode = linked ? st.st_ino : 0;
+		entry.times = { st.st_atim.tv_sec, st.st_mtim.tv_sec, st.st_ctim.tv_sec };
+		return true;
+	}
+
+	bool ReadDirectoryDevice(const std::filesystem::path& path, std::uint64_t& device)
+	{
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) return false;
+		device = st.st_dev;
+		return true;
+	}
+#elif defined(_WIN32)
+	bool ReadDirectory(const std::filesystem::path& path, directory_listing& listing, const read_options& options)
+	{
+		listing.Clear();
+		ReadDirectoryModified(path, listing.modified);
+		auto& counters = ThreadReadCounters();
+
+		WIN32_FIND_DATAW data;
+		const auto pattern = path / L"*";
+		counters.opens++;
+		const auto handle = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			counters.failed_opens++;
+			return false;
+		}
+
+		const auto exclude = options.exclude && !options.exclude->Empty() ? options.exclude.get() : nullptr;
+		do
+		{
+			counters.reads++;
+			if (IsDotOrDotDot(data.cFileName)) continue;
+
+			const native_string_view name(data.cFileName);
+			if (exclude && exclude->Matches(name)) continue;
+
+			// Symlinks and junctions, dwReserved0 holds the reparse tag. Other reparse points (cloud files,
+			// deduplicated files) are ordinary entries.
+			const auto link = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) && (data.dwReserved0 == IO_REPARSE_TAG_SYMLINK || data.dwReserved0 == IO_REPARSE_TAG_MOUNT_POINT);
+			if (link && !options.follow_symlinks) continue;
+
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				AddEntry(listing, name, entry_type::folder, 0);
+			}
+			else if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DEVICE))
+			{
+				const auto size = (static_cast<std::uintmax_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+				const auto modified = UnixTime(data.ftLastWriteTime);
+				AddEntry(listing, name, entry_type::file, size, { UnixTime(data.ftLastAccessTime), modified, modified });
+			}
+		} while (FindNextFileW(handle, &data));
+
+		const auto error = GetLastError();
+		FindClose(handle);
+		if (error != ERROR_NO_MORE_FILES)
+		{
+			counters.failed_reads++;
+			return false;
+		}
+		return true;
+	}
+
+	bool ReadDirectoryModified(const std::filesystem::path& path, std::uint64_t& modified)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data) || !(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) return false;
+		modified = (static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+		return true;
+	}
+
+	bool ReadFileEntry(const std::filesystem::path& path, directory_listing::entry& entry)
+	{
+		ThreadReadCounters().stats++;
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+		{
+			ThreadReadCounters().failed_stats++;
+			return false;
+		}
+		if (data.dwFileAttributes & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_DEVICE | FILE_ATTRIBUTE_REPARSE_POINT)) return false;
+
+		entry.size = (static_cast<std::uintmax_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+		entry.allocated = entry.size;
+		entry.device = 0;
+		entry.inode = 0;
+		const auto modified = UnixTime(data.ftLastWriteTime);
+		entry.times = { UnixTime(data.ftLastAccessTime), modified, modified };
+		return true;
+	}
+
+	bool ReadDirectoryDevice(const std::filesystem::path&, std::uint64_t&)
+	{
+		return false;
+	}
+#else
+	bool ReadDirectory(const std::filesystem::path& path, directory_listing& listing, const read_options& options)
+	{
+		listing.Clear();
+		ReadDirectoryModified(path, listing.modified);
+
+		auto& counters = ThreadReadCounters();
+
+		std::error_code ec;
+		counters.opens++;
+		std::filesystem::directory_iterator iterator(path, ec);
+		if (ec)
+		{
+			counters.failed_opens++;
+			return false;
+		}
+
+		const auto exclude = options.exclude && !options.exclude->Empty() ? options.exclude.get() : nullptr;
+		// An error while iterating ends at the end iterator, with the error in 'read_error'.
+		std::error_code read_error;
+		for (; iterator != std::filesystem::directory_iterator(); iterator.increment(read_error))
+		{
+			const auto& item = *iterator;
+			const auto name = item.path().filename().native();
+			if (exclude && exclude->Matches(name)) continue;
+			if (!options.follow_symlinks && item.is_symlink(ec)) continue;
+
+			if (item.is_directory(ec))
+			{
+				AddEntry(listing, name, entry_type::folder, 0);
+			}
+			else if (item.is_regular_file(ec))
+			{
+				const auto size = item.file_size(ec);
+				if (ec) continue;
+				const auto time = item.last_write_time(ec);
+				const auto modified = ec ? 0 : std::chrono::duration_cast<std::chrono::seconds>(std::chrono::file_clock::to_sys(time).time_since_epoch()).count();
+				AddEntry(listing, name, entry_type::file, size, { modified, modified, modified });
+			}
+		}
+		if (read_error)
+		{
+			counters.failed_reads++;
+			return false;
+		}
+		return true;
+	}
+
+	bool ReadDirectoryModified(const std::filesystem::path& path, std::uint64_t& modified)
+	{
+		std::error_code ec;
+		const auto time = std::filesystem::last_write_time(path, ec);
+		if (ec) return false;
+		modified = static_cast<std::uint64_t>(time.time_since_epoch().count());
+		return true;
+	}
+
+	bool ReadFileEntry(const std::filesystem::path& path, directory_listing::entry& entry)
+	{
+		auto& counters = ThreadReadCounters();
+		counters.stats++;
+		std::error_code ec;
+		const auto status = std::filesystem::symlink_status(path, ec);
+		if (!ec && !std::filesystem::is_regular_file(status)) return false;
+		const auto size = ec ? 0 : std::filesystem::file_size(path, ec);
+		if (ec)
+		{
+			counters.failed_stats++;
+			return false;
+		}
+		const auto time = std::filesystem::last_write_time(path, ec);
+		const auto modified = ec ? 0 : std::chrono::duration_cast<std::chrono::seconds>(std::chrono::file_clock::to_sys(time).time_since_epoch()).count();
+		entry.size = size;
+		entry.allocated = size;
+		entry.device = 0;
+		entry.inode = 0;
+		entry.times = { modified, modified, modified };
+		return true;
+	}
+
+	bool ReadDirectoryDevice(const std::filesystem::path&, std::uint64_t&)
+	{
+		return false;
+	}
+#endif
+}
@@ -0,0 +1,143 @@
+#ifndef FS_TREE_DIRECTORY_READER
+#define FS_TREE_DIRECTORY_READER
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace fs_tree
+{
+	using native_char = std::filesystem::path::value_type;
+	using native_string_view = std::basic_string_view<native_char>;
+
+	class NameMatcher;
+
+	enum class entry_type : std::uint8_t
+	{
+		file,
+		folder
+	};
+
+	// Last access, modification and status change of a file in seconds since 1970. Windows has no change time in
+	// its listings and reports the last write time for it, other platforms without stat report the last write
+	// time for all three.
+	struct file_times
+	{
+		std::int64_t accessed = 0;
+		std::int64_t modified = 0;
+		std::int64_t changed = 0;
+	};
+
+	// Contents of a single directory. Names are packed into one buffer so a listing can be reused by a loader
+	// thread without allocating per entry.
+	struct directory_listing
+	{
+		struct entry
+		{
+			std::uint32_t name_offset;
+			std::uint32_t name_length;
+			entry_type type;
+			std::uintmax_t size;
+			// Bytes of the blocks the file occupies on disk (st_blocks), smaller than 'size' for sparse and
+			// compressed files.
+			std::uintmax_t allocated;
+			// Identity of a file with more than one hard link, so it can be counted once. Zero for every other
+			// entry and on platforms where the listing doesn't provide link counts.
+			std::uint64_t device = 0;
+			std::uint64_t inode = 0;
+			// From the same stat as the sizes, zero for folders.
+			file_times times;
+		};
+
+		std::vector<native_char> names;
+		std::vector<entry> entries;
+
+		// Modification stamp of the directory itself, see ReadDirectoryModified.
+		std::uint64_t modified = 0;
+		// Identity of the directory itself, Linux only (zero elsewhere).
+		std::uint64_t device = 0;
+		std::uint64_t inode = 0;
+
+		native_string_view Name(const entry& e) const
+		{
+			return native_string_view(names.data() + e.name_offset, e.name_length);
+		}
+
+		void Clear()
+		{
+			names.clear();
+			entries.clear();
+			modified = 0;
+			device = 0;
+			inode = 0;
+		}
+	};
+
+	struct read_options
+	{
+		// Linux only: stat the files of a directory as one batch of asynchronous statx calls instead of one
+		// blocking fstatat after another. Pays off when stat latency dominates (cold caches, network filesystems).
+		bool async_stat = false;
+		std::uint32_t io_depth = 128;
+
+		// Symbolic links are skipped without being stat'ed unless this is set, then they are resolved and count as
+		// what they point to. Following links can reach a directory twice, callers have to detect that from the
+		// listing's device and inode.
+		bool follow_symlinks = false;
+		// When not zero, a directory on another device (a mount point) is read as empty, Linux only.
+		std::uint64_t device = 0;
+		// Entries whose names match are left out before they are stat'ed.
+		std::shared_ptr<const NameMatcher> exclude;
+	};
+
+	// System calls made by the readers of the calling thread, for instrumentation. Plain thread-local counters, so
+	// counting costs nothing measurable; whoever wants totals takes the difference before and after its work and
+	// merges the numbers of its threads. Windows counts FindFirstFileExW/FindNextFileW calls as reads.
+	struct read_counters
+	{
+		// Directories opened, and reads of batches of entries from them (getdents64 calls).
+		std::uint64_t opens = 0;
+		std::uint64_t reads = 0;
+		// Files stat'ed, synchronously or through AsyncStatAt, and the ones that failed (mostly vanished entries).
+		std::uint64_t stats = 0;
+		std::uint64_t failed_stats = 0;
+		// Directories that couldn't be opened, and the ones that failed while reading their entries.
+		std::uint64_t failed_opens = 0;
+		std::uint64_t failed_reads = 0;
+		// Time spent in the stat batches of ReadDirectory.
+		std::uint64_t stat_ns = 0;
+
+		read_counters& operator+=(const read_counters& other);
+		read_counters operator-(const read_counters& other) const;
+	};
+
+	read_counters& ThreadReadCounters();
+
+	// Reads the regular files (with their sizes, allocated sizes, times and, for hard-linked files, their inodes) and
+	// folders of 'path' into 'listing'. Entries that vanish while the directory is read, excluded entries and
+	// entries of other types are skipped. Returns false if the directory can't be opened.
+	//
+	// Linux reads the entries with large getdents64 batches from a single directory fd, trusts d_type for folders
+	// and calls fstatat relative to that fd only for regular files. Windows gets sizes from FindFirstFileExW with
+	// FIND_FIRST_EX_LARGE_FETCH without any stat. Other platforms use std::filesystem::directory_iterator. Only
+	// Linux reports allocated sizes, elsewhere they're equal to the sizes.
+	bool ReadDirectory(const std::filesystem::path& path, directory_listing& listing, const read_options& options = {});
+
+	// Reads a stamp that changes whenever an entry is added to, removed from or renamed in 'path' (the newest of
+	// mtime and ctime in nanoseconds on Linux, the last write time elsewhere) without reading the entries. Changes
+	// to the contents of files inside the directory don't affect it. Returns false if the directory can't be read.
+	bool ReadDirectoryModified(const std::filesystem::path& path, std::uint64_t& modified);
+
+	// Reads the regular file at 'path' into 'entry' the way ReadDirectory would (size, allocated size, times and,
+	// with other hard links, the inode), without following symlinks; the name and type are left alone. Returns
+	// false if it can't be stat'ed or isn't a regular file.
+	bool ReadFileEntry(const std::filesystem::path& path, directory_listing::entry& entry);
+
+	// Reads the device 'path' is on, for read_options::device. Returns false if it can't be read or the platform
+	// doesn't have device ids.
+	bool ReadDirectoryDevice(const std::filesystem::path& path, std::uint64_t& device);
+}
+
+#endif // !FS_TREE_DIRECTORY_READER
@@ -1,6 +1,7 @@
 #include "File.h"
 
-#include <iostream>
+#include <filesystem>
+#include <unordered_map>
 
 namespace fs_tree
 {
@@ -19,15 +20,9 @@ namespace fs_tree
 		};
 	}
 
-	display_info::display_info(const std::filesystem::path& p, const std::uintmax_t sz)
+	display_info::display_info(native_string_view name, const std::uintmax_t sz)
 	{
-		// Use filename if available, otherwise use the last part of parent path (for folder paths ending with a separator).
-		auto last = p.filename();
-		if (last.empty())
-		{
-			last = p.parent_path().filename();
-		}
-		path = last.string();
+		path = std::filesystem::path(name).string();
 
 		int depth = 0;
 		size = static_cast<double>(sz);
@@ -51,11 +46,4 @@ namespace fs_tree
 		}
 		return *this;
 	}
-
-	File::~File()
-	{
-#if _DEBUG
-		std::cout << "File destructor called for: " << path_ << std::endl;
-#endif
-	}
 }
\ No newline at end of file
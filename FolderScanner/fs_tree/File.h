@@ -1,11 +1,12 @@
 #ifndef FS_TREE_FILE
 #define FS_TREE_FILE
 
+#include "DirectoryReader.h"
+#include "NamePool.h"
+
 #include <cstdint>
-#include <filesystem>
-#include <memory>
-#include <vector>
-#include <unordered_map>
+#include <limits>
+#include <string>
 
 namespace fs_tree
 {
@@ -14,7 +15,7 @@ namespace fs_tree
 		double size;
 		std::string unit;
 		std::string path;
-		display_info(const std::filesystem::path& p, const std::uintmax_t sz);
+		display_info(native_string_view name, const std::uintmax_t sz);
 
 		display_info() = default;
 		display_info(const display_info&) = delete;
@@ -26,22 +27,29 @@ namespace fs_tree
 	};
 	//double display_size(const std::uintmax_t size);
 
-	class File;
+	using FileId = std::uint32_t;
+	using FolderId = std::uint32_t;
+	// A hard-linked inode, see InodeSet.
+	using LinkId = std::uint32_t;
 
-	using Files = std::vector<std::unique_ptr<File>>;
+	constexpr FolderId invalid_folder = std::numeric_limits<FolderId>::max();
+	constexpr LinkId no_link = std::numeric_limits<LinkId>::max();
 
-	class File
+	// Files of a FilesystemTree, one array per attribute. A folder's files occupy a contiguous id range. 'link' is
+	// no_link for files with a single link. The times are seconds since 1970 in 32 bits (up to 2106), earlier
+	// times are stored as zero.
+	struct FileChunk
 	{
-	public:
-		const std::filesystem::path path_;
-		const std::uintmax_t size_;
-		File(const std::filesystem::path& path) : path_(path), size_(std::filesystem::file_size(path)) {};
-		display_info GetDisplayInfo() const
-		{
-			return display_info(path_, size_);
-		}
-		virtual ~File();
+		static constexpr std::uint32_t size_bits = 16;
+		NameId name[1 << size_bits];
+		FolderId parent[1 << size_bits];
+		std::uintmax_t size[1 << size_bits];
+		std::uintmax_t allocated[1 << size_bits];
+		LinkId link[1 << size_bits];
+		std::uint32_t accessed[1 << size_bits];
+		std::uint32_t modified[1 << size_bits];
+		std::uint32_t changed[1 << size_bits];
 	};
 }
 
-#endif // !FS_TREE_FILE
\ No newline at end of file
+#endif // !FS_TREE_FILE
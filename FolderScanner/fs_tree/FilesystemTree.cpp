@@ -1,24 +1,1015 @@
 #include "FilesystemTree.h"
+#include "ParallelSort.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
 
 namespace fs_tree
 {
-	Folder* FilesystemTree::GetRoot() const
+	namespace
+	{
+		std::uint32_t StoredTime(std::int64_t seconds)
+		{
+			return static_cast<std::uint32_t>(std::clamp<std::int64_t>(seconds, 0, std::numeric_limits<std::uint32_t>::max()));
+		}
+
+		// Children are indexed before their folder's range is set, an empty range counts them as in use.
+		bool InRange(id_range range, std::uint32_t id)
+		{
+			return range.empty() || (id >= *range.begin() && id < *range.end());
+		}
+	}
+
+	FilesystemTree::FilesystemTree(const std::filesystem::path& root_path)
+		: root_path_(root_path), scan_time_(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+	{
+		// Use filename if available, otherwise use the last part of parent path (for folder paths ending with a separator).
+		auto last = root_path.filename();
+		if (last.empty())
+		{
+			last = root_path.parent_path().filename();
+		}
+		if (last.empty())
+		{
+			last = root_path;
+		}
+
+		auto writer = CreateWriter();
+		const auto root = folders_.Allocate(1);
+		folders_.At(&FolderChunk::name, root) = writer.names.Add(last.native());
+		folders_.At(&FolderChunk::parent, root) = invalid_folder;
+		histograms_.Allocate(1);
+	}
+
+	FilesystemTree::FilesystemTree(std::unique_ptr<Snapshot> snapshot)
+		: root_path_(native_string_view(snapshot->root_path.data(), snapshot->root_path.size())), scan_time_(snapshot->ScanTime()), snapshot_(std::move(snapshot))
+	{
+	}
+
+	FolderId FilesystemTree::GetRoot() const
+	{
+		return 0;
+	}
+
+	bool FilesystemTree::ReadOnly() const
+	{
+		return snapshot_ != nullptr;
+	}
+
+	const std::filesystem::path& FilesystemTree::GetRootPath() const
+	{
+		return root_path_;
+	}
+
+	FilesystemTree::Writer FilesystemTree::CreateWriter()
+	{
+		return Writer{ NamePool::Writer(names_) };
+	}
+
+	id_range FilesystemTree::AddChildren(Writer& writer, FolderId folder, const directory_listing& listing)
+	{
+		std::uint32_t folder_num = 0;
+		std::uint32_t file_num = 0;
+		for (const auto& entry : listing.entries)
+		{
+			if (entry.type == entry_type::folder) folder_num++;
+			else file_num++;
+		}
+
+		const auto first_folder = folders_.Allocate(folder_num);
+		const auto first_file = files_.Allocate(file_num);
+
+		auto next_folder = first_folder;
+		auto next_file = first_file;
+		subtree_totals totals{ 0, 0, 0, folder_num };
+		for (const auto& entry : listing.entries)
+		{
+			const auto name = writer.names.Add(listing.Name(entry));
+			if (entry.type == entry_type::folder)
+			{
+				folders_.At(&FolderChunk::name, next_folder) = name;
+				folders_.At(&FolderChunk::parent, next_folder) = folder;
+				IndexFolder(next_folder);
+				next_folder++;
+			}
+			else
+			{
+				const inode_key key{ entry.device, entry.inode };
+				totals += SetFile(next_file, folder, name, entry.size, entry.allocated, entry.times, entry.inode != 0 ? &key : nullptr);
+				IndexFile(next_file);
+				next_file++;
+			}
+		}
+
+		if (folder_num > 0)
+		{
+			const auto histogram = FilesHistogram(id_range(first_file, first_file + file_num));
+			SetHistogram(folder, &histogram);
+		}
+		return LinkChildren(folder, { first_folder, folder_num, first_file, file_num, totals, listing.modified, folder_num });
+	}
+
+	id_range FilesystemTree::CopyChildren(Writer& writer, FolderId folder, const FilesystemTree& previous, FolderId previous_folder)
+	{
+		const auto subfolders = previous.SubFolders(previous_folder);
+		const auto files = previous.Files(previous_folder);
+		const auto folder_num = static_cast<std::uint32_t>(subfolders.size());
+		const auto file_num = static_cast<std::uint32_t>(files.size());
+
+		const auto first_folder = folders_.Allocate(folder_num);
+		const auto first_file = files_.Allocate(file_num);
+
+		auto next_folder = first_folder;
+		for (const auto subfolder : subfolders)
+		{
+			folders_.At(&FolderChunk::name, next_folder) = writer.names.Add(previous.FolderName(subfolder));
+			folders_.At(&FolderChunk::parent, next_folder) = folder;
+			IndexFolder(next_folder);
+			next_folder++;
+		}
+
+		auto next_file = first_file;
+		subtree_totals totals{ 0, 0, 0, folder_num };
+		for (const auto file : files)
+		{
+			// Hard links are counted again from scratch, their owners in the previous tree may have changed.
+			const auto link = previous.FileLink(file);
+			const auto key = link != no_link ? previous.LinkKey(link) : inode_key{};
+			totals += SetFile(next_file, folder, writer.names.Add(previous.FileName(file)), previous.FileSize(file), previous.FileAllocated(file), previous.FileTimes(file), link != no_link ? &key : nullptr);
+			IndexFile(next_file);
+			next_file++;
+		}
+
+		if (folder_num > 0)
+		{
+			const auto histogram = FilesHistogram(id_range(first_file, first_file + file_num));
+			SetHistogram(folder, &histogram);
+		}
+
+		return LinkChildren(folder, { first_folder, folder_num, first_file, file_num, totals, previous.FolderModified(previous_folder), folder_num });
+	}
+
+	subtree_totals FilesystemTree::SetFile(FileId file, FolderId folder, NameId name, std::uintmax_t size, std::uintmax_t allocated, const file_times& times, const inode_key* key)
+	{
+		files_.At(&FileChunk::name, file) = name;
+		files_.At(&FileChunk::parent, file) = folder;
+		files_.At(&FileChunk::size, file) = size;
+		files_.At(&FileChunk::allocated, file) = allocated;
+		files_.At(&FileChunk::accessed, file) = StoredTime(times.accessed);
+		files_.At(&FileChunk::modified, file) = StoredTime(times.modified);
+		files_.At(&FileChunk::changed, file) = StoredTime(times.changed);
+		if (!key)
+		{
+			files_.At(&FileChunk::link, file) = no_link;
+			return { size, size, allocated, 1 };
+		}
+
+		const auto [link, owner] = links_.Add(*key, file);
+		files_.At(&FileChunk::link, file) = link;
+		return owner ? subtree_totals{ size, size, allocated, 1 } : subtree_totals{ size, 0, 0, 1 };
+	}
+
+	void FilesystemTree::ReleaseLinks(FolderId folder, bool subtree)
+	{
+		std::vector<FolderId> stack{ folder };
+		while (!stack.empty())
+		{
+			const auto current = stack.back();
+			stack.pop_back();
+
+			for (const auto file : Files(current))
+			{
+				const auto link = FileLink(file);
+				if (link != no_link) links_.Release(link, file);
+			}
+			if (!subtree) continue;
+			for (const auto subfolder : SubFolders(current))
+			{
+				stack.push_back(subfolder);
+			}
+		}
+	}
+
+	id_range FilesystemTree::LinkChildren(FolderId folder, const folder_link& link)
+	{
+		folders_.At(&FolderChunk::first_folder, folder) = link.first_folder;
+		folders_.At(&FolderChunk::folder_num, folder) = link.folder_num;
+		folders_.At(&FolderChunk::first_file, folder) = link.first_file;
+		folders_.At(&FolderChunk::file_num, folder) = link.file_num;
+		folders_.At(&FolderChunk::modified, folder) = link.modified;
+		folders_.At(&FolderChunk::pending, folder).store(link.pending, std::memory_order_relaxed);
+		folders_.At(&FolderChunk::size, folder).store(link.totals.size, std::memory_order_relaxed);
+		folders_.At(&FolderChunk::unique_size, folder).store(link.totals.unique_size, std::memory_order_relaxed);
+		folders_.At(&FolderChunk::allocated, folder).store(link.totals.allocated, std::memory_order_relaxed);
+		folders_.At(&FolderChunk::entries, folder).store(link.totals.entries, std::memory_order_relaxed);
+
+		// Readers that see the flag also see everything written above, including the rows of the children.
+		folders_.At(&FolderChunk::loaded, folder).store(true, std::memory_order_release);
+
+		return id_range(link.first_folder, link.first_folder + link.folder_num);
+	}
+
+	void FilesystemTree::FinishFolder(FolderId folder)
+	{
+		// A folder that couldn't be read is finished without any children.
+		folders_.At(&FolderChunk::loaded, folder).store(true, std::memory_order_release);
+
+		// A folder with subfolders is finished by the last of them instead.
+		if (folders_.At(&FolderChunk::folder_num, folder) > 0) return;
+
+		// Walks up instead of recursing, so deep trees can't overflow the stack.
+		for (auto parent = FolderParent(folder); parent != invalid_folder; folder = parent, parent = FolderParent(folder))
+		{
+			AddTotals(parent, FolderTotals(folder));
+			AddHistogram(parent, FolderHistogram(folder));
+			if (folders_.At(&FolderChunk::pending, parent).fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+		}
+	}
+
+	relink_result FilesystemTree::RelinkChildren(Writer& writer, FolderId folder, const directory_listing& listing)
+	{
+		relink_result result;
+
+		// The old files are replaced, and the new rows take over the inodes they counted.
+		ReleaseLinks(folder, false);
+
+		std::unordered_map<native_string_view, FolderId> old_subfolders;
+		for (const auto subfolder : SubFolders(folder))
+		{
+			old_subfolders.emplace(FolderName(subfolder), subfolder);
+		}
+
+		std::uint32_t folder_num = 0;
+		std::uint32_t file_num = 0;
+		bool same_folders = true;
+		for (const auto& entry : listing.entries)
+		{
+			if (entry.type == entry_type::file)
+			{
+				file_num++;
+				continue;
+			}
+			folder_num++;
+			same_folders = same_folders && old_subfolders.contains(listing.Name(entry));
+		}
+		same_folders = same_folders && folder_num == old_subfolders.size();
+
+		// Most changes add, remove or rename files. The new files are written over the old ones when they fit in
+		// the rows the folder had, and subfolders stay where they are unless they changed themselves.
+		const auto old_files = Files(folder);
+		const auto capacity = file_capacity_.find(folder);
+		const auto file_rows = capacity != file_capacity_.end() ? capacity->second : static_cast<std::uint32_t>(old_files.size());
+		const auto reuse_files = file_num <= file_rows;
+		const auto first_file = reuse_files ? *old_files.begin() : files_.Allocate(file_num);
+		if (reuse_files && file_rows > file_num) file_capacity_[folder] = file_rows;
+		else if (capacity != file_capacity_.end()) file_capacity_.erase(capacity);
+
+		const auto first_folder = same_folders ? *SubFolders(folder).begin() : folders_.Allocate(folder_num);
+
+		auto next_folder = first_folder;
+		auto next_file = first_file;
+		subtree_totals totals;
+		subtree_histogram histogram;
+		for (const auto& entry : listing.entries)
+		{
+			if (entry.type == entry_type::file)
+			{
+				const auto name = writer.names.Add(listing.Name(entry));
+				const inode_key key{ entry.device, entry.inode };
+				totals += SetFile(next_file, folder, name, entry.size, entry.allocated, entry.times, entry.inode != 0 ? &key : nullptr);
+				next_file++;
+				continue;
+			}
+
+			totals.entries++;
+			const auto old = old_subfolders.find(listing.Name(entry));
+			if (same_folders)
+			{
+				totals += FolderTotals(old->second);
+				histogram += FolderHistogram(old->second);
+				continue;
+			}
+
+			folders_.At(&FolderChunk::name, next_folder) = writer.names.Add(listing.Name(entry));
+			folders_.At(&FolderChunk::parent, next_folder) = folder;
+
+			if (old == old_subfolders.end())
+			{
+				LinkChildren(next_folder, {});
+				result.added.push_back(next_folder);
+			}
+			else
+			{
+				const auto old_folder = old->second;
+				old_subfolders.erase(old);
+
+				// The children keep their ids, only their parent changes.
+				const auto subfolders = SubFolders(old_folder);
+				const auto files = Files(old_folder);
+				for (const auto child : subfolders)
+				{
+					folders_.At(&FolderChunk::parent, child) = next_folder;
+				}
+				for (const auto child : files)
+				{
+					files_.At(&FileChunk::parent, child) = next_folder;
+				}
+				if (auto rows = file_capacity_.extract(old_folder))
+				{
+					rows.key() = next_folder;
+					file_capacity_.insert(std::move(rows));
+				}
+
+				// The histogram row moves along with the children.
+				histogram += FolderHistogram(old_folder);
+				folders_.At(&FolderChunk::histogram, next_folder) = FolderHistogramRow(old_folder);
+
+				const auto old_totals = FolderTotals(old_folder);
+				LinkChildren(next_folder, { *subfolders.begin(), static_cast<std::uint32_t>(subfolders.size()), *files.begin(), static_cast<std::uint32_t>(files.size()), old_totals, FolderModified(old_folder), 0 });
+				totals += old_totals;
+				result.relocated.emplace_back(old_folder, next_folder);
+			}
+			next_folder++;
+		}
+
+		if (!same_folders)
+		{
+			for (const auto& [name, old_folder] : old_subfolders)
+			{
+				ReleaseLinks(old_folder, true);
+				file_capacity_.erase(old_folder);
+				result.removed.push_back(old_folder);
+			}
+		}
+
+		histogram += FilesHistogram(id_range(first_file, first_file + file_num));
+		SetHistogram(folder, folder_num > 0 ? &histogram : nullptr);
+		LinkChildren(folder, { first_folder, folder_num, first_file, file_num, totals, listing.modified, 0 });
+
+		// Indexed once the ranges are set, so the index sees them in use. Nodes indexed before under the same
+		// parent and name are only added once.
+		for (auto file = first_file; file < first_file + file_num; file++)
+		{
+			IndexFile(file);
+		}
+		if (!same_folders)
+		{
+			for (const auto subfolder : SubFolders(folder))
+			{
+				IndexFolder(subfolder);
+			}
+			for (const auto& [old_folder, new_folder] : result.relocated)
+			{
+				for (const auto child : SubFolders(new_folder)) IndexFolder(child);
+				for (const auto child : Files(new_folder)) IndexFile(child);
+			}
+		}
+		return result;
+	}
+
+	bool FilesystemTree::UpdateFile(FileId file, std::uintmax_t size, std::uintmax_t allocated, const file_times& times, const inode_key* key)
+	{
+		const auto link = FileLink(file);
+		if (key ? link == no_link || !(LinkKey(link) == *key) : link != no_link) return false;
+
+		const auto owner = OwnsInode(file);
+		const auto file_totals = [&]() { return subtree_totals{ FileSize(file), owner ? FileSize(file) : 0, owner ? FileAllocated(file) : 0, 1 }; };
+		const auto old_totals = file_totals();
+		const auto old_histogram = FilesHistogram(id_range(file, file + 1));
+
+		files_.At(&FileChunk::size, file) = size;
+		files_.At(&FileChunk::allocated, file) = allocated;
+		files_.At(&FileChunk::accessed, file) = StoredTime(times.accessed);
+		files_.At(&FileChunk::modified, file) = StoredTime(times.modified);
+		files_.At(&FileChunk::changed, file) = StoredTime(times.changed);
+
+		// Unsigned wrap-around makes adding the difference work for shrinking files too.
+		const auto new_totals = file_totals();
+		const subtree_totals difference{ new_totals.size - old_totals.size, new_totals.unique_size - old_totals.unique_size, new_totals.allocated - old_totals.allocated, 0 };
+		const auto histogram_difference = FilesHistogram(id_range(file, file + 1)) - old_histogram;
+		for (auto folder = FileParent(file); folder != invalid_folder; folder = FolderParent(folder))
+		{
+			AddTotals(folder, difference);
+			// A folder without subfolders sums its histogram from its files when asked.
+			if (FolderHistogramRow(folder) != no_histogram) AddHistogram(folder, histogram_difference);
+		}
+		return true;
+	}
+
+	void FilesystemTree::FinishSubtrees(std::span<const FolderId> roots, FolderId first)
+	{
+		// Children always have bigger ids than their parents, so walking the ids backwards visits every folder
+		// after all of its descendants.
+		for (auto folder = FolderNum(); folder-- > first;)
+		{
+			AddTotals(FolderParent(folder), FolderTotals(folder));
+			AddHistogram(FolderParent(folder), FolderHistogram(folder));
+			folders_.At(&FolderChunk::pending, folder).store(0, std::memory_order_relaxed);
+		}
+
+		for (const auto root : roots)
+		{
+			folders_.At(&FolderChunk::pending, root).store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void FilesystemTree::AddTotals(FolderId folder, const subtree_totals& totals)
+	{
+		folders_.At(&FolderChunk::size, folder).fetch_add(totals.size, std::memory_order_relaxed);
+		folders_.At(&FolderChunk::unique_size, folder).fetch_add(totals.unique_size, std::memory_order_relaxed);
+		folders_.At(&FolderChunk::allocated, folder).fetch_add(totals.allocated, std::memory_order_relaxed);
+		folders_.At(&FolderChunk::entries, folder).fetch_add(totals.entries, std::memory_order_relaxed);
+	}
+
+	void FilesystemTree::PropagateChange(FolderId folder, const subtree_totals& old_totals, const subtree_histogram& old_histogram)
+	{
+		// Unsigned wrap-around makes adding the difference work for shrinking folders too.
+		const auto totals = FolderTotals(folder);
+		const subtree_totals difference{ totals.size - old_totals.size, totals.unique_size - old_totals.unique_size, totals.allocated - old_totals.allocated, totals.entries - old_totals.entries };
+		const auto histogram_difference = FolderHistogram(folder) - old_histogram;
+		for (auto parent = FolderParent(folder); parent != invalid_folder; parent = FolderParent(parent))
+		{
+			AddTotals(parent, difference);
+			AddHistogram(parent, histogram_difference);
+		}
+	}
+
+	std::uint32_t FilesystemTree::FolderHistogramRow(FolderId folder) const
+	{
+		if (snapshot_) return snapshot_->folder_histogram[folder];
+		return folders_.At(&FolderChunk::histogram, folder);
+	}
+
+	subtree_histogram FilesystemTree::FilesHistogram(id_range files) const
+	{
+		subtree_histogram histogram;
+		for (const auto file : files)
+		{
+			const auto times = FileTimes(file);
+			histogram.Add(AgeBucket(scan_time_ - std::max(times.accessed, times.modified)), FileSize(file));
+		}
+		return histogram;
+	}
+
+	void FilesystemTree::SetHistogram(FolderId folder, const subtree_histogram* histogram)
+	{
+		auto& row = folders_.At(&FolderChunk::histogram, folder);
+		if (!histogram)
+		{
+			row = no_histogram;
+			return;
+		}
+
+		if (row == no_histogram) row = histograms_.Allocate(1);
+		for (std::uint32_t i = 0; i < age_bucket_num; i++)
+		{
+			histograms_.At(&HistogramChunk::age_files, row)[i].store(histogram->age_files[i], std::memory_order_relaxed);
+			histograms_.At(&HistogramChunk::age_bytes, row)[i].store(histogram->age_bytes[i], std::memory_order_relaxed);
+		}
+		for (std::uint32_t i = 0; i < size_bucket_num; i++)
+		{
+			histograms_.At(&HistogramChunk::size_files, row)[i].store(histogram->size_files[i], std::memory_order_relaxed);
+			histograms_.At(&HistogramChunk::size_bytes, row)[i].store(histogram->size_bytes[i], std::memory_order_relaxed);
+		}
+	}
+
+	void FilesystemTree::AddHistogram(FolderId folder, const subtree_histogram& histogram)
+	{
+		// Most subtrees only fill a few buckets, the empty ones aren't worth an atomic add.
+		const auto row = folders_.At(&FolderChunk::histogram, folder);
+		const auto add = [](auto& counter, const auto value)
+		{
+			if (value != 0) counter.fetch_add(value, std::memory_order_relaxed);
+		};
+		for (std::uint32_t i = 0; i < age_bucket_num; i++)
+		{
+			add(histograms_.At(&HistogramChunk::age_files, row)[i], histogram.age_files[i]);
+			add(histograms_.At(&HistogramChunk::age_bytes, row)[i], histogram.age_bytes[i]);
+		}
+		for (std::uint32_t i = 0; i < size_bucket_num; i++)
+		{
+			add(histograms_.At(&HistogramChunk::size_files, row)[i], histogram.size_files[i]);
+			add(histograms_.At(&HistogramChunk::size_bytes, row)[i], histogram.size_bytes[i]);
+		}
+	}
+
+	void FilesystemTree::ClearOrders()
+	{
+		std::unique_lock lock(order_mutex_);
+		for (auto& orders : folder_orders_) orders.clear();
+		for (auto& orders : file_orders_) orders.clear();
+	}
+
+	void FilesystemTree::Save(const std::filesystem::path& path) const
+	{
+		// The columns are read from that file while writing, and Windows can't replace a mapped file anyway.
+		std::error_code error;
+		if (snapshot_ && std::filesystem::equivalent(path, snapshot_->Path(), error))
+		{
+			throw std::runtime_error("Can't save over the snapshot that is open: " + path.string());
+		}
+
+		const auto& root_path = root_path_.native();
+
+		snapshot_header header{};
+		std::copy(std::begin(snapshot_header::expected_magic), std::end(snapshot_header::expected_magic), header.magic);
+		header.version = snapshot_header::current_version;
+		header.char_size = sizeof(native_char);
+		header.folder_num = FolderNum();
+		header.file_num = FileNum();
+		header.name_num = snapshot_ ? static_cast<std::uint32_t>(snapshot_->name_length.size()) : names_.IdNum();
+		header.unique_name_num = static_cast<std::uint32_t>(UniqueNameNum());
+		header.root_path_length = root_path.size();
+		header.link_num = LinkNum();
+		header.scan_time = scan_time_;
+		for (NameId name = 0; name < header.name_num; name++)
+		{
+			header.name_chars += Name(name).size();
+		}
+
+		// Only folders with subfolders have a histogram row, numbered anew from 1 since rows of replaced folders
+		// can be left over.
+		std::vector<FolderId> histogram_folders{ invalid_folder };
+		for (FolderId folder = 0; folder < header.folder_num; folder++)
+		{
+			if (FolderHistogramRow(folder) != no_histogram) histogram_folders.push_back(folder);
+		}
+		header.histogram_num = histogram_folders.size();
+
+		const snapshot_layout layout(header);
+		SnapshotWriter writer(path, header);
+
+		writer.Write(layout.root_path, std::span<const native_char>(root_path.data(), root_path.size()));
+
+		writer.Column(layout.folder_name, header.folder_num, [this](FolderId id) { return FolderNameId(id); });
+		writer.Column(layout.folder_parent, header.folder_num, [this](FolderId id) { return FolderParent(id); });
+		// A snapshot's rows are copied as they are, the children of replaced rows don't point back at them anymore.
+		writer.Column(layout.folder_first_folder, header.folder_num, [this](FolderId id) { return snapshot_ ? snapshot_->folder_first_folder[id] : *SubFolders(id).begin(); });
+		writer.Column(layout.folder_folder_num, header.folder_num, [this](FolderId id) { return snapshot_ ? snapshot_->folder_folder_num[id] : static_cast<std::uint32_t>(SubFolders(id).size()); });
+		writer.Column(layout.folder_first_file, header.folder_num, [this](FolderId id) { return snapshot_ ? snapshot_->folder_first_file[id] : *Files(id).begin(); });
+		writer.Column(layout.folder_file_num, header.folder_num, [this](FolderId id) { return snapshot_ ? snapshot_->folder_file_num[id] : static_cast<std::uint32_t>(Files(id).size()); });
+		writer.Column(layout.folder_size, header.folder_num, [this](FolderId id) { return static_cast<std::uint64_t>(FolderSize(id)); });
+		writer.Column(layout.folder_unique_size, header.folder_num, [this](FolderId id) { return static_cast<std::uint64_t>(FolderUniqueSize(id)); });
+		writer.Column(layout.folder_allocated, header.folder_num, [this](FolderId id) { return static_cast<std::uint64_t>(FolderAllocated(id)); });
+		writer.Column(layout.folder_entries, header.folder_num, [this](FolderId id) { return FolderEntries(id); });
+		writer.Column(layout.folder_modified, header.folder_num, [this](FolderId id) { return FolderModified(id); });
+		std::uint32_t histogram_row = 0;
+		writer.Column(layout.folder_histogram, header.folder_num, [&](FolderId id) { return FolderHistogramRow(id) != no_histogram ? ++histogram_row : no_histogram; });
+
+		writer.Column(layout.file_name, header.file_num, [this](FileId id) { return FileNameId(id); });
+		writer.Column(layout.file_parent, header.file_num, [this](FileId id) { return FileParent(id); });
+		writer.Column(layout.file_size, header.file_num, [this](FileId id) { return static_cast<std::uint64_t>(FileSize(id)); });
+		writer.Column(layout.file_allocated, header.file_num, [this](FileId id) { return static_cast<std::uint64_t>(FileAllocated(id)); });
+		writer.Column(layout.file_link, header.file_num, [this](FileId id) { return FileLink(id); });
+		writer.Column(layout.file_accessed, header.file_num, [this](FileId id) { return StoredTime(FileTimes(id).accessed); });
+		writer.Column(layout.file_modified, header.file_num, [this](FileId id) { return StoredTime(FileTimes(id).modified); });
+		writer.Column(layout.file_changed, header.file_num, [this](FileId id) { return StoredTime(FileTimes(id).changed); });
+
+		const auto link_num = static_cast<std::uint32_t>(header.link_num);
+		writer.Column(layout.link_device, link_num, [this](LinkId id) { return LinkKey(id).device; });
+		writer.Column(layout.link_inode, link_num, [this](LinkId id) { return LinkKey(id).inode; });
+		writer.Column(layout.link_owner, link_num, [this](LinkId id) { return LinkOwner(id); });
+
+		writer.Column(layout.histograms, static_cast<std::uint32_t>(header.histogram_num), [&](std::uint32_t row)
+		{
+			return row != no_histogram ? FolderHistogram(histogram_folders[row]) : subtree_histogram{};
+		});
+
+		std::uint64_t name_offset = 0;
+		writer.Column(layout.name_offset, header.name_num, [&](NameId id) { const auto offset = name_offset; name_offset += Name(id).size(); return offset; });
+		writer.Column(layout.name_length, header.name_num, [this](NameId id) { return static_cast<std::uint32_t>(Name(id).size()); });
+		name_offset = 0;
+		for (NameId name = 0; name < header.name_num; name++)
+		{
+			const auto view = Name(name);
+			writer.Write(layout.name_chars + name_offset * sizeof(native_char), std::span<const native_char>(view.data(), view.size()));
+			name_offset += view.size();
+		}
+
+		writer.Finish(layout.total_size);
+	}
+
+	std::uint32_t FilesystemTree::FolderNum() const
+	{
+		if (snapshot_) return static_cast<std::uint32_t>(snapshot_->folder_parent.size());
+		return folders_.Size();
+	}
+
+	std::uint32_t FilesystemTree::FileNum() const
+	{
+		if (snapshot_) return static_cast<std::uint32_t>(snapshot_->file_parent.size());
+		return files_.Size();
+	}
+
+	std::uint64_t FilesystemTree::UniqueNameNum() const
+	{
+		if (snapshot_) return snapshot_->UniqueNameNum();
+		return names_.UniqueNum();
+	}
+
+	std::uint32_t FilesystemTree::LinkNum() const
+	{
+		if (snapshot_) return static_cast<std::uint32_t>(snapshot_->link_owner.size());
+		return links_.Size();
+	}
+
+	std::int64_t FilesystemTree::ScanTime() const
+	{
+		return scan_time_;
+	}
+
+	NameId FilesystemTree::FolderNameId(FolderId folder) const
+	{
+		if (snapshot_) return snapshot_->folder_name[folder];
+		return folders_.At(&FolderChunk::name, folder);
+	}
+
+	NameId FilesystemTree::FileNameId(FileId file) const
+	{
+		if (snapshot_) return snapshot_->file_name[file];
+		return files_.At(&FileChunk::name, file);
+	}
+
+	native_string_view FilesystemTree::Name(NameId name) const
+	{
+		if (snapshot_) return snapshot_->Name(name);
+		return names_.Get(name);
+	}
+
+	LinkId FilesystemTree::FileLink(FileId file) const
+	{
+		if (snapshot_) return snapshot_->file_link[file];
+		return files_.At(&FileChunk::link, file);
+	}
+
+	inode_key FilesystemTree::LinkKey(LinkId link) const
+	{
+		if (snapshot_) return { snapshot_->link_device[link], snapshot_->link_inode[link] };
+		return links_.Key(link);
+	}
+
+	FileId FilesystemTree::LinkOwner(LinkId link) const
 	{
-		return root_.get();
+		if (snapshot_) return snapshot_->link_owner[link];
+		return links_.Owner(link);
 	}
-	void FilesystemTree::AddFile(File* file)
+
+	bool FilesystemTree::OwnsInode(FileId file) const
 	{
+		const auto link = FileLink(file);
+		return link == no_link || LinkOwner(link) == file;
+	}
 
+	native_string_view FilesystemTree::FolderName(FolderId folder) const
+	{
+		return Name(FolderNameId(folder));
 	}
-	void FilesystemTree::AddFolder(Folder* file)
+
+	FolderId FilesystemTree::FolderParent(FolderId folder) const
 	{
+		if (snapshot_) return snapshot_->folder_parent[folder];
+		return folders_.At(&FolderChunk::parent, folder);
 	}
-	std::optional<Folder*> FilesystemTree::GetFolder(std::string_view path)
+
+	std::uintmax_t FilesystemTree::FolderSize(FolderId folder) const
+	{
+		if (snapshot_) return snapshot_->folder_size[folder];
+		return folders_.At(&FolderChunk::size, folder).load(std::memory_order_relaxed);
+	}
+
+	std::uintmax_t FilesystemTree::FolderUniqueSize(FolderId folder) const
+	{
+		if (snapshot_) return snapshot_->folder_unique_size[folder];
+		return folders_.At(&FolderChunk::unique_size, folder).load(std::memory_order_relaxed);
+	}
+
+	std::uintmax_t FilesystemTree::FolderAllocated(FolderId folder) const
+	{
+		if (snapshot_) return snapshot_->folder_allocated[folder];
+		return folders_.At(&FolderChunk::allocated, folder).load(std::memory_order_relaxed);
+	}
+
+	std::uintmax_t FilesystemTree::FolderSize(FolderId folder, size_kind kind) const
+	{
+		return kind == size_kind::allocated ? FolderAllocated(folder) : FolderSize(folder);
+	}
+
+	std::uint64_t FilesystemTree::FolderEntries(FolderId folder) const
 	{
-		return std::optional<Folder*>();
+		if (snapshot_) return snapshot_->folder_entries[folder];
+		return folders_.At(&FolderChunk::entries, folder).load(std::memory_order_relaxed);
 	}
-	std::optional<File*> FilesystemTree::GetFile(std::string_view path)
+
+	subtree_totals FilesystemTree::FolderTotals(FolderId folder) const
+	{
+		return { FolderSize(folder), FolderUniqueSize(folder), FolderAllocated(folder), FolderEntries(folder) };
+	}
+
+	std::uint64_t FilesystemTree::FolderModified(FolderId folder) const
+	{
+		if (snapshot_) return snapshot_->folder_modified[folder];
+		return folders_.At(&FolderChunk::modified, folder);
+	}
+
+	subtree_histogram FilesystemTree::FolderHistogram(FolderId folder) const
+	{
+		if (!FolderLoaded(folder)) return {};
+
+		const auto row = FolderHistogramRow(folder);
+		if (row == no_histogram) return FilesHistogram(Files(folder));
+		if (snapshot_) return snapshot_->histograms[row];
+
+		subtree_histogram histogram;
+		for (std::uint32_t i = 0; i < age_bucket_num; i++)
+		{
+			histogram.age_files[i] = histograms_.At(&HistogramChunk::age_files, row)[i].load(std::memory_order_relaxed);
+			histogram.age_bytes[i] = histograms_.At(&HistogramChunk::age_bytes, row)[i].load(std::memory_order_relaxed);
+		}
+		for (std::uint32_t i = 0; i < size_bucket_num; i++)
+		{
+			histogram.size_files[i] = histograms_.At(&HistogramChunk::size_files, row)[i].load(std::memory_order_relaxed);
+			histogram.size_bytes[i] = histograms_.At(&HistogramChunk::size_bytes, row)[i].load(std::memory_order_relaxed);
+		}
+		return histogram;
+	}
+
+	bool FilesystemTree::FolderLoaded(FolderId folder) const
+	{
+		return snapshot_ || folders_.At(&FolderChunk::loaded, folder).load(std::memory_order_acquire);
+	}
+
+	bool FilesystemTree::FolderComplete(FolderId folder) const
+	{
+		// Subfolders add their totals before they stop being pending, so these are final once pending is zero.
+		return FolderLoaded(folder) && (snapshot_ || folders_.At(&FolderChunk::pending, folder).load(std::memory_order_acquire) == 0);
+	}
+
+	subtree_progress FilesystemTree::FolderProgress(FolderId folder) const
+	{
+		if (FolderComplete(folder)) return { FolderTotals(folder), true };
+
+		// An incomplete folder's own total already contains some finished subfolders, so the walk sums the files
+		// and the finished subfolders of every incomplete folder itself instead.
+		subtree_progress progress;
+		std::vector<FolderId> stack{ folder };
+		while (!stack.empty())
+		{
+			const auto current = stack.back();
+			stack.pop_back();
+
+			for (const auto file : Files(current))
+			{
+				const auto owned = OwnsInode(file);
+				progress += { FileSize(file), owned ? FileSize(file) : 0, owned ? FileAllocated(file) : 0, 1 };
+			}
+			for (const auto subfolder : SubFolders(current))
+			{
+				progress.entries++;
+				if (FolderComplete(subfolder))
+				{
+					progress += FolderTotals(subfolder);
+				}
+				else
+				{
+					stack.push_back(subfolder);
+				}
+			}
+		}
+		return progress;
+	}
+
+	id_range FilesystemTree::SubFolders(FolderId folder) const
+	{
+		if (snapshot_)
+		{
+			const auto [first, num] = snapshot_->SubFolders(folder);
+			return id_range(first, first + num);
+		}
+		if (!FolderLoaded(folder)) return id_range();
+		const auto first = folders_.At(&FolderChunk::first_folder, folder);
+		return id_range(first, first + folders_.At(&FolderChunk::folder_num, folder));
+	}
+
+	id_range FilesystemTree::Files(FolderId folder) const
+	{
+		if (snapshot_)
+		{
+			const auto [first, num] = snapshot_->Files(folder);
+			return id_range(first, first + num);
+		}
+		if (!FolderLoaded(folder)) return id_range();
+		const auto first = folders_.At(&FolderChunk::first_file, folder);
+		return id_range(first, first + folders_.At(&FolderChunk::file_num, folder));
+	}
+
+	std::filesystem::path FilesystemTree::FolderPath(FolderId folder) const
+	{
+		std::vector<native_string_view> names;
+		for (; folder != GetRoot(); folder = FolderParent(folder))
+		{
+			names.push_back(FolderName(folder));
+		}
+
+		auto path = root_path_;
+		for (auto name = names.rbegin(); name != names.rend(); name++)
+		{
+			path /= *name;
+		}
+		return path;
+	}
+
+	display_info FilesystemTree::FolderDisplayInfo(FolderId folder) const
 	{
-		return std::optional<File*>();
+		return display_info(FolderName(folder), FolderSize(folder));
+	}
+
+	native_string_view FilesystemTree::FileName(FileId file) const
+	{
+		return Name(FileNameId(file));
+	}
+
+	FolderId FilesystemTree::FileParent(FileId file) const
+	{
+		if (snapshot_) return snapshot_->file_parent[file];
+		return files_.At(&FileChunk::parent, file);
+	}
+
+	std::uintmax_t FilesystemTree::FileSize(FileId file) const
+	{
+		if (snapshot_) return snapshot_->file_size[file];
+		return files_.At(&FileChunk::size, file);
+	}
+
+	std::uintmax_t FilesystemTree::FileUniqueSize(FileId file) const
+	{
+		return OwnsInode(file) ? FileSize(file) : 0;
+	}
+
+	std::uintmax_t FilesystemTree::FileAllocated(FileId file) const
+	{
+		if (snapshot_) return snapshot_->file_allocated[file];
+		return files_.At(&FileChunk::allocated, file);
+	}
+
+	file_times FilesystemTree::FileTimes(FileId file) const
+	{
+		if (snapshot_) return { snapshot_->file_accessed[file], snapshot_->file_modified[file], snapshot_->file_changed[file] };
+		return { files_.At(&FileChunk::accessed, file), files_.At(&FileChunk::modified, file), files_.At(&FileChunk::changed, file) };
+	}
+
+	std::uintmax_t FilesystemTree::FileSize(FileId file, size_kind kind) const
+	{
+		return kind == size_kind::allocated ? FileAllocated(file) : FileSize(file);
+	}
+
+	std::filesystem::path FilesystemTree::FilePath(FileId file) const
+	{
+		return FolderPath(FileParent(file)) / FileName(file);
+	}
+
+	display_info FilesystemTree::FileDisplayInfo(FileId file) const
+	{
+		return display_info(FileName(file), FileSize(file));
+	}
+
+	template<typename Size>
+	std::span<const std::uint32_t> FilesystemTree::Order(std::unordered_map<FolderId, child_order>& orders, FolderId folder, id_range children, std::uint32_t limit, Size size)
+	{
+		std::unique_lock lock(order_mutex_);
+
+		auto& order = orders[folder];
+		if (order.ids.empty())
+		{
+			order.ids.assign(children.begin(), children.end());
+		}
+
+		const auto count = std::min<std::size_t>(limit, order.ids.size());
+		if (count > order.sorted)
+		{
+			const auto bigger = [&](const auto lhs, const auto rhs) { return size(lhs) > size(rhs); };
+			const auto unsorted = std::span(order.ids).subspan(order.sorted);
+
+			// Top-K requests that need a small part of the folder only select and sort that part.
+			if (count < order.ids.size() / 2)
+			{
+				std::partial_sort(unsorted.begin(), unsorted.begin() + (count - order.sorted), unsorted.end(), bigger);
+				order.sorted = count;
+			}
+			else
+			{
+				ParallelSort(unsorted, bigger);
+				order.sorted = order.ids.size();
+			}
+		}
+
+		return std::span<const std::uint32_t>(order.ids).first(count);
+	}
+
+	std::span<const FolderId> FilesystemTree::SortedSubFolders(FolderId folder, std::uint32_t limit, size_kind kind)
+	{
+		return Order(folder_orders_[static_cast<int>(kind)], folder, SubFolders(folder), limit, [this, kind](const FolderId id) { return FolderSize(id, kind); });
+	}
+
+	std::span<const FileId> FilesystemTree::SortedFiles(FolderId folder, std::uint32_t limit, size_kind kind)
+	{
+		return Order(file_orders_[static_cast<int>(kind)], folder, Files(folder), limit, [this, kind](const FileId id) { return FileSize(id, kind); });
+	}
+
+	void FilesystemTree::IndexFolder(FolderId folder) const
+	{
+		const auto hash_of = [this](FolderId id) { return PathIndex::Hash(FolderParent(id), FolderName(id)); };
+		const auto live = [this](FolderId id)
+		{
+			const auto parent = FolderParent(id);
+			return parent == invalid_folder || InRange(SubFolders(parent), id);
+		};
+		folder_index_.Add(hash_of(folder), folder, hash_of, live);
+	}
+
+	void FilesystemTree::IndexFile(FileId file) const
+	{
+		const auto hash_of = [this](FileId id) { return PathIndex::Hash(FileParent(id), FileName(id)); };
+		const auto live = [this](FileId id) { return InRange(Files(FileParent(id)), id); };
+		file_index_.Add(hash_of(file), file, hash_of, live);
+	}
+
+	std::optional<FolderId> FilesystemTree::FindSubFolder(FolderId folder, native_string_view name) const
+	{
+		// Replaced children stay in the index, only the ones in the folder's current range count.
+		const auto subfolders = SubFolders(folder);
+		if (snapshot_)
+		{
+			const auto found = std::ranges::find_if(subfolders, [&](FolderId id) { return FolderName(id) == name; });
+			return found != subfolders.end() ? std::optional<FolderId>(*found) : std::nullopt;
+		}
+
+		const auto found = folder_index_.Find(PathIndex::Hash(folder, name), [&](FolderId id)
+		{
+			return id >= *subfolders.begin() && id < *subfolders.end() && FolderName(id) == name;
+		});
+		return found != PathIndex::no_entry ? std::optional<FolderId>(found) : std::nullopt;
+	}
+
+	std::optional<FileId> FilesystemTree::FindFile(FolderId folder, native_string_view name) const
+	{
+		const auto files = Files(folder);
+		if (snapshot_)
+		{
+			const auto found = std::ranges::find_if(files, [&](FileId id) { return FileName(id) == name; });
+			return found != files.end() ? std::optional<FileId>(*found) : std::nullopt;
+		}
+
+		const auto found = file_index_.Find(PathIndex::Hash(folder, name), [&](FileId id)
+		{
+			return id >= *files.begin() && id < *files.end() && FileName(id) == name;
+		});
+		return found != PathIndex::no_entry ? std::optional<FileId>(found) : std::nullopt;
+	}
+
+	std::optional<std::vector<std::filesystem::path>> FilesystemTree::RootRelativeNames(const std::filesystem::path& path) const
+	{
+		auto relative = path.lexically_normal();
+		if (relative.has_root_path())
+		{
+			relative = relative.lexically_relative(root_path_.lexically_normal());
+			if (relative.empty()) return std::nullopt;
+		}
+
+		std::vector<std::filesystem::path> names;
+		for (const auto& name : relative)
+		{
+			// Only a leading ".." is left after normalizing, and it leads out of the tree.
+			if (name == "..") return std::nullopt;
+			if (name.empty() || name == ".") continue;
+			names.push_back(name);
+		}
+		return names;
+	}
+
+	std::optional<FolderId> FilesystemTree::GetFolder(const std::filesystem::path& path) const
+	{
+		const auto names = RootRelativeNames(path);
+		if (!names) return std::nullopt;
+
+		std::optional<FolderId> folder = GetRoot();
+		for (auto name = names->begin(); name != names->end() && folder; name++)
+		{
+			folder = FindSubFolder(*folder, name->native());
+		}
+		return folder;
+	}
+
+	std::optional<FileId> FilesystemTree::GetFile(const std::filesystem::path& path) const
+	{
+		const auto names = RootRelativeNames(path);
+		if (!names || names->empty()) return std::nullopt;
+
+		std::optional<FolderId> folder = GetRoot();
+		for (auto name = names->begin(); name + 1 != names->end() && folder; name++)
+		{
+			folder = FindSubFolder(*folder, name->native());
+		}
+		return folder ? FindFile(*folder, names->back().native()) : std::nullopt;
 	}
-}
\ No newline at end of file
+}
@@ -1,34 +1,302 @@
 #ifndef FILESYSTEM_FILESYSTEM_TREE_H
 #define FILESYSTEM_FILESYSTEM_TREE_H
 
+#include "Arena.h"
+#include "DirectoryReader.h"
 #include "Folder.h"
 #include "File.h"
+#include "Histogram.h"
+#include "InodeSet.h"
+#include "NamePool.h"
+#include "PathIndex.h"
+#include "Snapshot.h"
 
 #include <algorithm>
 #include <filesystem>
+#include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace fs_tree
 {
+	using id_range = std::ranges::iota_view<std::uint32_t, std::uint32_t>;
+
+	constexpr std::uint32_t all_children = std::numeric_limits<std::uint32_t>::max();
+
+	// Totals of a subtree. 'unique_size' counts the size of every hard-linked inode once, at its owner, and
+	// 'allocated' is the space the subtree occupies on disk (like du), with hard links counted the same way.
+	struct subtree_totals
+	{
+		std::uintmax_t size = 0;
+		std::uintmax_t unique_size = 0;
+		std::uintmax_t allocated = 0;
+		std::uint64_t entries = 0;
+
+		subtree_totals& operator+=(const subtree_totals& other)
+		{
+			size += other.size;
+			unique_size += other.unique_size;
+			allocated += other.allocated;
+			entries += other.entries;
+			return *this;
+		}
+	};
+
+	// Which size of files and folders orders listings.
+	enum class size_kind : std::uint8_t
+	{
+		// The logical size, what reading the files would return.
+		apparent,
+		// The blocks occupied on disk.
+		allocated
+	};
+
+	// Totals of a subtree, see FilesystemTree::FolderProgress.
+	struct subtree_progress : subtree_totals
+	{
+		bool complete = false;
+	};
+
+	// What FilesystemTree::RelinkChildren did to the subfolders of a folder.
+	struct relink_result
+	{
+		// New subfolders without any children yet.
+		std::vector<FolderId> added;
+		// Subfolders that are still there, moved to a new id together with their children (old id, new id).
+		std::vector<std::pair<FolderId, FolderId>> relocated;
+		// Subfolders that are gone, with everything below them.
+		std::vector<FolderId> removed;
+	};
+
+	// Owns every folder, file and name of a scan in a few chunked arrays (see ChunkedTable). Nodes are addressed
+	// by 32-bit ids, only the last path component is stored and full paths are rebuilt from the parent links.
+	//
+	// A tree can also be opened from a snapshot written by Save. It then reads the nodes straight from the mapped
+	// file and can't be loaded into.
 	class FilesystemTree
 	{
 	private:
-		std::unique_ptr<Folder> root_;
+		std::filesystem::path root_path_;
+
+		ChunkedTable<FolderChunk> folders_;
+		ChunkedTable<FileChunk> files_;
+		ChunkedTable<HistogramChunk> histograms_;
+		NamePool names_;
+		InodeSet links_;
+
+		// Seconds since 1970 when the tree was created, the ages of the histograms are relative to it.
+		std::int64_t scan_time_;
+
+		std::unique_ptr<Snapshot> snapshot_;
+
+		// Children by (parent, name), filled in as folders are loaded. Trees opened from a snapshot don't have them,
+		// they look through the children of the one folder instead (see FindSubFolder).
+		mutable PathIndex folder_index_;
+		mutable PathIndex file_index_;
+
+		// File rows RelinkChildren left to folders whose files shrank, for when they grow again.
+		std::unordered_map<FolderId, std::uint32_t> file_capacity_;
+
+		NameId FolderNameId(FolderId folder) const;
+		NameId FileNameId(FileId file) const;
+		native_string_view Name(NameId name) const;
+		LinkId FileLink(FileId file) const;
+		inode_key LinkKey(LinkId link) const;
+		FileId LinkOwner(LinkId link) const;
+		// True if the file's size counts towards unique sizes: it has a single link or owns its inode.
+		bool OwnsInode(FileId file) const;
+
+		// Fills in the row of a new file and returns what it adds to the totals of its folder. 'key' is the file's
+		// inode if it has other links, nullptr otherwise.
+		subtree_totals SetFile(FileId file, FolderId folder, NameId name, std::uintmax_t size, std::uintmax_t allocated, const file_times& times, const inode_key* key);
+		// Releases the inodes owned by the files of 'folder', or of its whole subtree, see InodeSet::Release.
+		void ReleaseLinks(FolderId folder, bool subtree);
+		void AddTotals(FolderId folder, const subtree_totals& totals);
+
+		std::uint32_t FolderHistogramRow(FolderId folder) const;
+		subtree_histogram FilesHistogram(id_range files) const;
+		// Stores the histogram of a folder with subfolders in its row, allocating one if it has none yet; nullptr
+		// drops the row of a folder that has no subfolders anymore. Call before the folder is linked.
+		void SetHistogram(FolderId folder, const subtree_histogram* histogram);
+		void AddHistogram(FolderId folder, const subtree_histogram& histogram);
+
+		// Adds a node whose name and parent are set to the path index.
+		void IndexFolder(FolderId folder) const;
+		void IndexFile(FileId file) const;
+		// The names of the folders from the root down to 'path' (see GetFolder), nothing if it's outside the tree.
+		std::optional<std::vector<std::filesystem::path>> RootRelativeNames(const std::filesystem::path& path) const;
+
+		// Everything LinkChildren sets for a folder.
+		struct folder_link
+		{
+			FolderId first_folder;
+			std::uint32_t folder_num;
+			FileId first_file;
+			std::uint32_t file_num;
+			subtree_totals totals;
+			std::uint64_t modified;
+			std::uint32_t pending;
+		};
+
+		// Fills in the children columns of 'folder' and publishes them to concurrent readers.
+		id_range LinkChildren(FolderId folder, const folder_link& link);
+
+		// Children ordered by size, biggest first, for the folders that have been listed. Only the first 'sorted'
+		// ids are in their final order, the rest are all smaller and get sorted once somebody asks for them.
+		struct child_order
+		{
+			std::vector<std::uint32_t> ids;
+			std::size_t sorted = 0;
+		};
+
+		std::mutex order_mutex_;
+		std::unordered_map<FolderId, child_order> folder_orders_[2];
+		std::unordered_map<FolderId, child_order> file_orders_[2];
+
+		template<typename Size>
+		std::span<const std::uint32_t> Order(std::unordered_map<FolderId, child_order>& orders, FolderId folder, id_range children, std::uint32_t limit, Size size);
 
 	public:
-		FilesystemTree(const std::filesystem::path& root_path) : root_(std::move(std::make_unique<Folder>(root_path))) 
+		// Per-loader-thread state for adding nodes.
+		struct Writer
 		{
-		
+			NamePool::Writer names;
 		};
-		Folder* GetRoot() const;
 
-		void AddFile(File* file);
-		void AddFolder(Folder* file);
-		std::optional<Folder*> GetFolder(std::string_view path);
-		std::optional<File*> GetFile(std::string_view path);
+		FilesystemTree(const std::filesystem::path& root_path);
+		explicit FilesystemTree(std::unique_ptr<Snapshot> snapshot);
+		FilesystemTree(const FilesystemTree&) = delete;
+		FilesystemTree& operator=(const FilesystemTree&) = delete;
+
+		FolderId GetRoot() const;
+		// True for trees opened from a snapshot, those can't be changed.
+		bool ReadOnly() const;
+		const std::filesystem::path& GetRootPath() const;
+
+		Writer CreateWriter();
+
+		// Adds the entries of 'listing' as the children of 'folder', which must not have any yet. Returns the range
+		// of the new subfolders. Different folders can be filled from different threads at the same time.
+		id_range AddChildren(Writer& writer, FolderId folder, const directory_listing& listing);
+
+		// Like AddChildren, but copies the files and subfolders of 'previous_folder' from an earlier scan instead
+		// of reading them. The n-th new subfolder is a copy of the n-th subfolder of 'previous_folder', only their
+		// own children are left to be added.
+		id_range CopyChildren(Writer& writer, FolderId folder, const FilesystemTree& previous, FolderId previous_folder);
+
+		// Called once per folder after AddChildren (or instead of it when the folder couldn't be read). When the
+		// folder has no subfolders its size and entry count are final: they are added to the parent, and every
+		// ancestor whose last pending subfolder this was is finished the same way, so totals are complete as soon as
+		// loading ends.
+		void FinishFolder(FolderId folder);
+
+		// Updates a loaded 'folder' to a fresh 'listing' of it: its files are replaced, subfolders that are still
+		// there keep their subtrees and sizes, new ones are added empty and removed ones are unlinked. The new files
+		// take the rows of the old ones when they fit in the most the folder had, otherwise they get new rows. When
+		// the folder has the same subfolders as before they keep their ids; otherwise children ranges being
+		// contiguous, the kept subfolders move to new ids and the old ids become unreachable (a rescan drops them).
+		// The folder's totals are set to its files plus the kept subfolders, ancestors aren't touched (see
+		// PropagateChange). Inodes owned by the replaced files and removed subtrees are released; a link of them
+		// that survives elsewhere only counts again once its own folder is relinked. Single writer only, nothing may
+		// read the tree meanwhile.
+		relink_result RelinkChildren(Writer& writer, FolderId folder, const directory_listing& listing);
+
+		// Updates a file whose contents were written to: its size, allocated size and times, and the totals and
+		// histograms of its folder and every ancestor with them. 'key' is the file's inode if it has other links,
+		// nullptr otherwise; if that doesn't match how the file was counted, nothing is changed and false is
+		// returned, the folder has to be relinked instead. Single writer only, nothing may read the tree meanwhile.
+		bool UpdateFile(FileId file, std::uintmax_t size, std::uintmax_t allocated, const file_times& times, const inode_key* key);
+
+		// For subtrees that were loaded by a single thread with AddChildren alone, without FinishFolder: adds the
+		// totals of folders [first, FolderNum()) to their parents and marks them and 'roots' (the parents of the
+		// subtrees) finished. The totals of 'roots' aren't propagated any further.
+		void FinishSubtrees(std::span<const FolderId> roots, FolderId first);
+
+		// Adds the difference between the current totals and histogram of 'folder' and the old ones to every
+		// ancestor.
+		void PropagateChange(FolderId folder, const subtree_totals& old_totals, const subtree_histogram& old_histogram);
+
+		// Drops every cached child order, for when sizes or children changed after loading.
+		void ClearOrders();
+
+		// Writes the tree to a snapshot file that can be reopened with the Snapshot constructor, replacing 'path'
+		// only once it's complete. Call after loading has finished. Throws std::runtime_error if the file can't be
+		// written or is the snapshot this tree was opened from.
+		void Save(const std::filesystem::path& path) const;
+
+		std::uint32_t FolderNum() const;
+		std::uint32_t FileNum() const;
+		std::uint64_t UniqueNameNum() const;
+		// Number of distinct hard-linked inodes.
+		std::uint32_t LinkNum() const;
+		// When the tree was scanned (or the snapshot's tree was), in seconds since 1970.
+		std::int64_t ScanTime() const;
+
+		// Every accessor below can be used while the tree is still loading, without blocking the loaders. Until a
+		// folder is loaded it has no children, and until it's complete (loaded, with every subfolder complete) its
+		// size and entry count only include its own files and the subfolders that are complete.
+		bool FolderLoaded(FolderId folder) const;
+		bool FolderComplete(FolderId folder) const;
+
+		// Totals of everything loaded below 'folder' so far. Walks the loaded but incomplete part of the subtree,
+		// so it costs nothing for complete folders and is meant for showing progress, not for every node.
+		subtree_progress FolderProgress(FolderId folder) const;
+
+		native_string_view FolderName(FolderId folder) const;
+		FolderId FolderParent(FolderId folder) const;
+		std::uintmax_t FolderSize(FolderId folder) const;
+		std::uintmax_t FolderUniqueSize(FolderId folder) const;
+		std::uintmax_t FolderAllocated(FolderId folder) const;
+		std::uint64_t FolderEntries(FolderId folder) const;
+		subtree_totals FolderTotals(FolderId folder) const;
+		std::uint64_t FolderModified(FolderId folder) const;
+		// The files below 'folder' by age and by size (see AgeBucket and SizeBucket), complete when the folder is.
+		// Folders with subfolders keep theirs up to date like their totals, for the others it's summed from their
+		// files, so asking costs the same for any subtree.
+		subtree_histogram FolderHistogram(FolderId folder) const;
+		id_range SubFolders(FolderId folder) const;
+		id_range Files(FolderId folder) const;
+		std::filesystem::path FolderPath(FolderId folder) const;
+		display_info FolderDisplayInfo(FolderId folder) const;
+
+		native_string_view FileName(FileId file) const;
+		FolderId FileParent(FileId file) const;
+		std::uintmax_t FileSize(FileId file) const;
+		// The file's size, or zero if it's a hard link whose inode is counted at another file.
+		std::uintmax_t FileUniqueSize(FileId file) const;
+		// Bytes of the blocks the file occupies on disk, whichever link owns them.
+		std::uintmax_t FileAllocated(FileId file) const;
+		file_times FileTimes(FileId file) const;
+		// FolderSize/FileSize or FolderAllocated/FileAllocated.
+		std::uintmax_t FolderSize(FolderId folder, size_kind kind) const;
+		std::uintmax_t FileSize(FileId file, size_kind kind) const;
+		std::filesystem::path FilePath(FileId file) const;
+		display_info FileDisplayInfo(FileId file) const;
+
+		// The biggest 'limit' subfolders/files of 'folder' by the 'kind' size, biggest first. Nothing is sorted
+		// while scanning; the order is computed the first time a folder is listed and cached, asking for fewer
+		// entries than the folder has only partially sorts it. The spans stay valid as long as the tree. Call after
+		// loading has finished.
+		std::span<const FolderId> SortedSubFolders(FolderId folder, std::uint32_t limit = all_children, size_kind kind = size_kind::apparent);
+		std::span<const FileId> SortedFiles(FolderId folder, std::uint32_t limit = all_children, size_kind kind = size_kind::apparent);
+
+		// The subfolder or file of 'folder' called 'name', found through the path index in a few probes whatever
+		// the number of children. Can be used while loading: children are found once their folder is loaded. Trees
+		// opened from a snapshot compare the names of the folder's children, so only its own pages are read.
+		std::optional<FolderId> FindSubFolder(FolderId folder, native_string_view name) const;
+		std::optional<FileId> FindFile(FolderId folder, native_string_view name) const;
+
+		// The folder or file at 'path', one FindSubFolder per component. An absolute path has to be below the root
+		// path, a relative one is taken relative to the root; "." and ".." are resolved without looking at the disk.
+		std::optional<FolderId> GetFolder(const std::filesystem::path& path) const;
+		std::optional<FileId> GetFile(const std::filesystem::path& path) const;
 	};
 }
 
-#endif // !FILESYSTEM_FILESYSTEM_TREE_H
\ No newline at end of file
+#endif // !FILESYSTEM_FILESYSTEM_TREE_H
@@ -1,49 +1,42 @@
 #ifndef FS_TREE_FOLDER
 #define FS_TREE_FOLDER
 
+#include <atomic>
 #include <cstdint>
-#include <filesystem>
-#include <mutex>
-#include <memory>
-#include <optional>
-#include <vector>
 
 #include "File.h"
+#include "NamePool.h"
 
 namespace fs_tree
 {
-	class Folder;
-
-	using Folders = std::vector<std::unique_ptr<Folder>>;
-	
-	class Folder
+	// Folders of a FilesystemTree, one array per attribute. The subfolders and files of a folder occupy
+	// contiguous id ranges that are allocated when the folder is loaded, and a folder is always allocated after
+	// its parent, so every parent id is smaller than the ids of its children.
+	//
+	// 'size' starts as the total of the folder's own files and grows while its subfolders finish loading,
+	// 'unique_size' is the same with every hard-linked inode counted only for its owner (see InodeSet), 'allocated'
+	// sums the blocks on disk with the same rule for hard links, 'entries' does the same with the number of files and folders below the folder, and 'pending' is the number
+	// of subfolders that haven't finished yet. 'loaded' is set once the children columns are filled in, so other
+	// threads can read them while the tree is still loading. 'modified' is the stamp from ReadDirectoryModified,
+	// taken when the folder was read. 'histogram' is the folder's row in the histogram table, no_histogram for
+	// folders without subfolders (see HistogramChunk).
+	struct FolderChunk
 	{
-	private:
-		Files files_;
-		Folders folders_;
-		std::uintmax_t size_ = 0;
-
-		std::mutex mutex_;
-
-	public:
-		const std::filesystem::path path_;
-		Folder(const std::filesystem::path& path) : path_(path) {}
-		void AddFolder(std::unique_ptr<Folder> folder);
-		void AddFile(std::unique_ptr<File> file);
-
-		const std::uint64_t GetFolderNum() const;
-		Folders& GetFolders();
-		Files& GetFiles();
-		std::optional<std::filesystem::directory_iterator> GetDirectoryIterator();
-		void CalculateSize();
-        std::uintmax_t RecursiveCalculateSize();
-		virtual ~Folder();
-		std::uintmax_t Size() const;
-
-		display_info GetDisplayInfo() const
-		{
-			return display_info(path_, size_);
-		}
+		static constexpr std::uint32_t size_bits = 16;
+		NameId name[1 << size_bits];
+		FolderId parent[1 << size_bits];
+		FolderId first_folder[1 << size_bits];
+		std::uint32_t folder_num[1 << size_bits];
+		FileId first_file[1 << size_bits];
+		std::uint32_t file_num[1 << size_bits];
+		std::atomic<std::uintmax_t> size[1 << size_bits];
+		std::atomic<std::uintmax_t> unique_size[1 << size_bits];
+		std::atomic<std::uintmax_t> allocated[1 << size_bits];
+		std::atomic<std::uint64_t> entries[1 << size_bits];
+		std::atomic_uint32_t pending[1 << size_bits];
+		std::atomic_bool loaded[1 << size_bits];
+		std::uint64_t modified[1 << size_bits];
+		std::uint32_t histogram[1 << size_bits];
 	};
 }
 
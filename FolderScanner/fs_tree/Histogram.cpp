@@ -0,0 +1,64 @@
+#include "Histogram.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace fs_tree
+{
+	std::uint32_t AgeBucket(std::int64_t age_seconds)
+	{
+		const auto days = age_seconds > 0 ? static_cast<std::uint64_t>(age_seconds) / (24 * 60 * 60) : 0;
+		const auto bound = std::upper_bound(std::begin(age_bucket_days), std::end(age_bucket_days), days);
+		return static_cast<std::uint32_t>(bound - std::begin(age_bucket_days)) - 1;
+	}
+
+	std::uint32_t SizeBucket(std::uint64_t size)
+	{
+		return std::min(static_cast<std::uint32_t>(std::bit_width(size)), size_bucket_num - 1);
+	}
+
+	std::uint64_t SizeBucketMin(std::uint32_t bucket)
+	{
+		return bucket == 0 ? 0 : std::uint64_t(1) << (bucket - 1);
+	}
+
+	void subtree_histogram::Add(std::uint32_t age_bucket, std::uint64_t size)
+	{
+		const auto size_bucket = SizeBucket(size);
+		age_files[age_bucket]++;
+		age_bytes[age_bucket] += size;
+		size_files[size_bucket]++;
+		size_bytes[size_bucket] += size;
+	}
+
+	subtree_histogram& subtree_histogram::operator+=(const subtree_histogram& other)
+	{
+		for (std::uint32_t i = 0; i < age_bucket_num; i++)
+		{
+			age_files[i] += other.age_files[i];
+			age_bytes[i] += other.age_bytes[i];
+		}
+		for (std::uint32_t i = 0; i < size_bucket_num; i++)
+		{
+			size_files[i] += other.size_files[i];
+			size_bytes[i] += other.size_bytes[i];
+		}
+		return *this;
+	}
+
+	subtree_histogram subtree_histogram::operator-(const subtree_histogram& other) const
+	{
+		auto difference = *this;
+		for (std::uint32_t i = 0; i < age_bucket_num; i++)
+		{
+			difference.age_files[i] -= other.age_files[i];
+			difference.age_bytes[i] -= other.age_bytes[i];
+		}
+		for (std::uint32_t i = 0; i < size_bucket_num; i++)
+		{
+			difference.size_files[i] -= other.size_files[i];
+			difference.size_bytes[i] -= other.size_bytes[i];
+		}
+		return difference;
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef FS_TREE_HISTOGRAM
+#define FS_TREE_HISTOGRAM
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+
+namespace fs_tree
+{
+	// Files by how long ago they were last used (the newest of their access and modification times, relative to
+	// the time of the scan): bucket n holds the ages from age_bucket_days[n] days up to the next bound, the last
+	// bucket everything older.
+	constexpr std::uint32_t age_bucket_days[] = { 0, 1, 7, 30, 90, 180, 365, 730 };
+	constexpr std::uint32_t age_bucket_num = static_cast<std::uint32_t>(std::size(age_bucket_days));
+
+	// Files by size in powers of two: bucket 0 holds the empty files, bucket n the sizes of [2^(n-1), 2^n) bytes
+	// and the last bucket everything from 1 GB up.
+	constexpr std::uint32_t size_bucket_num = 32;
+
+	// Files with a time after the scan (clocks out of sync) count as used right then.
+	std::uint32_t AgeBucket(std::int64_t age_seconds);
+	std::uint32_t SizeBucket(std::uint64_t size);
+	// The smallest size of 'bucket'.
+	std::uint64_t SizeBucketMin(std::uint32_t bucket);
+
+	// Number and bytes of the files of a subtree in every age and size bucket. The layout has no padding, so
+	// snapshots store it as it is.
+	struct subtree_histogram
+	{
+		std::uint32_t age_files[age_bucket_num] = {};
+		std::uint32_t size_files[size_bucket_num] = {};
+		std::uint64_t age_bytes[age_bucket_num] = {};
+		std::uint64_t size_bytes[size_bucket_num] = {};
+
+		void Add(std::uint32_t age_bucket, std::uint64_t size);
+		subtree_histogram& operator+=(const subtree_histogram& other);
+		// Unsigned wrap-around, adding the difference to a histogram works for shrinking subtrees too.
+		subtree_histogram operator-(const subtree_histogram& other) const;
+	};
+
+	// Histograms of the folders of a FilesystemTree that have subfolders, one array per bucket kind. The
+	// histogram of a folder without subfolders is summed from its files when asked for, which keeps the table to
+	// a fraction of the folders.
+	struct HistogramChunk
+	{
+		static constexpr std::uint32_t size_bits = 12;
+		std::atomic_uint32_t age_files[1 << size_bits][age_bucket_num];
+		std::atomic_uint32_t size_files[1 << size_bits][size_bucket_num];
+		std::atomic_uint64_t age_bytes[1 << size_bits][age_bucket_num];
+		std::atomic_uint64_t size_bytes[1 << size_bits][size_bucket_num];
+	};
+
+	// Row 0 of the histogram table is never used, so a zero-initialized folder has none.
+	constexpr std::uint32_t no_histogram = 0;
+}
+
+#endif // !FS_TREE_HISTOGRAM
@@ -0,0 +1,39 @@
+#include "InodeSet.h"
+
+namespace fs_tree
+{
+	std::pair<LinkId, bool> InodeSet::Add(const inode_key& key, FileId file)
+	{
+		auto& shard = GetShard(key);
+		std::unique_lock lock(shard.mutex);
+
+		const auto search = shard.ids.find(key);
+		if (search != shard.ids.end())
+		{
+			auto& owner = links_.At(&LinkChunk::owner, search->second);
+			if (owner.load(std::memory_order_relaxed) != no_owner) return { search->second, false };
+
+			owner.store(file, std::memory_order_relaxed);
+			return { search->second, true };
+		}
+
+		const auto link = links_.Allocate(1);
+		links_.At(&LinkChunk::device, link) = key.device;
+		links_.At(&LinkChunk::inode, link) = key.inode;
+		links_.At(&LinkChunk::owner, link).store(file, std::memory_order_relaxed);
+		shard.ids.emplace(key, link);
+		return { link, true };
+	}
+
+	void InodeSet::Release(LinkId link, FileId file)
+	{
+		auto& shard = GetShard(Key(link));
+		std::unique_lock lock(shard.mutex);
+
+		auto& owner = links_.At(&LinkChunk::owner, link);
+		if (owner.load(std::memory_order_relaxed) == file)
+		{
+			owner.store(no_owner, std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#ifndef FS_TREE_INODE_SET
+#define FS_TREE_INODE_SET
+
+#include "Arena.h"
+#include "File.h"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace fs_tree
+{
+	constexpr FileId no_owner = std::numeric_limits<FileId>::max();
+
+	struct inode_key
+	{
+		std::uint64_t device;
+		std::uint64_t inode;
+
+		bool operator==(const inode_key&) const = default;
+	};
+
+	struct LinkChunk
+	{
+		static constexpr std::uint32_t size_bits = 16;
+		std::uint64_t device[1 << size_bits];
+		std::uint64_t inode[1 << size_bits];
+		std::atomic<FileId> owner[1 << size_bits];
+	};
+
+	// The hard-linked files of a tree, one id per (device, inode). The first file added for an inode becomes its
+	// owner and is the only one whose size counts towards unique sizes. Inodes are spread over independently
+	// locked shards, so loader threads only contend when they hit the same shard at the same time, and files with
+	// a single link never get here at all.
+	class InodeSet
+	{
+	private:
+		static constexpr std::size_t shard_num = 64;
+
+		struct key_hash
+		{
+			std::size_t operator()(const inode_key& key) const
+			{
+				// Inodes are mostly sequential, the multiplication spreads them over all shards and buckets.
+				return static_cast<std::size_t>((key.inode ^ (key.device << 32) ^ (key.device >> 32)) * 0x9E3779B97F4A7C15ull);
+			}
+		};
+
+		struct alignas(64) Shard
+		{
+			std::mutex mutex;
+			std::unordered_map<inode_key, LinkId, key_hash> ids;
+		};
+
+		ChunkedTable<LinkChunk> links_;
+		std::unique_ptr<Shard[]> shards_ = std::make_unique<Shard[]>(shard_num);
+
+		Shard& GetShard(const inode_key& key)
+		{
+			return shards_[(key_hash{}(key) >> 58) % shard_num];
+		}
+
+	public:
+		// Returns the id of 'key' and whether 'file' became its owner, which happens when the inode is new or its
+		// owner was released. Thread safe.
+		std::pair<LinkId, bool> Add(const inode_key& key, FileId file);
+
+		// Gives up the ownership of 'link' if 'file' has it, so the next file added for the inode takes it over.
+		// For files that are about to be replaced.
+		void Release(LinkId link, FileId file);
+
+		FileId Owner(LinkId link) const
+		{
+			return links_.At(&LinkChunk::owner, link).load(std::memory_order_relaxed);
+		}
+
+		inode_key Key(LinkId link) const
+		{
+			return { links_.At(&LinkChunk::device, link), links_.At(&LinkChunk::inode, link) };
+		}
+
+		std::uint32_t Size() const
+		{
+			return links_.Size();
+		}
+	};
+}
+
+#endif // !FS_TREE_INODE_SET
@@ -0,0 +1,110 @@
+#include "NameMatcher.h"
+
+#include <algorithm>
+#include <filesystem>
+
+namespace fs_tree
+{
+	namespace
+	{
+		constexpr std::string_view regex_prefix = "re:";
+
+		bool IsWildcard(native_char c)
+		{
+			return c == '*' || c == '?';
+		}
+
+		// Iterative glob matching: on a mismatch it only backtracks to the last '*', so it's linear for the usual
+		// patterns and never recurses.
+		bool GlobMatches(native_string_view pattern, native_string_view name)
+		{
+			std::size_t p = 0;
+			std::size_t n = 0;
+			auto star = native_string_view::npos;
+			std::size_t resume = 0;
+
+			while (n < name.size())
+			{
+				if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+				{
+					p++;
+					n++;
+				}
+				else if (p < pattern.size() && pattern[p] == '*')
+				{
+					star = p++;
+					resume = n;
+				}
+				else if (star != native_string_view::npos)
+				{
+					p = star + 1;
+					n = ++resume;
+				}
+				else
+				{
+					return false;
+				}
+			}
+
+			while (p < pattern.size() && pattern[p] == '*') p++;
+			return p == pattern.size();
+		}
+	}
+
+	void NameMatcher::Add(std::string_view rule)
+	{
+		if (rule.starts_with(regex_prefix))
+		{
+			const auto expression = std::filesystem::path(rule.substr(regex_prefix.size())).native();
+			regexes_.emplace_back(expression, std::regex::ECMAScript | std::regex::optimize);
+			return;
+		}
+
+		const auto pattern = std::filesystem::path(rule).native();
+		const auto wildcards = std::count_if(pattern.begin(), pattern.end(), IsWildcard);
+		if (wildcards == 0)
+		{
+			exact_.insert(pattern);
+		}
+		else if (wildcards == 1 && pattern.back() == '*')
+		{
+			prefixes_.push_back(pattern.substr(0, pattern.size() - 1));
+		}
+		else if (wildcards == 1 && pattern.front() == '*')
+		{
+			suffixes_.push_back(pattern.substr(1));
+		}
+		else
+		{
+			globs_.push_back(pattern);
+		}
+	}
+
+	bool NameMatcher::Empty() const
+	{
+		return exact_.empty() && prefixes_.empty() && suffixes_.empty() && globs_.empty() && regexes_.empty();
+	}
+
+	bool NameMatcher::Matches(native_string_view name) const
+	{
+		if (!exact_.empty() && exact_.find(name) != exact_.end()) return true;
+
+		for (const auto& prefix : prefixes_)
+		{
+			if (name.starts_with(prefix)) return true;
+		}
+		for (const auto& suffix : suffixes_)
+		{
+			if (name.ends_with(suffix)) return true;
+		}
+		for (const auto& glob : globs_)
+		{
+			if (GlobMatches(glob, name)) return true;
+		}
+		for (const auto& regex : regexes_)
+		{
+			if (std::regex_match(name.begin(), name.end(), regex)) return true;
+		}
+		return false;
+	}
+}
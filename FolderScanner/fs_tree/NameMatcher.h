@@ -0,0 +1,49 @@
+#ifndef FS_TREE_NAME_MATCHER
+#define FS_TREE_NAME_MATCHER
+
+#include "DirectoryReader.h"
+
+#include <functional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace fs_tree
+{
+	// A set of exclusion rules matched against file and folder names (not paths). Rules are globs with '*' and
+	// '?', or ECMAScript regular expressions when prefixed with "re:". They are sorted by shape when added, so
+	// the common ones cost a hash lookup (node_modules) or a suffix compare (*.tmp) per name, and only
+	// general globs and regular expressions are matched one by one.
+	class NameMatcher
+	{
+	private:
+		using native_string = std::filesystem::path::string_type;
+
+		struct string_hash
+		{
+			using is_transparent = void;
+
+			std::size_t operator()(native_string_view name) const
+			{
+				return std::hash<native_string_view>{}(name);
+			}
+		};
+
+		std::unordered_set<native_string, string_hash, std::equal_to<>> exact_;
+		std::vector<native_string> prefixes_;
+		std::vector<native_string> suffixes_;
+		std::vector<native_string> globs_;
+		std::vector<std::basic_regex<native_char>> regexes_;
+
+	public:
+		// Throws std::runtime_error (std::regex_error) for an invalid regular expression.
+		void Add(std::string_view rule);
+
+		bool Empty() const;
+		bool Matches(native_string_view name) const;
+	};
+}
+
+#endif // !FS_TREE_NAME_MATCHER
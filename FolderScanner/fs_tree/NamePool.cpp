@@ -0,0 +1,91 @@
+#include "NamePool.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace fs_tree
+{
+	native_char* NamePool::AllocatePage(std::size_t size)
+	{
+		auto page = std::make_unique_for_overwrite<native_char[]>(size);
+		auto data = page.get();
+
+		std::unique_lock lock(pages_mutex_);
+		pages_.push_back(std::move(page));
+		return data;
+	}
+
+	NameId NamePool::Writer::Store(native_string_view name)
+	{
+		native_char* destination = nullptr;
+		if (name.size() > page_size / 4)
+		{
+			// Long names get their own page instead of wasting the rest of the current one.
+			destination = pool_->AllocatePage(name.size());
+		}
+		else
+		{
+			if (name.size() > page_left_)
+			{
+				page_ = pool_->AllocatePage(page_size);
+				page_left_ = page_size;
+			}
+			destination = page_;
+			page_ += name.size();
+			page_left_ -= name.size();
+		}
+		std::copy(name.begin(), name.end(), destination);
+
+		if (next_id_ == end_id_)
+		{
+			next_id_ = pool_->views_.Allocate(id_block_size);
+			end_id_ = next_id_ + id_block_size;
+		}
+
+		const auto id = next_id_++;
+		pool_->views_.At(&NameChunk::view, id) = native_string_view(destination, name.size());
+		return id;
+	}
+
+	NameId NamePool::Writer::Add(native_string_view name)
+	{
+		const auto hash = std::hash<native_string_view>{}(name);
+
+		auto& cached = cache_[hash % cache_size];
+		if (cached.used && cached.hash == hash && pool_->Get(cached.id) == name)
+		{
+			return cached.id;
+		}
+
+		// The cache and the shard use different bits of the hash, so names colliding in one don't collide in the other.
+		auto& shard = pool_->shards_[(hash / cache_size) % shard_num];
+		NameId id;
+		{
+			std::unique_lock lock(shard.mutex);
+			const auto search = shard.ids.find(name);
+			if (search != shard.ids.end())
+			{
+				id = search->second;
+			}
+			else
+			{
+				id = Store(name);
+				shard.ids.emplace(pool_->Get(id), id);
+			}
+		}
+
+		cached = { hash, id, true };
+		return id;
+	}
+
+	std::uint64_t NamePool::UniqueNum() const
+	{
+		std::uint64_t unique_num = 0;
+		for (std::size_t i = 0; i < shard_num; i++)
+		{
+			std::unique_lock lock(shards_[i].mutex);
+			unique_num += shards_[i].ids.size();
+		}
+		return unique_num;
+	}
+}
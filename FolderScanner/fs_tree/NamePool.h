@@ -0,0 +1,93 @@
+#ifndef FS_TREE_NAME_POOL
+#define FS_TREE_NAME_POOL
+
+#include "Arena.h"
+#include "DirectoryReader.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace fs_tree
+{
+	using NameId = std::uint32_t;
+
+	struct NameChunk
+	{
+		static constexpr std::uint32_t size_bits = 16;
+		native_string_view view[1 << size_bits];
+	};
+
+	// Interned storage for file and folder names: every distinct name is stored once, in large character pages
+	// owned by the pool, and nodes refer to it by a 32-bit id. Names like node_modules, index.js or .git repeat
+	// millions of times on real trees, so this is a fraction of the memory of one string per node.
+	class NamePool
+	{
+	public:
+		// Per-thread state: the current character page, a block of reserved ids and a small direct-mapped cache of
+		// recently added names, so repeated names are usually resolved without touching any shared state.
+		class Writer
+		{
+		private:
+			static constexpr std::size_t cache_size = 1024;
+
+			struct cache_entry
+			{
+				std::size_t hash = 0;
+				NameId id = 0;
+				bool used = false;
+			};
+
+			NamePool* pool_;
+			native_char* page_ = nullptr;
+			std::size_t page_left_ = 0;
+			NameId next_id_ = 0;
+			NameId end_id_ = 0;
+			std::unique_ptr<cache_entry[]> cache_ = std::make_unique<cache_entry[]>(cache_size);
+
+			NameId Store(native_string_view name);
+
+		public:
+			explicit Writer(NamePool& pool) : pool_(&pool) {}
+			NameId Add(native_string_view name);
+		};
+
+	private:
+		static constexpr std::size_t page_size = 64 * 1024;
+		static constexpr std::uint32_t id_block_size = 4096;
+		static constexpr std::size_t shard_num = 64;
+
+		struct alignas(64) Shard
+		{
+			std::mutex mutex;
+			std::unordered_map<native_string_view, NameId> ids;
+		};
+
+		ChunkedTable<NameChunk> views_;
+		std::unique_ptr<Shard[]> shards_ = std::make_unique<Shard[]>(shard_num);
+
+		std::mutex pages_mutex_;
+		std::vector<std::unique_ptr<native_char[]>> pages_;
+
+		native_char* AllocatePage(std::size_t size);
+
+	public:
+		native_string_view Get(NameId id) const
+		{
+			return views_.At(&NameChunk::view, id);
+		}
+
+		// Number of ids handed out, including the unused ids of the blocks reserved by writers (those are empty).
+		std::uint32_t IdNum() const
+		{
+			return views_.Size();
+		}
+
+		// Number of distinct names.
+		std::uint64_t UniqueNum() const;
+	};
+}
+
+#endif // !FS_TREE_NAME_POOL
@@ -0,0 +1,60 @@
+#ifndef FS_TREE_PARALLEL_SORT
+#define FS_TREE_PARALLEL_SORT
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace fs_tree
+{
+	// Below this many elements a single std::sort is faster than starting threads.
+	constexpr std::size_t parallel_sort_threshold = 128 * 1024;
+
+	// Sorts 'values' with up to one thread per hardware thread: equal slices are sorted concurrently and then
+	// merged pairwise, each round of merges running in parallel as well. Small inputs are sorted in place on the
+	// calling thread.
+	template<typename T, typename Compare>
+	void ParallelSort(std::span<T> values, Compare compare)
+	{
+		const auto slice_num = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), values.size() / (parallel_sort_threshold / 4));
+		if (values.size() < parallel_sort_threshold || slice_num < 2)
+		{
+			std::sort(values.begin(), values.end(), compare);
+			return;
+		}
+
+		std::vector<std::size_t> bounds;
+		for (std::size_t i = 0; i <= slice_num; i++)
+		{
+			bounds.push_back(values.size() * i / slice_num);
+		}
+
+		std::vector<std::jthread> threads;
+		for (std::size_t i = 0; i + 1 < bounds.size(); i++)
+		{
+			threads.emplace_back([&, i]() { std::sort(values.begin() + bounds[i], values.begin() + bounds[i + 1], compare); });
+		}
+		threads.clear();
+
+		// Every round merges neighbouring slices and drops the bound between them.
+		while (bounds.size() > 2)
+		{
+			std::vector<std::size_t> merged{ 0 };
+			for (std::size_t i = 0; i + 2 < bounds.size(); i += 2)
+			{
+				threads.emplace_back([&, i]() { std::inplace_merge(values.begin() + bounds[i], values.begin() + bounds[i + 1], values.begin() + bounds[i + 2], compare); });
+				merged.push_back(bounds[i + 2]);
+			}
+			if (bounds.size() % 2 == 0)
+			{
+				merged.push_back(bounds.back());
+			}
+			threads.clear();
+			bounds = std::move(merged);
+		}
+	}
+}
+
+#endif // !FS_TREE_PARALLEL_SORT
@@ -0,0 +1,24 @@
+#include "PathIndex.h"
+
+#include <functional>
+
+namespace fs_tree
+{
+	std::uint64_t PathIndex::Hash(std::uint32_t parent, native_string_view name)
+	{
+		// Siblings share the parent, the multiplication keeps their names from landing next to each other.
+		const auto hash = static_cast<std::uint64_t>(std::hash<native_string_view>{}(name)) ^ ((parent + 1ull) * 0x9E3779B97F4A7C15ull);
+		return hash ^ (hash >> 29);
+	}
+
+	std::uint64_t PathIndex::Size() const
+	{
+		std::uint64_t size = 0;
+		for (std::size_t i = 0; i < shard_num; i++)
+		{
+			std::unique_lock lock(shards_[i].mutex);
+			size += shards_[i].size;
+		}
+		return size;
+	}
+}
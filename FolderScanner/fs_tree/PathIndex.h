@@ -0,0 +1,122 @@
+#ifndef FS_TREE_PATH_INDEX
+#define FS_TREE_PATH_INDEX
+
+#include "DirectoryReader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace fs_tree
+{
+	// Finds the child of a folder by name in a few probes: a hash table from (parent id, name) to the id of the
+	// child. Only ids are stored, 4 bytes per slot, the keys are compared against the tree itself (see Find), so
+	// the index costs a fraction of what the nodes do. Ids are spread over independently locked shards of linear
+	// probing, so loader threads can add the children of different folders at the same time.
+	//
+	// Entries aren't removed when their node is replaced, they stay behind and must simply fail to match. A shard
+	// that fills up drops them while it's rebuilt, so it only grows for the entries that are still in use.
+	class PathIndex
+	{
+	public:
+		static constexpr std::uint32_t no_entry = std::numeric_limits<std::uint32_t>::max();
+
+		static std::uint64_t Hash(std::uint32_t parent, native_string_view name);
+
+	private:
+		static constexpr std::size_t shard_num = 64;
+		static constexpr std::size_t min_slot_num = 64;
+
+		struct alignas(64) Shard
+		{
+			mutable std::mutex mutex;
+			std::vector<std::uint32_t> slots;
+			std::size_t size = 0;
+		};
+
+		std::unique_ptr<Shard[]> shards_ = std::make_unique<Shard[]>(shard_num);
+
+		// The top bits pick the shard, the bottom bits the slot, so both are spread evenly.
+		static Shard& GetShard(Shard* shards, std::uint64_t hash)
+		{
+			return shards[(hash >> 58) % shard_num];
+		}
+
+		// Returns false if 'id' is already stored under 'hash'.
+		static bool Insert(std::vector<std::uint32_t>& slots, std::uint64_t hash, std::uint32_t id)
+		{
+			const auto mask = slots.size() - 1;
+			auto slot = hash & mask;
+			for (; slots[slot] != no_entry; slot = (slot + 1) & mask)
+			{
+				if (slots[slot] == id) return false;
+			}
+			slots[slot] = id;
+			return true;
+		}
+
+	public:
+		// Adds 'id' under 'hash', unless it's there already. When the shard is full, it's rebuilt with the ids for
+		// which 'live(id)' is true, hashed again with 'hash_of(id)', so the node must already be readable and
+		// count as live. Thread safe.
+		template<typename HashOf, typename Live>
+		void Add(std::uint64_t hash, std::uint32_t id, HashOf hash_of, Live live)
+		{
+			auto& shard = GetShard(shards_.get(), hash);
+			std::unique_lock lock(shard.mutex);
+
+			// Kept at most three quarters full, and at most half full after rebuilding.
+			if ((shard.size + 1) * 4 > shard.slots.size() * 3)
+			{
+				// An id that was reused for another node is hashed like the current entry and collapses into it, or
+				// belongs to another shard, which has the current entry.
+				std::vector<std::pair<std::uint64_t, std::uint32_t>> entries;
+				for (const auto old : shard.slots)
+				{
+					if (old == no_entry || !live(old)) continue;
+					const auto old_hash = hash_of(old);
+					if (&GetShard(shards_.get(), old_hash) == &shard) entries.emplace_back(old_hash, old);
+				}
+
+				auto slot_num = std::max(shard.slots.size(), min_slot_num);
+				while ((entries.size() + 1) * 2 > slot_num) slot_num *= 2;
+
+				std::vector<std::uint32_t> slots(slot_num, no_entry);
+				shard.size = 0;
+				for (const auto& [old_hash, old] : entries)
+				{
+					if (Insert(slots, old_hash, old)) shard.size++;
+				}
+				shard.slots = std::move(slots);
+			}
+
+			if (Insert(shard.slots, hash, id)) shard.size++;
+		}
+
+		// Returns the first id stored under 'hash' for which 'match(id)' is true, no_entry if there is none.
+		// Thread safe, also while ids are being added.
+		template<typename Match>
+		std::uint32_t Find(std::uint64_t hash, Match match) const
+		{
+			const auto& shard = GetShard(shards_.get(), hash);
+			std::unique_lock lock(shard.mutex);
+			if (shard.slots.empty()) return no_entry;
+
+			const auto mask = shard.slots.size() - 1;
+			for (auto slot = hash & mask; shard.slots[slot] != no_entry; slot = (slot + 1) & mask)
+			{
+				if (match(shard.slots[slot])) return shard.slots[slot];
+			}
+			return no_entry;
+		}
+
+		// Number of ids stored, including the replaced ones that haven't been dropped yet.
+		std::uint64_t Size() const;
+	};
+}
+
+#endif // !FS_TREE_PATH_INDEX
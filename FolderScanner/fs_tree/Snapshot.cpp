@@ -0,0 +1,327 @@
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs_tree
+{
+	namespace
+	{
+		std::uint64_t Align(std::uint64_t offset)
+		{
+			return (offset + 7) & ~std::uint64_t(7);
+		}
+
+		std::runtime_error SnapshotError(const std::filesystem::path& path, const char* what)
+		{
+			return std::runtime_error(std::string(what) + ": " + path.string());
+		}
+	}
+
+	snapshot_layout::snapshot_layout(const snapshot_header& header)
+	{
+		constexpr auto max_size = std::numeric_limits<std::uint64_t>::max();
+		std::uint64_t offset = sizeof(snapshot_header);
+		bool overflow = false;
+		const auto next = [&](std::uint64_t count, std::uint64_t element_size)
+		{
+			const auto current = Align(offset);
+			if (overflow || current < offset || (element_size != 0 && count > (max_size - current) / element_size))
+			{
+				overflow = true;
+				return std::uint64_t(0);
+			}
+			offset = current + count * element_size;
+			return current;
+		};
+
+		root_path = next(header.root_path_length, header.char_size);
+
+		folder_name = next(header.folder_num, sizeof(NameId));
+		folder_parent = next(header.folder_num, sizeof(FolderId));
+		folder_first_folder = next(header.folder_num, sizeof(FolderId));
+		folder_folder_num = next(header.folder_num, sizeof(std::uint32_t));
+		folder_first_file = next(header.folder_num, sizeof(FileId));
+		folder_file_num = next(header.folder_num, sizeof(std::uint32_t));
+		folder_size = next(header.folder_num, sizeof(std::uint64_t));
+		folder_unique_size = next(header.folder_num, sizeof(std::uint64_t));
+		folder_allocated = next(header.folder_num, sizeof(std::uint64_t));
+		folder_entries = next(header.folder_num, sizeof(std::uint64_t));
+		folder_modified = next(header.folder_num, sizeof(std::uint64_t));
+		folder_histogram = next(header.folder_num, sizeof(std::uint32_t));
+
+		file_name = next(header.file_num, sizeof(NameId));
+		file_parent = next(header.file_num, sizeof(FolderId));
+		file_size = next(header.file_num, sizeof(std::uint64_t));
+		file_allocated = next(header.file_num, sizeof(std::uint64_t));
+		file_link = next(header.file_num, sizeof(LinkId));
+		file_accessed = next(header.file_num, sizeof(std::uint32_t));
+		file_modified = next(header.file_num, sizeof(std::uint32_t));
+		file_changed = next(header.file_num, sizeof(std::uint32_t));
+
+		link_device = next(header.link_num, sizeof(std::uint64_t));
+		link_inode = next(header.link_num, sizeof(std::uint64_t));
+		link_owner = next(header.link_num, sizeof(FileId));
+
+		histograms = next(header.histogram_num, sizeof(subtree_histogram));
+
+		name_offset = next(header.name_num, sizeof(std::uint64_t));
+		name_length = next(header.name_num, sizeof(std::uint32_t));
+		name_chars = next(header.name_chars, header.char_size);
+
+		total_size = overflow ? max_size : offset;
+	}
+
+	SnapshotWriter::SnapshotWriter(const std::filesystem::path& path, const snapshot_header& header)
+		: path_(path), temporary_path_(path.native() + std::filesystem::path::string_type({ '.', 't', 'm', 'p' })),
+		stream_(temporary_path_, std::ios::binary | std::ios::trunc)
+	{
+		if (!stream_) throw SnapshotError(temporary_path_, "Can't create the snapshot");
+		stream_.exceptions(std::ios::badbit | std::ios::failbit);
+		WriteBytes(&header, sizeof(header));
+	}
+
+	SnapshotWriter::~SnapshotWriter()
+	{
+		if (finished_) return;
+
+		std::error_code error;
+		stream_.exceptions(std::ios::goodbit);
+		stream_.close();
+		std::filesystem::remove(temporary_path_, error);
+	}
+
+	void SnapshotWriter::Seek(std::uint64_t offset)
+	{
+		static constexpr char zeros[8] = {};
+		while (position_ < offset)
+		{
+			WriteBytes(zeros, static_cast<std::size_t>(std::min<std::uint64_t>(offset - position_, sizeof(zeros))));
+		}
+	}
+
+	void SnapshotWriter::WriteBytes(const void* data, std::size_t size)
+	{
+		stream_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		position_ += size;
+	}
+
+	void SnapshotWriter::Finish(std::uint64_t total_size)
+	{
+		Seek(total_size);
+		stream_.close();
+
+		// Replaces the target in one step where the platform allows (rename on POSIX, MoveFileExW with
+		// MOVEFILE_REPLACE_EXISTING on Windows), a tree still mapped from the old file keeps reading that one.
+		std::error_code error;
+		std::filesystem::rename(temporary_path_, path_, error);
+		if (error) throw SnapshotError(path_, "Can't replace the snapshot");
+		finished_ = true;
+	}
+
+#if defined(_WIN32)
+	struct Snapshot::mapping
+	{
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE map = nullptr;
+		const void* data = nullptr;
+		std::uint64_t size = 0;
+
+		explicit mapping(const std::filesystem::path& path)
+		{
+			file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE) throw SnapshotError(path, "Can't open the snapshot");
+
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+			{
+				CloseHandle(file);
+				throw SnapshotError(path, "Can't map the snapshot");
+			}
+			size = static_cast<std::uint64_t>(file_size.QuadPart);
+
+			map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data = map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (!data)
+			{
+				if (map) CloseHandle(map);
+				CloseHandle(file);
+				throw SnapshotError(path, "Can't map the snapshot");
+			}
+		}
+
+		~mapping()
+		{
+			UnmapViewOfFile(data);
+			CloseHandle(map);
+			CloseHandle(file);
+		}
+	};
+#elif defined(__unix__) || defined(__APPLE__)
+	struct Snapshot::mapping
+	{
+		const void* data = nullptr;
+		std::uint64_t size = 0;
+
+		explicit mapping(const std::filesystem::path& path)
+		{
+			const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0) throw SnapshotError(path, "Can't open the snapshot");
+
+			struct stat st;
+			if (fstat(fd, &st) != 0 || st.st_size == 0)
+			{
+				close(fd);
+				throw SnapshotError(path, "Can't map the snapshot");
+			}
+			size = static_cast<std::uint64_t>(st.st_size);
+
+			// The mapping keeps the file referenced, the descriptor isn't needed anymore.
+			const auto address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+			close(fd);
+			if (address == MAP_FAILED) throw SnapshotError(path, "Can't map the snapshot");
+			data = address;
+		}
+
+		~mapping()
+		{
+			munmap(const_cast<void*>(data), size);
+		}
+	};
+#else
+	// No mapping API, the snapshot is read into memory instead.
+	struct Snapshot::mapping
+	{
+		std::unique_ptr<std::uint64_t[]> buffer;
+		const void* data = nullptr;
+		std::uint64_t size = 0;
+
+		explicit mapping(const std::filesystem::path& path)
+		{
+			std::ifstream stream(path, std::ios::binary | std::ios::ate);
+			if (!stream) throw SnapshotError(path, "Can't open the snapshot");
+
+			size = static_cast<std::uint64_t>(stream.tellg());
+			buffer = std::make_unique_for_overwrite<std::uint64_t[]>(size / sizeof(std::uint64_t) + 1);
+			stream.seekg(0);
+			if (!stream.read(reinterpret_cast<char*>(buffer.get()), static_cast<std::streamsize>(size)))
+			{
+				throw SnapshotError(path, "Can't read the snapshot");
+			}
+			data = buffer.get();
+		}
+	};
+#endif
+
+	template<typename T>
+	std::span<const T> Snapshot::Array(std::uint64_t offset, std::uint64_t size) const
+	{
+		return std::span<const T>(reinterpret_cast<const T*>(static_cast<const char*>(mapping_->data) + offset), size);
+	}
+
+	template<typename T>
+	snapshot_column<T> Snapshot::Column(std::uint64_t offset, std::uint64_t size) const
+	{
+		return snapshot_column<T>(Array<T>(offset, size), path_);
+	}
+
+	void ThrowCorruptSnapshot(const std::filesystem::path& path)
+	{
+		throw SnapshotError(path, "Snapshot is corrupt");
+	}
+
+	Snapshot::Snapshot(const std::filesystem::path& path) : mapping_(std::make_unique<mapping>(path)), path_(path)
+	{
+		header_ = static_cast<const snapshot_header*>(mapping_->data);
+		if (mapping_->size < sizeof(snapshot_header) || std::memcmp(header_->magic, snapshot_header::expected_magic, sizeof(header_->magic)) != 0)
+		{
+			throw SnapshotError(path, "Not a snapshot");
+		}
+		if (header_->version != snapshot_header::current_version || header_->char_size != sizeof(native_char))
+		{
+			throw SnapshotError(path, "Snapshot was saved by an incompatible version");
+		}
+
+		const snapshot_layout layout(*header_);
+		if (layout.total_size == std::numeric_limits<std::uint64_t>::max())
+		{
+			throw SnapshotError(path, "Snapshot is corrupt");
+		}
+		if (layout.total_size > mapping_->size || header_->folder_num == 0)
+		{
+			throw SnapshotError(path, "Snapshot is truncated");
+		}
+
+		root_path = Array<native_char>(layout.root_path, header_->root_path_length);
+
+		folder_name = Column<NameId>(layout.folder_name, header_->folder_num);
+		folder_parent = Column<FolderId>(layout.folder_parent, header_->folder_num);
+		folder_first_folder = Column<FolderId>(layout.folder_first_folder, header_->folder_num);
+		folder_folder_num = Column<std::uint32_t>(layout.folder_folder_num, header_->folder_num);
+		folder_first_file = Column<FileId>(layout.folder_first_file, header_->folder_num);
+		folder_file_num = Column<std::uint32_t>(layout.folder_file_num, header_->folder_num);
+		folder_size = Column<std::uint64_t>(layout.folder_size, header_->folder_num);
+		folder_unique_size = Column<std::uint64_t>(layout.folder_unique_size, header_->folder_num);
+		folder_allocated = Column<std::uint64_t>(layout.folder_allocated, header_->folder_num);
+		folder_entries = Column<std::uint64_t>(layout.folder_entries, header_->folder_num);
+		folder_modified = Column<std::uint64_t>(layout.folder_modified, header_->folder_num);
+		folder_histogram = Column<std::uint32_t>(layout.folder_histogram, header_->folder_num);
+
+		file_name = Column<NameId>(layout.file_name, header_->file_num);
+		file_parent = Column<FolderId>(layout.file_parent, header_->file_num);
+		file_size = Column<std::uint64_t>(layout.file_size, header_->file_num);
+		file_allocated = Column<std::uint64_t>(layout.file_allocated, header_->file_num);
+		file_link = Column<LinkId>(layout.file_link, header_->file_num);
+		file_accessed = Column<std::uint32_t>(layout.file_accessed, header_->file_num);
+		file_modified = Column<std::uint32_t>(layout.file_modified, header_->file_num);
+		file_changed = Column<std::uint32_t>(layout.file_changed, header_->file_num);
+
+		link_device = Column<std::uint64_t>(layout.link_device, header_->link_num);
+		link_inode = Column<std::uint64_t>(layout.link_inode, header_->link_num);
+		link_owner = Column<FileId>(layout.link_owner, header_->link_num);
+
+		histograms = Column<subtree_histogram>(layout.histograms, header_->histogram_num);
+
+		name_offset = Column<std::uint64_t>(layout.name_offset, header_->name_num);
+		name_length = Column<std::uint32_t>(layout.name_length, header_->name_num);
+		name_chars = Array<native_char>(layout.name_chars, header_->name_chars);
+
+	}
+
+	std::pair<FolderId, std::uint32_t> Snapshot::SubFolders(FolderId folder) const
+	{
+		const auto first = folder_first_folder[folder];
+		const auto num = folder_folder_num[folder];
+		if (num != 0 && (first == 0 || first > folder_parent.size() || num > folder_parent.size() - first)) ThrowCorruptSnapshot(path_);
+		for (auto subfolder = first; subfolder < first + num; subfolder++)
+		{
+			if (folder_parent[subfolder] != folder) ThrowCorruptSnapshot(path_);
+		}
+		return { first, num };
+	}
+
+	std::pair<FileId, std::uint32_t> Snapshot::Files(FolderId folder) const
+	{
+		const auto first = folder_first_file[folder];
+		const auto num = folder_file_num[folder];
+		if (num != 0 && (first > file_parent.size() || num > file_parent.size() - first)) ThrowCorruptSnapshot(path_);
+		for (auto file = first; file < first + num; file++)
+		{
+			if (file_parent[file] != folder) ThrowCorruptSnapshot(path_);
+		}
+		return { first, num };
+	}
+
+	Snapshot::~Snapshot() = default;
+}
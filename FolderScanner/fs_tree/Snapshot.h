@@ -0,0 +1,268 @@
+#ifndef FS_TREE_SNAPSHOT
+#define FS_TREE_SNAPSHOT
+
+#include "DirectoryReader.h"
+#include "File.h"
+#include "Histogram.h"
+#include "NamePool.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace fs_tree
+{
+	// On-disk layout of a saved tree: the header followed by flat arrays, each starting at a multiple of 8 bytes.
+	//
+	//     root path       native_char[root_path_length]
+	//     folders         name, parent, first_folder, folder_num, first_file, file_num (std::uint32_t[folder_num]),
+	//                     size, unique_size, allocated, entries, modified (std::uint64_t[folder_num]),
+	//                     histogram (std::uint32_t[folder_num])
+	//     files           name, parent (std::uint32_t[file_num]), size, allocated (std::uint64_t[file_num]),
+	//                     link, accessed, modified, changed (std::uint32_t[file_num])
+	//     links           device, inode (std::uint64_t[link_num]), owner (std::uint32_t[link_num])
+	//     histograms      subtree_histogram[histogram_num]
+	//     names           offset (std::uint64_t[name_num]), length (std::uint32_t[name_num]), native_char[name_chars]
+	//
+	// Ids are the ones of the saved tree, so the arrays can be used in place without any parsing.
+	struct snapshot_header
+	{
+		static constexpr char expected_magic[8] = { 'F', 'S', 'S', 'N', 'A', 'P', '\0', '\0' };
+		static constexpr std::uint32_t current_version = 6;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t char_size;
+		std::uint32_t folder_num;
+		std::uint32_t file_num;
+		std::uint32_t name_num;
+		std::uint32_t unique_name_num;
+		std::uint64_t name_chars;
+		std::uint64_t root_path_length;
+		std::uint64_t link_num;
+		std::uint64_t histogram_num;
+		// When the tree was scanned, in seconds since 1970, what the ages of the histograms are relative to.
+		std::int64_t scan_time;
+	};
+
+	// Byte offsets of every array of a snapshot with the given header. A corrupt header whose arrays don't fit in
+	// 64 bits gets a total_size of std::numeric_limits<std::uint64_t>::max().
+	struct snapshot_layout
+	{
+		std::uint64_t root_path;
+		std::uint64_t folder_name;
+		std::uint64_t folder_parent;
+		std::uint64_t folder_first_folder;
+		std::uint64_t folder_folder_num;
+		std::uint64_t folder_first_file;
+		std::uint64_t folder_file_num;
+		std::uint64_t folder_size;
+		std::uint64_t folder_unique_size;
+		std::uint64_t folder_allocated;
+		std::uint64_t folder_entries;
+		std::uint64_t folder_modified;
+		std::uint64_t folder_histogram;
+		std::uint64_t file_name;
+		std::uint64_t file_parent;
+		std::uint64_t file_size;
+		std::uint64_t file_allocated;
+		std::uint64_t file_link;
+		std::uint64_t file_accessed;
+		std::uint64_t file_modified;
+		std::uint64_t file_changed;
+		std::uint64_t link_device;
+		std::uint64_t link_inode;
+		std::uint64_t link_owner;
+		std::uint64_t histograms;
+		std::uint64_t name_offset;
+		std::uint64_t name_length;
+		std::uint64_t name_chars;
+		std::uint64_t total_size;
+
+		explicit snapshot_layout(const snapshot_header& header);
+	};
+
+	// Writes the arrays of a new snapshot, each one at its offset from snapshot_layout. The file is written next to
+	// the target as '<path>.tmp' and only replaces it in Finish, so a save that fails or is interrupted leaves the
+	// previous snapshot alone. Throws std::runtime_error if the file can't be written.
+	class SnapshotWriter
+	{
+	private:
+		static constexpr std::size_t buffer_size = 64 * 1024;
+
+		std::filesystem::path path_;
+		std::filesystem::path temporary_path_;
+		std::ofstream stream_;
+		std::uint64_t position_ = 0;
+		bool finished_ = false;
+
+		// Pads with zeros up to 'offset', arrays are always written in layout order.
+		void Seek(std::uint64_t offset);
+		void WriteBytes(const void* data, std::size_t size);
+
+	public:
+		SnapshotWriter(const std::filesystem::path& path, const snapshot_header& header);
+		SnapshotWriter(const SnapshotWriter&) = delete;
+		SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+		// Removes the temporary file unless Finish succeeded.
+		~SnapshotWriter();
+
+		template<typename T>
+		void Write(std::uint64_t offset, std::span<const T> values)
+		{
+			Seek(offset);
+			WriteBytes(values.data(), values.size_bytes());
+		}
+
+		// Writes value(id) for every id in [0, num) as one array, in blocks so no column is ever fully copied.
+		template<typename Value>
+		void Column(std::uint64_t offset, std::uint32_t num, Value value)
+		{
+			using T = decltype(value(std::uint32_t()));
+			std::vector<T> buffer;
+			buffer.reserve(buffer_size);
+
+			Seek(offset);
+			for (std::uint32_t id = 0; id < num; id++)
+			{
+				buffer.push_back(value(id));
+				if (buffer.size() == buffer_size)
+				{
+					WriteBytes(buffer.data(), buffer.size() * sizeof(T));
+					buffer.clear();
+				}
+			}
+			WriteBytes(buffer.data(), buffer.size() * sizeof(T));
+		}
+
+		// Pads the file to its full size, closes it and renames it over the target.
+		void Finish(std::uint64_t total_size);
+	};
+
+	// Throws the std::runtime_error a snapshot whose arrays point outside of themselves is reported with.
+	[[noreturn]] void ThrowCorruptSnapshot(const std::filesystem::path& path);
+
+	// An array of a mapped snapshot. Indexing checks the id, so a corrupt snapshot throws when the bad entry is
+	// used instead of reading out of bounds.
+	template<typename T>
+	class snapshot_column
+	{
+	private:
+		std::span<const T> values_;
+		const std::filesystem::path* path_ = nullptr;
+
+	public:
+		snapshot_column() = default;
+		snapshot_column(std::span<const T> values, const std::filesystem::path& path) : values_(values), path_(&path)
+		{
+		}
+
+		const T& operator[](std::uint64_t id) const
+		{
+			if (id >= values_.size()) ThrowCorruptSnapshot(*path_);
+			return values_[id];
+		}
+
+		std::size_t size() const
+		{
+			return values_.size();
+		}
+	};
+
+	// A snapshot file mapped read-only into memory. Opening it only validates the header, pages of the arrays are
+	// read by the OS when a node on them is accessed for the first time, and parts of the tree that are never
+	// browsed are never read from disk. Entries are checked as they're used, see snapshot_column and SubFolders.
+	class Snapshot
+	{
+	private:
+		struct mapping;
+		std::unique_ptr<mapping> mapping_;
+		std::filesystem::path path_;
+
+		const snapshot_header* header_ = nullptr;
+
+		template<typename T>
+		std::span<const T> Array(std::uint64_t offset, std::uint64_t size) const;
+		template<typename T>
+		snapshot_column<T> Column(std::uint64_t offset, std::uint64_t size) const;
+
+	public:
+		// Throws std::runtime_error if the file can't be mapped or isn't a snapshot of this build's format.
+		explicit Snapshot(const std::filesystem::path& path);
+		Snapshot(const Snapshot&) = delete;
+		Snapshot& operator=(const Snapshot&) = delete;
+		~Snapshot();
+
+		std::span<const native_char> root_path;
+
+		snapshot_column<NameId> folder_name;
+		snapshot_column<FolderId> folder_parent;
+		snapshot_column<FolderId> folder_first_folder;
+		snapshot_column<std::uint32_t> folder_folder_num;
+		snapshot_column<FileId> folder_first_file;
+		snapshot_column<std::uint32_t> folder_file_num;
+		snapshot_column<std::uint64_t> folder_size;
+		snapshot_column<std::uint64_t> folder_unique_size;
+		snapshot_column<std::uint64_t> folder_allocated;
+		snapshot_column<std::uint64_t> folder_entries;
+		snapshot_column<std::uint64_t> folder_modified;
+		snapshot_column<std::uint32_t> folder_histogram;
+
+		snapshot_column<NameId> file_name;
+		snapshot_column<FolderId> file_parent;
+		snapshot_column<std::uint64_t> file_size;
+		snapshot_column<std::uint64_t> file_allocated;
+		snapshot_column<LinkId> file_link;
+		snapshot_column<std::uint32_t> file_accessed;
+		snapshot_column<std::uint32_t> file_modified;
+		snapshot_column<std::uint32_t> file_changed;
+
+		snapshot_column<std::uint64_t> link_device;
+		snapshot_column<std::uint64_t> link_inode;
+		snapshot_column<FileId> link_owner;
+
+		snapshot_column<subtree_histogram> histograms;
+
+		snapshot_column<std::uint64_t> name_offset;
+		snapshot_column<std::uint32_t> name_length;
+		std::span<const native_char> name_chars;
+
+		// The file the snapshot is mapped from.
+		const std::filesystem::path& Path() const
+		{
+			return path_;
+		}
+
+		std::uint64_t UniqueNameNum() const
+		{
+			return header_->unique_name_num;
+		}
+
+		std::int64_t ScanTime() const
+		{
+			return header_->scan_time;
+		}
+
+		native_string_view Name(NameId id) const
+		{
+			const auto offset = name_offset[id];
+			const auto length = name_length[id];
+			if (offset > name_chars.size() || length > name_chars.size() - offset) ThrowCorruptSnapshot(path_);
+			return native_string_view(name_chars.data() + offset, length);
+		}
+
+		// The first id and number of the subfolders or files of 'folder'. Throws unless they're inside the arrays
+		// and each one has 'folder' as its parent; the root is nobody's child, so walking down from it reaches every
+		// folder once and following parents up from there always ends at the root. Rows of folders replaced while
+		// watching can't be reached and are only read with the raw columns.
+		std::pair<FolderId, std::uint32_t> SubFolders(FolderId folder) const;
+		std::pair<FileId, std::uint32_t> Files(FolderId folder) const;
+	};
+}
+
+#endif // !FS_TREE_SNAPSHOT
@@ -1,15 +1,18 @@
 #include <iostream>
-#include "app/App.h"	
+#include "app/App.h"
+#include "app/Batch.h"
 #include <filesystem>
-#include <windows.h>
 
-int main()
+int main(int argc, char** argv)
 {
-	wchar_t buffer[MAX_PATH];
-	GetCurrentDirectory(MAX_PATH, buffer);
-	
-	app::App app { buffer };
+	// With arguments it's a one-shot run for scripts, see app::PrintBatchUsage.
+	if (argc > 1)
+	{
+		return app::RunBatch({ argv + 1, argv + argc });
+	}
+
+	app::App app { std::filesystem::current_path() };
 
 	app.Run();
 	return 0;
-}
\ No newline at end of file
+}